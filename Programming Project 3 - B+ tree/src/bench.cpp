@@ -0,0 +1,2167 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "btree.h"
+#include "buffer.h"
+#include "bufHashTbl.h"
+#include "file.h"
+#include "file_iterator.h"
+#include "filescan.h"
+#include "io_engine.h"
+#include "page.h"
+#include "page_iterator.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+const std::string benchRelationName = "benchRel";
+
+typedef std::chrono::steady_clock BenchClock;
+
+/**
+ * @brief Tuple layout of the relations main.cpp indexes.
+ */
+struct BenchRecord {
+    int i;
+    double d;
+    char s[64];
+};
+
+/**
+ * @brief A named benchmark that can be selected on the command line.
+ */
+struct Benchmark {
+    const char* name;
+    void (*run)();
+};
+
+// -----------------------------------------------------------------------------
+// Forward declarations
+// -----------------------------------------------------------------------------
+
+void createBenchRelation(const std::string& name, int numPages);
+void removeBenchRelation(const std::string& name);
+double secondsSince(const BenchClock::time_point& start);
+void benchConcurrentReadPage();
+void runReadPageThreads(BufMgr* bufMgr, File* file, int numPages, int numThreads, int opsPerThread);
+void benchHashTable();
+void createRandomRelation(const std::string& name, int numRecords, bool shuffled = true,
+                          std::uint16_t recordLength = 0,
+                          const std::vector<std::uint16_t>& columnLengths =
+                              std::vector<std::uint16_t>());
+void runPolicyWorkload(const char* name, ReplacementPolicyType policyType, int numRecords);
+void benchReplacementPolicies();
+void runScanProbeMix(const char* name, bool useRing, int numRecords);
+void benchScanResistance();
+void runDirtyWorkload(const char* name, const BufWriterConfig& config, int numPages);
+void benchBackgroundWriter();
+void dropFromOsCache(const std::string& name);
+std::uint64_t hashRecord(const char* data, std::size_t length, int rounds);
+void benchPrefetch();
+
+// Per-RID readPage/unPinPage pairs against batched readPages/unPinPages.
+void benchBatchRead();
+
+// flushFile on small files, against the size of the pool.
+void benchFlushFile();
+
+// Cost of sampling the buffer pool statistics, and a sample of each format.
+void benchStats();
+
+// Cost of a buffer miss served from the OS page cache, and of the file reads
+// underneath it.
+void benchMissCost();
+
+// Misses from several threads, and dirty evictions, on each file backend.
+void benchFileBackends();
+
+// Buffered against direct I/O: throughput, process RSS and OS cache held.
+std::size_t residentBytes();
+std::size_t osCachedBytes(const std::string& name);
+void benchDirectIO();
+
+// Batched reads and flushes against the I/O engine's queue depth.
+void benchQueueDepth();
+
+// PageFile::allocatePage and deletePage cost as the file grows.
+void benchAllocate();
+
+// Scans, random page reads and an index build through a MappedFile against
+// the PageFile and BufMgr path.
+void benchMappedFile();
+
+// Index leaf placement and range scans with and without extents.
+void benchExtents();
+
+// BlobFile size and disk usage under delete and reallocate churn.
+void fileMegabytes(const std::string& name, double& sizeMB, double& diskMB);
+void benchFreeMap();
+
+// Consecutive pages read and flushed one at a time against as vectored runs.
+void benchVectoredIO();
+
+// Scans reading records as copies against as views into the page, and an
+// index build.
+void benchRecordView();
+
+// Record deletes and inserts churning a page, with fixed and varying record
+// lengths.
+void benchPageChurn();
+
+// Slot reuse on a page with many slots, and scans of a page whose slots are
+// mostly unused.
+void benchPageSlots();
+
+// Relation size, scans and an index build with slotted pages against pages of
+// fixed-length records.
+void benchFixedPages();
+
+// Scans of one field, of whole records and of a column, and an index build,
+// on slotted pages, pages of fixed-length records and the PAX layout.
+std::int64_t sumIntColumn(const ColumnView& column);
+void benchPaxPages();
+
+const Benchmark benchmarks[] = {
+    { "concurrent", benchConcurrentReadPage },
+    { "hashtable", benchHashTable },
+    { "policies", benchReplacementPolicies },
+    { "scanmix", benchScanResistance },
+    { "bgwriter", benchBackgroundWriter },
+    { "prefetch", benchPrefetch },
+    { "batchread", benchBatchRead },
+    { "flushfile", benchFlushFile },
+    { "stats", benchStats },
+    { "misscost", benchMissCost },
+    { "backends", benchFileBackends },
+    { "directio", benchDirectIO },
+    { "qdepth", benchQueueDepth },
+    { "allocate", benchAllocate },
+    { "mmap", benchMappedFile },
+    { "extents", benchExtents },
+    { "freemap", benchFreeMap },
+    { "vectored", benchVectoredIO },
+    { "recordview", benchRecordView },
+    { "churn", benchPageChurn },
+    { "slots", benchPageSlots },
+    { "fixedpage", benchFixedPages },
+    { "pax", benchPaxPages },
+};
+
+int main(int argc, char** argv)
+{
+    const std::string which = argc > 1 ? argv[1] : "all";
+    bool ran = false;
+
+    for (const Benchmark& bench : benchmarks) {
+        if (which == "all" || which == bench.name) {
+            std::cout << "=== " << bench.name << " ===" << std::endl;
+            bench.run();
+            std::cout << std::endl;
+            ran = true;
+        }
+    }
+
+    if (!ran) {
+        std::cout << "Unknown benchmark: " << which << std::endl;
+        std::cout << "Available:";
+        for (const Benchmark& bench : benchmarks) {
+            std::cout << " " << bench.name;
+        }
+        std::cout << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+
+void createBenchRelation(const std::string& name, int numPages)
+{
+    removeBenchRelation(name);
+
+    PageFile file = PageFile::create(name);
+    char record[64];
+    memset(record, ' ', sizeof(record));
+
+    for (int i = 0; i < numPages; i++) {
+        PageId pageNo;
+        Page page = file.allocatePage(pageNo);
+        sprintf(record, "%08d bench record", i);
+        page.insertRecord(std::string(record, sizeof(record)));
+        file.writePage(pageNo, page);
+    }
+}
+
+void removeBenchRelation(const std::string& name)
+{
+    try {
+        File::remove(name);
+    }
+    catch (const FileNotFoundException&) {
+    }
+}
+
+double secondsSince(const BenchClock::time_point& start)
+{
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+// -----------------------------------------------------------------------------
+// benchConcurrentReadPage
+// -----------------------------------------------------------------------------
+
+void runReadPageThreads(BufMgr* bufMgr, File* file, int numPages, int numThreads, int opsPerThread)
+{
+    std::vector<std::thread> threads;
+    const BenchClock::time_point start = BenchClock::now();
+
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([=]() {
+            std::uint32_t seed = 12345u + 7919u * t;
+            Page* page;
+            for (int i = 0; i < opsPerThread; i++) {
+                seed = seed * 1103515245u + 12345u;
+                const PageId pageNo = 1 + (seed >> 8) % numPages;
+                bufMgr->readPage(file, pageNo, page);
+                bufMgr->unPinPage(file, pageNo, false);
+            }
+        }));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    const double secs = secondsSince(start);
+    const double ops = static_cast<double>(numThreads) * opsPerThread;
+    std::cout << std::setw(8) << numThreads << std::setw(16) << std::fixed << std::setprecision(0)
+              << ops / secs << std::endl;
+}
+
+void benchConcurrentReadPage()
+{
+    // readPage/unPinPage throughput with 1..N threads under each policy,
+    // first with the whole relation resident and then with a pool a quarter
+    // of its size.
+    const int numPages = 512;
+    const int opsPerThread = 200000;
+    int maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads < 4) {
+        maxThreads = 4;
+    }
+
+    createBenchRelation(benchRelationName, numPages);
+
+    const std::uint32_t poolSizes[] = { 2 * numPages, numPages / 4 };
+    const ReplacementPolicyType policies[] = { CLOCK, LRU_K, TWO_Q, ARC };
+    const char* policyNames[] = { "clock", "lru-2", "2q", "arc" };
+    for (std::uint32_t poolSize : poolSizes) {
+        for (int p = 0; p < 4; p++) {
+            BufMgr* bufMgr = new BufMgr(poolSize, policies[p]);
+            PageFile* file = new PageFile(benchRelationName, false);
+
+            std::cout << "pool " << poolSize << " frames, " << numPages << " pages, "
+                      << policyNames[p] << std::endl;
+            std::cout << std::setw(8) << "threads" << std::setw(16) << "ops/sec" << std::endl;
+            for (int threads = 1; threads <= maxThreads; threads *= 2) {
+                runReadPageThreads(bufMgr, file, numPages, threads, opsPerThread);
+            }
+
+            bufMgr->flushFile(file);
+            delete file;
+            delete bufMgr;
+        }
+    }
+
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchHashTable
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief The chained, exception-reporting hash table BufMgr used before
+ * BufHashTbl switched to open addressing.  Kept here as the baseline.
+ */
+class ChainedHashTbl {
+public:
+    explicit ChainedHashTbl(int htSize)
+        : htSize_(htSize)
+    {
+        ht_ = new Bucket*[htSize];
+        for (int i = 0; i < htSize; i++) {
+            ht_[i] = NULL;
+        }
+    }
+
+    ~ChainedHashTbl()
+    {
+        for (int i = 0; i < htSize_; i++) {
+            while (ht_[i]) {
+                Bucket* tmp = ht_[i];
+                ht_[i] = ht_[i]->next;
+                delete tmp;
+            }
+        }
+        delete[] ht_;
+    }
+
+    void insert(const File* file, const PageId pageNo, const FrameId frameNo)
+    {
+        const int index = hash(file, pageNo);
+        Bucket* bucket = new Bucket;
+        bucket->file = file;
+        bucket->pageNo = pageNo;
+        bucket->frameNo = frameNo;
+        bucket->next = ht_[index];
+        ht_[index] = bucket;
+    }
+
+    void lookup(const File* file, const PageId pageNo, FrameId& frameNo)
+    {
+        for (Bucket* bucket = ht_[hash(file, pageNo)]; bucket; bucket = bucket->next) {
+            if (bucket->file == file && bucket->pageNo == pageNo) {
+                frameNo = bucket->frameNo;
+                return;
+            }
+        }
+        throw HashNotFoundException(file->filename(), pageNo);
+    }
+
+    void remove(const File* file, const PageId pageNo)
+    {
+        const int index = hash(file, pageNo);
+        Bucket* prev = NULL;
+        for (Bucket* bucket = ht_[index]; bucket; prev = bucket, bucket = bucket->next) {
+            if (bucket->file == file && bucket->pageNo == pageNo) {
+                if (prev) {
+                    prev->next = bucket->next;
+                }
+                else {
+                    ht_[index] = bucket->next;
+                }
+                delete bucket;
+                return;
+            }
+        }
+        throw HashNotFoundException(file->filename(), pageNo);
+    }
+
+private:
+    struct Bucket {
+        const File* file;
+        PageId pageNo;
+        FrameId frameNo;
+        Bucket* next;
+    };
+
+    int hash(const File* file, const PageId pageNo)
+    {
+        // same truncating hash as before, made non-negative so it cannot
+        // index outside the table
+        const unsigned int tmp = static_cast<unsigned int>(reinterpret_cast<std::uintptr_t>(file));
+        return (tmp + pageNo) % htSize_;
+    }
+
+    int htSize_;
+    Bucket** ht_;
+};
+
+template <class Table, class Key, class Lookup>
+void timeHashTable(const char* name, Table& table, const std::vector<Key>& files, int numEntries, Lookup lookup)
+{
+    const int numFiles = files.size();
+    const int rounds = 2000000;
+    FrameId frameNo = 0;
+    std::uint64_t checksum = 0;
+
+    for (int i = 0; i < numEntries; i++) {
+        table.insert(files[i % numFiles], 1 + i / numFiles, i);
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < rounds; i++) {
+        const int key = static_cast<int>((i * 7919ull) % numEntries);
+        if (lookup(table, files[key % numFiles], 1 + key / numFiles, frameNo)) {
+            checksum += frameNo;
+        }
+    }
+    const double hitNs = secondsSince(start) * 1e9 / rounds;
+
+    const int missRounds = rounds / 10;
+    start = BenchClock::now();
+    for (int i = 0; i < missRounds; i++) {
+        const int key = static_cast<int>((i * 7919ull) % numEntries);
+        if (lookup(table, files[key % numFiles], 1 + numEntries + key, frameNo)) {
+            checksum += frameNo;
+        }
+    }
+    const double missNs = secondsSince(start) * 1e9 / missRounds;
+
+    start = BenchClock::now();
+    for (int i = 0; i < rounds; i++) {
+        const int key = static_cast<int>((i * 7919ull) % numEntries);
+        const PageId pageNo = 1 + key / numFiles;
+        table.remove(files[key % numFiles], pageNo);
+        table.insert(files[key % numFiles], pageNo, key);
+    }
+    const double churnNs = secondsSince(start) * 1e9 / rounds;
+
+    std::cout << std::setw(10) << name << std::fixed << std::setprecision(1)
+              << std::setw(12) << hitNs << std::setw(12) << missNs << std::setw(16) << churnNs
+              << "   (checksum " << checksum << ")" << std::endl;
+}
+
+void benchHashTable()
+{
+    // Hit lookups, miss lookups and remove+insert pairs on a table holding one
+    // entry per frame of a 1000 frame pool, spread over four files.
+    const int numEntries = 1000;
+    const int htsize = ((((int)(numEntries * 1.2)) * 2) / 2) + 1;
+    std::vector<PageFile*> files;
+
+    for (int i = 0; i < 4; i++) {
+        const std::string name = benchRelationName + std::to_string(i);
+        removeBenchRelation(name);
+        files.push_back(new PageFile(name, true));
+    }
+
+    std::cout << std::setw(10) << "table" << std::setw(12) << "hit ns" << std::setw(12) << "miss ns"
+              << std::setw(16) << "remove+ins ns" << std::endl;
+    {
+        ChainedHashTbl chained(htsize);
+        timeHashTable("chained", chained, files, numEntries,
+            [](ChainedHashTbl& table, const File* file, PageId pageNo, FrameId& frameNo) {
+                try {
+                    table.lookup(file, pageNo, frameNo);
+                    return true;
+                }
+                catch (const HashNotFoundException&) {
+                    return false;
+                }
+            });
+    }
+    {
+        // BufHashTbl is keyed by file identity rather than by address
+        std::vector<std::uint64_t> fileIds;
+        for (std::size_t i = 0; i < files.size(); i++) {
+            fileIds.push_back(files[i]->id());
+        }
+        BufHashTbl open(htsize);
+        timeHashTable("open", open, fileIds, numEntries,
+            [](BufHashTbl& table, std::uint64_t fileId, PageId pageNo, FrameId& frameNo) {
+                return table.lookup(fileId, pageNo, frameNo);
+            });
+    }
+
+    for (std::size_t i = 0; i < files.size(); i++) {
+        const std::string name = files[i]->filename();
+        delete files[i];
+        removeBenchRelation(name);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// benchReplacementPolicies
+// -----------------------------------------------------------------------------
+
+void createRandomRelation(const std::string& name, int numRecords, bool shuffled,
+                          std::uint16_t recordLength,
+                          const std::vector<std::uint16_t>& columnLengths)
+{
+    removeBenchRelation(name);
+
+    PageFile file = !columnLengths.empty() ? PageFile::create(name, columnLengths)
+                    : recordLength > 0     ? PageFile::create(name, recordLength)
+                                           : PageFile::create(name);
+    BenchRecord record;
+    memset(&record, 0, sizeof(record));
+
+    std::vector<int> keys(numRecords);
+    for (int i = 0; i < numRecords; i++) {
+        keys[i] = i;
+    }
+    std::uint32_t seed = 4242u;
+    for (int i = numRecords - 1; i > 0 && shuffled; i--) {
+        seed = seed * 1103515245u + 12345u;
+        std::swap(keys[i], keys[(seed >> 8) % (i + 1)]);
+    }
+
+    PageId pageNo;
+    Page page = file.allocatePage(pageNo);
+    for (int i = 0; i < numRecords; i++) {
+        record.i = keys[i];
+        record.d = keys[i];
+        sprintf(record.s, "%05d string record", keys[i]);
+        const std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+        try {
+            page.insertRecord(data);
+        }
+        catch (const InsufficientSpaceException&) {
+            file.writePage(pageNo, page);
+            page = file.allocatePage(pageNo);
+            page.insertRecord(data);
+        }
+    }
+    file.writePage(pageNo, page);
+}
+
+void runPolicyWorkload(const char* name, ReplacementPolicyType policyType, int numRecords)
+{
+    const std::uint32_t poolSize = 64;
+    const int numScans = 400;
+    BufMgr* bufMgr = new BufMgr(poolSize, policyType);
+    PageFile* relation = new PageFile(benchRelationName, false);
+    std::string indexName;
+    std::uint64_t checksum = 0;
+
+    BTreeIndex* index = new BTreeIndex(benchRelationName, indexName, bufMgr,
+                                       offsetof(BenchRecord, i), INTEGER);
+    const std::uint64_t buildAccesses = bufMgr->getBufStats().accesses;
+    const std::uint64_t buildReads = bufMgr->getBufStats().diskreads;
+    bufMgr->clearBufStats();
+
+    // Mostly short index range scans over a hot fiftieth of the key space, some
+    // anywhere in it, and now and then a full sequential scan of the relation.
+    std::uint32_t seed = 777u;
+    for (int scan = 0; scan < numScans; scan++) {
+        seed = seed * 1103515245u + 12345u;
+        const int hot = (seed >> 8) % 10 < 8;
+        seed = seed * 1103515245u + 12345u;
+        const int low = hot ? (seed >> 8) % (numRecords / 50) : (seed >> 8) % numRecords;
+        const int high = low + 20;
+
+        if (scan % 100 == 99) {
+            FileScan fileScan(benchRelationName, bufMgr);
+            RecordId rid;
+            try {
+                while (1) {
+                    fileScan.scanNext(rid);
+                    checksum += rid.slot_number;
+                }
+            }
+            catch (const EndOfFileException&) {
+            }
+        }
+
+        try {
+            index->startScan(&low, GTE, &high, LT);
+        }
+        catch (const NoSuchKeyFoundException&) {
+            continue;
+        }
+        RecordId rid;
+        Page* page;
+        try {
+            while (1) {
+                index->scanNext(rid);
+                bufMgr->readPage(relation, rid.page_number, page);
+                checksum += reinterpret_cast<const BenchRecord*>(page->getRecord(rid).data())->i;
+                bufMgr->unPinPage(relation, rid.page_number, false);
+            }
+        }
+        catch (const IndexScanCompletedException&) {
+        }
+        index->endScan();
+    }
+
+    const std::uint64_t accesses = bufMgr->getBufStats().accesses;
+    const std::uint64_t reads = bufMgr->getBufStats().diskreads;
+    std::cout << std::setw(8) << name << std::fixed << std::setprecision(1)
+              << std::setw(14) << buildReads << std::setw(10) << 100.0 * (buildAccesses - buildReads) / buildAccesses
+              << std::setw(14) << reads << std::setw(10) << 100.0 * (accesses - reads) / accesses
+              << "   (checksum " << checksum << ")" << std::endl;
+
+    delete index;
+    bufMgr->flushFile(relation);
+    delete relation;
+    delete bufMgr;
+    removeBenchRelation(indexName);
+}
+
+void benchReplacementPolicies()
+{
+    // Disk reads and hit ratios of each replacement policy with a 64 frame
+    // pool, for building an index over a shuffled relation and for a skewed
+    // mix of index range scans and sequential scans over it.
+    const int numRecords = 20000;
+    createRandomRelation(benchRelationName, numRecords);
+
+    std::cout << std::setw(8) << "policy" << std::setw(14) << "build reads" << std::setw(10) << "hit %"
+              << std::setw(14) << "scan reads" << std::setw(10) << "hit %" << std::endl;
+    runPolicyWorkload("clock", CLOCK, numRecords);
+    runPolicyWorkload("lru-2", LRU_K, numRecords);
+    runPolicyWorkload("2q", TWO_Q, numRecords);
+    runPolicyWorkload("arc", ARC, numRecords);
+
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchScanResistance
+// -----------------------------------------------------------------------------
+
+void runScanProbeMix(const char* name, bool useRing, int numRecords)
+{
+    const std::uint32_t poolSize = 64;
+    const int numRounds = 20;
+    const int probesPerRound = 200;
+    const std::string scanRelationName = benchRelationName + "Scan";
+    BufMgr* bufMgr = new BufMgr(poolSize);
+    PageFile* relation = new PageFile(benchRelationName, false);
+    std::string indexName;
+    std::uint64_t checksum = 0;
+    std::uint64_t probeAccesses = 0;
+    std::uint64_t probeReads = 0;
+
+    BTreeIndex* index = new BTreeIndex(benchRelationName, indexName, bufMgr,
+                                       offsetof(BenchRecord, i), INTEGER);
+    bufMgr->clearBufStats();
+
+    // Rounds of short index probes over a hot set of keys, each followed by a
+    // sequential scan of a relation several times the size of the pool.
+    std::uint32_t seed = 99u;
+    for (int round = 0; round < numRounds; round++) {
+        const std::uint64_t accessesBefore = bufMgr->getBufStats().accesses;
+        const std::uint64_t readsBefore = bufMgr->getBufStats().diskreads;
+        for (int probe = 0; probe < probesPerRound; probe++) {
+            seed = seed * 1103515245u + 12345u;
+            const int low = (seed >> 8) % (numRecords / 500);
+            const int high = low + 3;
+            try {
+                index->startScan(&low, GTE, &high, LT);
+            }
+            catch (const NoSuchKeyFoundException&) {
+                continue;
+            }
+            RecordId rid;
+            Page* page;
+            try {
+                while (1) {
+                    index->scanNext(rid);
+                    bufMgr->readPage(relation, rid.page_number, page);
+                    checksum += reinterpret_cast<const BenchRecord*>(page->getRecord(rid).data())->i;
+                    bufMgr->unPinPage(relation, rid.page_number, false);
+                }
+            }
+            catch (const IndexScanCompletedException&) {
+            }
+            index->endScan();
+        }
+        probeAccesses += bufMgr->getBufStats().accesses - accessesBefore;
+        probeReads += bufMgr->getBufStats().diskreads - readsBefore;
+
+        BufAccessStrategy ring;
+        FileScan fileScan(scanRelationName, bufMgr, useRing ? &ring : NULL);
+        RecordId rid;
+        try {
+            while (1) {
+                fileScan.scanNext(rid);
+                checksum += rid.page_number;
+            }
+        }
+        catch (const EndOfFileException&) {
+        }
+    }
+
+    const std::uint64_t accesses = bufMgr->getBufStats().accesses;
+    const std::uint64_t reads = bufMgr->getBufStats().diskreads;
+    std::cout << std::setw(8) << name << std::fixed << std::setprecision(1)
+              << std::setw(14) << probeReads << std::setw(10) << 100.0 * (probeAccesses - probeReads) / probeAccesses
+              << std::setw(14) << reads << std::setw(10) << 100.0 * (accesses - reads) / accesses
+              << "   (checksum " << checksum << ")" << std::endl;
+
+    delete index;
+    bufMgr->flushFile(relation);
+    delete relation;
+    delete bufMgr;
+    removeBenchRelation(indexName);
+}
+
+void benchScanResistance()
+{
+    // Pool hit ratio with a 64 frame pool for index probes interleaved with
+    // sequential scans of a 400 page relation, with the scans reading through
+    // the shared pool and through a BufAccessStrategy ring.
+    const int numRecords = 20000;
+    const int scanPages = 400;
+    createRandomRelation(benchRelationName, numRecords);
+    createBenchRelation(benchRelationName + "Scan", scanPages);
+
+    std::cout << std::setw(8) << "scans" << std::setw(14) << "probe reads" << std::setw(10) << "hit %"
+              << std::setw(14) << "total reads" << std::setw(10) << "hit %" << std::endl;
+    runScanProbeMix("shared", false, numRecords);
+    runScanProbeMix("ring", true, numRecords);
+
+    removeBenchRelation(benchRelationName + "Scan");
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchBackgroundWriter
+// -----------------------------------------------------------------------------
+
+void runDirtyWorkload(const char* name, const BufWriterConfig& config, int numPages)
+{
+    const std::uint32_t poolSize = 64;
+    const int numOps = 100000;
+    BufMgr* bufMgr = new BufMgr(poolSize);
+    bufMgr->setWriterConfig(config);
+    PageFile* file = new PageFile(benchRelationName, false);
+
+    // Random pages, half of them updated; every miss needs a victim, and
+    // half the victims are dirty unless someone cleaned them first.
+    std::uint32_t seed = 31337u;
+    Page* page;
+    const BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < numOps; i++) {
+        seed = seed * 1103515245u + 12345u;
+        const PageId pageNo = 1 + (seed >> 8) % numPages;
+        const bool update = (seed >> 4) & 1;
+        bufMgr->readPage(file, pageNo, page);
+        if (update) {
+            page->getRecord(page->begin().getCurrentRecord());
+        }
+        bufMgr->unPinPage(file, pageNo, update);
+    }
+    const double secs = secondsSince(start);
+
+    const BufStats& stats = bufMgr->getBufStats();
+    std::cout << std::setw(10) << name << std::fixed << std::setprecision(0)
+              << std::setw(12) << numOps / secs
+              << std::setw(10) << stats.diskreads
+              << std::setw(14) << stats.victimwrites
+              << std::setw(10) << stats.bgwrites
+              << std::setw(10) << stats.bgrounds << std::endl;
+
+    bufMgr->flushFile(file);
+    delete file;
+    delete bufMgr;
+}
+
+void benchBackgroundWriter()
+{
+    // Foreground read/update throughput and who paid for the writes, with a
+    // 64 frame pool over a 512 page relation.
+    const int numPages = 512;
+    createBenchRelation(benchRelationName, numPages);
+
+    std::cout << std::setw(10) << "writer" << std::setw(12) << "ops/sec" << std::setw(10) << "reads"
+              << std::setw(14) << "victim writes" << std::setw(10) << "bg writes"
+              << std::setw(10) << "rounds" << std::endl;
+
+    BufWriterConfig config;
+    runDirtyWorkload("off", config, numPages);
+
+    config.enabled = true;
+    runDirtyWorkload("10ms", config, numPages);
+
+    config.delayMs = 1;
+    runDirtyWorkload("1ms", config, numPages);
+
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchPrefetch
+// -----------------------------------------------------------------------------
+
+void dropFromOsCache(const std::string& name)
+{
+    // evict the file's pages from the OS page cache so that reads go to disk
+    const int fd = open(name.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+std::uint64_t hashRecord(const char* data, std::size_t length, int rounds)
+{
+    // stands in for evaluating a predicate on the record
+    std::uint64_t h = 14695981039346656037ull;
+    for (int r = 0; r < rounds; r++) {
+        for (std::size_t i = 0; i < length; i++) {
+            h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+        }
+    }
+    return h;
+}
+
+void benchPrefetch()
+{
+    // Cold-cache sequential scans of a 4096 page relation through a 64 frame
+    // pool, page by page with readPage and through FileScan, which prefetches
+    // once it sees consecutive pages.  Each record is hashed a number of times
+    // to stand in for the work done per record.
+    const int numPages = 4096;
+    const int workRounds[] = { 0, 20 };
+    createBenchRelation(benchRelationName, numPages);
+
+    std::cout << std::setw(12) << "scan" << std::setw(8) << "work" << std::setw(10) << "secs" << std::setw(10) << "reads"
+              << std::setw(12) << "prefetched" << std::endl;
+
+    for (int run = 0; run < 4; run++) {
+        const int work = workRounds[run / 2];
+        BufMgr* bufMgr = new BufMgr(64);
+        BufAccessStrategy ring;
+        std::uint64_t checksum = 0;
+        dropFromOsCache(benchRelationName);
+
+        const BenchClock::time_point start = BenchClock::now();
+        if (run % 2 == 0) {
+            PageFile* file = new PageFile(benchRelationName, false);
+            Page* page;
+            for (PageId pageNo = 1; pageNo <= static_cast<PageId>(numPages); pageNo++) {
+                bufMgr->readPage(file, pageNo, page, &ring);
+                for (PageIterator it = page->begin(); it != page->end(); ++it) {
+                    const std::string record = *it;
+                    checksum += hashRecord(record.data(), record.size(), work);
+                }
+                bufMgr->unPinPage(file, pageNo, false);
+            }
+            bufMgr->flushFile(file);
+            delete file;
+        }
+        else {
+            FileScan fileScan(benchRelationName, bufMgr, &ring);
+            RecordId rid;
+            try {
+                while (1) {
+                    fileScan.scanNext(rid);
+                    const std::string record = fileScan.getRecord();
+                    checksum += hashRecord(record.data(), record.size(), work);
+                }
+            }
+            catch (const EndOfFileException&) {
+            }
+        }
+        const double secs = secondsSince(start);
+
+        std::cout << std::setw(12) << (run % 2 == 0 ? "readPage" : "FileScan") << std::setw(8) << work
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(10) << secs << std::setw(10) << bufMgr->getBufStats().diskreads
+                  << std::setw(12) << bufMgr->getBufStats().prefetches
+                  << "   (checksum " << checksum << ")" << std::endl;
+        delete bufMgr;
+    }
+
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchBatchRead
+// -----------------------------------------------------------------------------
+
+void benchBatchRead()
+{
+    // Fetches 200000 RIDs of a 2048 page relation, the way an index scan hands
+    // them out: clustered, 20 consecutive RIDs per page, and unclustered, each
+    // on a random page.  The pool holds the whole relation, and is warmed by a
+    // first pass that is not timed; a cold pass on a fresh pool is timed too.
+    const int numPages = 2048;
+    const int numRids = 200000;
+    const size_t batchSize = 32;
+    createBenchRelation(benchRelationName, numPages);
+
+    std::vector<PageId> clustered;
+    std::vector<PageId> unclustered;
+    std::uint32_t seed = 4242u;
+    for (int i = 0; i < numRids; i++) {
+        clustered.push_back(1 + (i / 20) % numPages);
+        seed = seed * 1103515245u + 12345u;
+        unclustered.push_back(1 + (seed >> 8) % numPages);
+    }
+
+    std::cout << std::setw(12) << "order" << std::setw(8) << "pool" << std::setw(10) << "api" << std::setw(10) << "secs"
+              << std::setw(10) << "reads" << std::endl;
+
+    for (int run = 0; run < 8; run++) {
+        const std::vector<PageId>& rids = (run / 4) == 0 ? clustered : unclustered;
+        const bool warm = (run / 2) % 2 == 1;
+        const bool batched = run % 2 == 1;
+        BufMgr* bufMgr = new BufMgr(numPages + 64);
+        PageFile* file = new PageFile(benchRelationName, false);
+        std::uint64_t checksum = 0;
+
+        for (int pass = warm ? 0 : 1; pass < 2; pass++) {
+            bufMgr->clearBufStats();
+            const BenchClock::time_point start = BenchClock::now();
+            if (batched) {
+                std::vector<PageId> pageNos;
+                std::vector<Page*> pages;
+                for (size_t i = 0; i < rids.size(); i += batchSize) {
+                    pageNos.assign(rids.begin() + i, rids.begin() + std::min(i + batchSize, rids.size()));
+                    bufMgr->readPages(file, pageNos, pages);
+                    for (size_t k = 0; k < pages.size(); k++) {
+                        checksum += pages[k]->page_number();
+                    }
+                    bufMgr->unPinPages(file, pageNos, false);
+                }
+            }
+            else {
+                Page* page;
+                for (size_t i = 0; i < rids.size(); i++) {
+                    bufMgr->readPage(file, rids[i], page);
+                    checksum += page->page_number();
+                    bufMgr->unPinPage(file, rids[i], false);
+                }
+            }
+            const double secs = secondsSince(start);
+
+            if (pass == 1) {
+                std::cout << std::setw(12) << ((run / 4) == 0 ? "clustered" : "random") << std::setw(8) << (warm ? "warm" : "cold")
+                          << std::setw(10) << (batched ? "batch" : "single")
+                          << std::fixed << std::setprecision(3)
+                          << std::setw(10) << secs << std::setw(10) << bufMgr->getBufStats().diskreads
+                          << "   (checksum " << checksum << ")" << std::endl;
+            }
+        }
+
+        bufMgr->flushFile(file);
+        delete file;
+        delete bufMgr;
+    }
+
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchFlushFile
+// -----------------------------------------------------------------------------
+
+void benchFlushFile()
+{
+    // Opens a 4 page file, reads it in, dirties it and flushes it, 500 times
+    // over, the way short-lived scans and indexes do, with pools of growing
+    // size.  The pool also holds a 512 page relation that stays resident.
+    const int numPages = 4;
+    const int numRounds = 500;
+    const int residentPages = 512;
+    const std::uint32_t poolSizes[] = { 1024, 16384, 131072 };
+    const std::string smallName = benchRelationName + ".small";
+    createBenchRelation(benchRelationName, residentPages);
+    createBenchRelation(smallName, numPages);
+
+    std::cout << std::setw(10) << "frames" << std::setw(14) << "usec/flush" << std::setw(10) << "writes" << std::endl;
+
+    for (std::uint32_t poolSize : poolSizes) {
+        BufMgr* bufMgr = new BufMgr(poolSize);
+        PageFile* resident = new PageFile(benchRelationName, false);
+        Page* page;
+        for (PageId pageNo = 1; pageNo <= static_cast<PageId>(residentPages); pageNo++) {
+            bufMgr->readPage(resident, pageNo, page);
+            bufMgr->unPinPage(resident, pageNo, false);
+        }
+        bufMgr->clearBufStats();
+
+        double flushSecs = 0;
+        for (int round = 0; round < numRounds; round++) {
+            PageFile* file = new PageFile(smallName, false);
+            for (PageId pageNo = numPages; pageNo >= 1; pageNo--) {
+                bufMgr->readPage(file, pageNo, page);
+                bufMgr->unPinPage(file, pageNo, true);
+            }
+            const BenchClock::time_point start = BenchClock::now();
+            bufMgr->flushFile(file);
+            flushSecs += secondsSince(start);
+            delete file;
+        }
+
+        std::cout << std::setw(10) << poolSize << std::fixed << std::setprecision(2)
+                  << std::setw(14) << flushSecs * 1e6 / numRounds
+                  << std::setw(10) << bufMgr->getBufStats().diskwrites << std::endl;
+        bufMgr->flushFile(resident);
+        delete resident;
+        delete bufMgr;
+    }
+
+    removeBenchRelation(smallName);
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchStats
+// -----------------------------------------------------------------------------
+
+void benchStats()
+{
+    // Runs 200000 random page requests over 4 files through a 256 frame pool,
+    // then times dumping the statistics in each format, as a monitoring agent
+    // sampling them would.
+    const int numFiles = 4;
+    const int numPages = 128;
+    const int numOps = 200000;
+    const int numDumps = 1000;
+    BufMgr* bufMgr = new BufMgr(256);
+    std::vector<PageFile*> files;
+    for (int f = 0; f < numFiles; f++) {
+        const std::string name = benchRelationName + "." + std::to_string(f);
+        createBenchRelation(name, numPages);
+        files.push_back(new PageFile(name, false));
+    }
+
+    std::uint32_t seed = 777u;
+    Page* page;
+    const BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < numOps; i++) {
+        seed = seed * 1103515245u + 12345u;
+        PageFile* file = files[(seed >> 4) % numFiles];
+        const PageId pageNo = 1 + (seed >> 12) % numPages;
+        bufMgr->readPage(file, pageNo, page);
+        bufMgr->unPinPage(file, pageNo, (seed & 7) == 0);
+    }
+    const double opSecs = secondsSince(start);
+
+    std::cout << "readPage+unPinPage: " << std::fixed << std::setprecision(1) << opSecs * 1e9 / numOps << " ns/op" << std::endl;
+    const BufStatsFormat formats[] = { STATS_TEXT, STATS_JSON };
+    std::string samples[2];
+    for (int f = 0; f < 2; f++) {
+        const BenchClock::time_point dumpStart = BenchClock::now();
+        for (int i = 0; i < numDumps; i++) {
+            std::ostringstream out;
+            bufMgr->printStats(out, formats[f]);
+            samples[f] = out.str();
+        }
+        std::cout << (f == 0 ? "printStats text: " : "printStats json: ") << std::setprecision(2)
+                  << secondsSince(dumpStart) * 1e6 / numDumps << " usec/dump, " << samples[f].size() << " bytes" << std::endl;
+    }
+    std::cout << std::endl << samples[1];
+
+    for (int f = 0; f < numFiles; f++) {
+        bufMgr->flushFile(files[f]);
+        const std::string name = files[f]->filename();
+        delete files[f];
+        removeBenchRelation(name);
+    }
+    delete bufMgr;
+}
+
+// -----------------------------------------------------------------------------
+// benchMissCost
+// -----------------------------------------------------------------------------
+
+void benchMissCost()
+{
+    // Reads a 4096 page relation, which the OS has cached, through a 64 frame
+    // pool so that every request misses: first straight from the file, into a
+    // returned page and into a caller's page, then through the pool, with the
+    // victims clean and with them dirty.
+    const int numPages = 4096;
+    const int numRounds = 8;
+    createBenchRelation(benchRelationName, numPages);
+
+    std::vector<PageId> order;
+    std::uint32_t seed = 99u;
+    for (int i = 0; i < numPages * numRounds; i++) {
+        seed = seed * 1103515245u + 12345u;
+        order.push_back(1 + (seed >> 8) % numPages);
+    }
+
+    std::cout << std::setw(24) << "path" << std::setw(12) << "ns/page" << std::setw(10) << "reads" << std::endl;
+
+    PageFile* file = new PageFile(benchRelationName, false);
+    std::uint64_t checksum = 0;
+    for (int run = 0; run < 2; run++) {
+        Page page;
+        const BenchClock::time_point start = BenchClock::now();
+        for (size_t i = 0; i < order.size(); i++) {
+            if (run == 0) {
+                page = file->readPage(order[i]);
+            }
+            else {
+                file->readPageInto(order[i], page);
+            }
+            checksum += page.page_number();
+        }
+        const double secs = secondsSince(start);
+        std::cout << std::setw(24) << (run == 0 ? "File::readPage" : "File::readPageInto")
+                  << std::fixed << std::setprecision(1) << std::setw(12) << secs * 1e9 / order.size()
+                  << std::setw(10) << "-" << std::endl;
+    }
+
+    for (int run = 0; run < 2; run++) {
+        const bool dirty = run == 1;
+        BufMgr* bufMgr = new BufMgr(64);
+        Page* page;
+        const BenchClock::time_point start = BenchClock::now();
+        for (size_t i = 0; i < order.size(); i++) {
+            bufMgr->readPage(file, order[i], page);
+            checksum += page->page_number();
+            bufMgr->unPinPage(file, order[i], dirty);
+        }
+        const double secs = secondsSince(start);
+        std::cout << std::setw(24) << (dirty ? "BufMgr miss, dirty" : "BufMgr miss, clean")
+                  << std::fixed << std::setprecision(1) << std::setw(12) << secs * 1e9 / order.size()
+                  << std::setw(10) << bufMgr->getBufStats().diskreads << std::endl;
+        bufMgr->flushFile(file);
+        delete bufMgr;
+    }
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+
+    delete file;
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchFileBackends
+// -----------------------------------------------------------------------------
+
+void benchFileBackends()
+{
+    // A 4096 page relation, which the OS has cached, behind a 64 frame pool, so
+    // that nearly every request misses: random readPage/unPinPage throughput
+    // with 1..N threads, then a single thread dirtying every page it reads so
+    // that each miss also writes its victim back.
+    const int numPages = 4096;
+    const int opsPerThread = 20000;
+    const int dirtyOps = 32768;
+    int maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads < 4) {
+        maxThreads = 4;
+    }
+    const FileBackendType backends[] = { STREAM_BACKEND, POSIX_BACKEND };
+    const FileBackendType savedBackend = File::backend();
+
+    createBenchRelation(benchRelationName, numPages);
+
+    for (FileBackendType backend : backends) {
+        File::setBackend(backend);
+        BufMgr* bufMgr = new BufMgr(64);
+        PageFile* file = new PageFile(benchRelationName, false);
+
+        std::cout << (backend == POSIX_BACKEND ? "pread/pwrite" : "fstream") << std::endl;
+        std::cout << std::setw(8) << "threads" << std::setw(16) << "ops/sec" << std::endl;
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            runReadPageThreads(bufMgr, file, numPages, threads, opsPerThread);
+        }
+
+        std::uint32_t seed = 31337u;
+        Page* page;
+        const BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < dirtyOps; i++) {
+            seed = seed * 1103515245u + 12345u;
+            const PageId pageNo = 1 + (seed >> 8) % numPages;
+            bufMgr->readPage(file, pageNo, page);
+            bufMgr->unPinPage(file, pageNo, true);
+        }
+        const double secs = secondsSince(start);
+        std::cout << std::setw(8) << "dirty" << std::setw(16) << std::fixed << std::setprecision(0)
+                  << dirtyOps / secs << "   (" << bufMgr->getBufStats().diskwrites << " writes)" << std::endl;
+
+        bufMgr->flushFile(file);
+        delete file;
+        delete bufMgr;
+    }
+
+    File::setBackend(savedBackend);
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchDirectIO
+// -----------------------------------------------------------------------------
+
+std::size_t residentBytes()
+{
+    long pages = 0;
+    long resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+        if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return static_cast<std::size_t>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+std::size_t osCachedBytes(const std::string& name)
+{
+    // pages of the file the OS page cache holds
+    std::size_t cached = 0;
+    const int fd = open(name.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        const long pageSize = sysconf(_SC_PAGESIZE);
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            std::vector<unsigned char> incore((st.st_size + pageSize - 1) / pageSize);
+            if (mincore(map, st.st_size, &incore[0]) == 0) {
+                for (unsigned char page : incore) {
+                    cached += (page & 1) * pageSize;
+                }
+            }
+            munmap(map, st.st_size);
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return cached;
+}
+
+void benchDirectIO()
+{
+    // 200000 random requests, one in eight dirtying its page, over an 8192 page
+    // (64 MB) relation through a 1024 frame (8 MB) pool, starting with the
+    // relation out of the OS cache.  Buffered I/O soon serves every miss from
+    // the OS cache, which ends up holding the whole relation besides the pool;
+    // direct I/O goes to the device on every miss and caches only the pool.
+    const int numPages = 8192;
+    const int numOps = 200000;
+    const std::uint32_t poolSize = 1024;
+    const FileBackendType savedBackend = File::backend();
+
+    createBenchRelation(benchRelationName, numPages);
+
+    std::cout << std::setw(18) << "mode" << std::setw(10) << "secs" << std::setw(12) << "ops/sec"
+              << std::setw(10) << "RSS MB" << std::setw(14) << "OS cache MB" << std::endl;
+
+    for (int run = 0; run < 3; run++) {
+        const bool direct = run > 0;
+        const bool hugePages = run == 2;
+        File::setBackend(direct ? DIRECT_BACKEND : POSIX_BACKEND);
+        dropFromOsCache(benchRelationName);
+
+        BufMgr* bufMgr = new BufMgr(poolSize, CLOCK, hugePages);
+        PageFile* file = new PageFile(benchRelationName, false);
+        std::uint32_t seed = 2024u;
+        std::uint64_t checksum = 0;
+        Page* page;
+        const BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < numOps; i++) {
+            seed = seed * 1103515245u + 12345u;
+            const PageId pageNo = 1 + (seed >> 8) % numPages;
+            bufMgr->readPage(file, pageNo, page);
+            checksum += page->page_number();
+            bufMgr->unPinPage(file, pageNo, (seed & 7) == 0);
+        }
+        const double secs = secondsSince(start);
+
+        std::cout << std::setw(18) << (hugePages ? "direct+hugepages" : direct ? "direct" : "buffered")
+                  << std::fixed << std::setprecision(2) << std::setw(10) << secs
+                  << std::setprecision(0) << std::setw(12) << numOps / secs
+                  << std::setprecision(1) << std::setw(10) << residentBytes() / 1048576.0
+                  << std::setw(14) << osCachedBytes(benchRelationName) / 1048576.0
+                  << "   (checksum " << checksum << ")" << std::endl;
+
+        bufMgr->flushFile(file);
+        delete file;
+        delete bufMgr;
+    }
+
+    File::setBackend(savedBackend);
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchQueueDepth
+// -----------------------------------------------------------------------------
+
+void benchQueueDepth()
+{
+    // Direct I/O, so that every read and write goes to the device: 64 random
+    // pages at a time read with readPages into a pool that has room for them
+    // all, then every one of them dirtied and written by flushFile, for each
+    // engine and queue depth.  The first line reads page by page with
+    // readPage, for comparison.
+    const int numPages = 8192;
+    const int numBatches = 64;
+    const size_t batchSize = 64;
+    const unsigned depths[] = { 1, 4, 16, 64 };
+    const IOEngineType engines[] = { URING_ENGINE, THREAD_ENGINE };
+    const FileBackendType savedBackend = File::backend();
+    const IOEngineType savedEngine = IOEngine::get()->type();
+
+    createBenchRelation(benchRelationName, numPages);
+    File::setBackend(DIRECT_BACKEND);
+
+    std::vector<PageId> pageNos;
+    std::uint32_t seed = 8086u;
+    for (int i = 0; i < numBatches * static_cast<int>(batchSize); i++) {
+        seed = seed * 1103515245u + 12345u;
+        pageNos.push_back(1 + (seed >> 8) % numPages);
+    }
+
+    std::cout << std::setw(10) << "engine" << std::setw(8) << "depth" << std::setw(14) << "read pg/s"
+              << std::setw(14) << "flush pg/s" << std::endl;
+
+    for (int run = -1; run < 8; run++) {
+        const bool single = run < 0;
+        IOEngineType engine = URING_ENGINE;
+        unsigned depth = 1;
+        if (!single) {
+            engine = IOEngine::select(engines[run / 4], depths[run % 4]);
+            depth = depths[run % 4];
+        }
+
+        BufMgr* bufMgr = new BufMgr(numPages + 64);
+        PageFile* file = new PageFile(benchRelationName, false);
+        std::uint64_t checksum = 0;
+        std::vector<PageId> batch;
+        std::vector<Page*> pages;
+
+        const BenchClock::time_point start = BenchClock::now();
+        for (size_t i = 0; i < pageNos.size(); i += batchSize) {
+            batch.assign(pageNos.begin() + i, pageNos.begin() + i + batchSize);
+            if (single) {
+                Page* page;
+                for (size_t k = 0; k < batch.size(); k++) {
+                    bufMgr->readPage(file, batch[k], page);
+                    checksum += page->page_number();
+                    bufMgr->unPinPage(file, batch[k], true);
+                }
+            }
+            else {
+                bufMgr->readPages(file, batch, pages);
+                for (size_t k = 0; k < pages.size(); k++) {
+                    checksum += pages[k]->page_number();
+                }
+                bufMgr->unPinPages(file, batch, true);
+            }
+        }
+        const double readSecs = secondsSince(start);
+        const std::uint64_t reads = bufMgr->getBufStats().diskreads;
+
+        const BenchClock::time_point flushStart = BenchClock::now();
+        bufMgr->flushFile(file);
+        const double flushSecs = secondsSince(flushStart);
+        const std::uint64_t writes = bufMgr->getBufStats().diskwrites;
+
+        std::cout << std::setw(10) << (single ? "readPage" : engine == URING_ENGINE ? "io_uring" : "threads")
+                  << std::setw(8) << depth << std::fixed << std::setprecision(0)
+                  << std::setw(14) << reads / readSecs << std::setw(14) << writes / flushSecs
+                  << "   (checksum " << checksum << ")" << std::endl;
+        delete file;
+        delete bufMgr;
+    }
+
+    IOEngine::select(savedEngine);
+    File::setBackend(savedBackend);
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchAllocate
+// -----------------------------------------------------------------------------
+
+void benchAllocate()
+{
+    // Grows a file to a million pages one allocatePage at a time, timing each
+    // stretch, then deletes every fourth page and allocates them all again.
+    // Both should cost the same per page however large the file has grown.
+    const int numPages = 1 << 20;
+    const int stretch = numPages / 8;
+
+    removeBenchRelation(benchRelationName);
+    PageFile* file = new PageFile(benchRelationName, true);
+    PageId pageNo;
+
+    std::cout << std::setw(12) << "pages" << std::setw(14) << "us/alloc" << std::endl;
+    for (int done = 0; done < numPages; done += stretch) {
+        const BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < stretch; i++) {
+            file->allocatePage(pageNo);
+        }
+        const double secs = secondsSince(start);
+        std::cout << std::setw(12) << done + stretch << std::fixed << std::setprecision(2)
+                  << std::setw(14) << secs * 1e6 / stretch << std::endl;
+    }
+
+    const BenchClock::time_point deleteStart = BenchClock::now();
+    for (PageId p = 1; p <= static_cast<PageId>(numPages); p += 4) {
+        file->deletePage(p);
+    }
+    const double deleteSecs = secondsSince(deleteStart);
+
+    const BenchClock::time_point reuseStart = BenchClock::now();
+    for (int i = 0; i < numPages / 4; i++) {
+        file->allocatePage(pageNo);
+    }
+    const double reuseSecs = secondsSince(reuseStart);
+
+    int usedPages = 0;
+    for (FileIterator iter = file->begin(); iter != file->end(); ++iter) {
+        usedPages++;
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "delete " << numPages / 4 << " pages: " << deleteSecs * 1e6 / (numPages / 4)
+              << " us/page" << std::endl
+              << "reuse  " << numPages / 4 << " pages: " << reuseSecs * 1e6 / (numPages / 4)
+              << " us/page (" << usedPages << " pages in the used list)" << std::endl;
+
+    delete file;
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchMappedFile
+// -----------------------------------------------------------------------------
+
+void benchMappedFile()
+{
+    // A relation several times the size of the pool, in the OS cache: full
+    // scans, random page reads and an index build, each once through a
+    // PageFile and the pool and once through a MappedFile.
+    const int numRecords = 400000;
+    const std::uint32_t poolSize = 256;
+    const int numScans = 5;
+    const int numReads = 200000;
+
+    createRandomRelation(benchRelationName, numRecords);
+    int numPages = 0;
+    {
+        PageFile relation(benchRelationName, false);
+        for (FileIterator iter = relation.begin(); iter != relation.end(); ++iter) {
+            numPages++;
+        }
+    }
+
+    std::cout << std::setw(14) << "workload" << std::setw(10) << "path" << std::setw(10) << "secs"
+              << std::setw(14) << "per sec" << std::endl;
+
+    for (int mapped = 0; mapped < 2; mapped++) {
+        BufMgr* bufMgr = new BufMgr(poolSize);
+        std::uint64_t checksum = 0;
+
+        // full scans, counting records
+        BufAccessStrategy bulkRead(BufAccessStrategy::BULK_READ_RING_SIZE);
+        int records = 0;
+        BenchClock::time_point start = BenchClock::now();
+        for (int scan = 0; scan < numScans; scan++) {
+            FileScan* fileScan = mapped ? new FileScan(benchRelationName)
+                                        : new FileScan(benchRelationName, bufMgr, &bulkRead);
+            try {
+                RecordId rid;
+                while (true) {
+                    fileScan->scanNext(rid);
+                    checksum += fileScan->getRecord().size();
+                    records++;
+                }
+            }
+            catch (const EndOfFileException&) {
+            }
+            delete fileScan;
+        }
+        double secs = secondsSince(start);
+        std::cout << std::setw(14) << "scan" << std::setw(10) << (mapped ? "mmap" : "pool")
+                  << std::fixed << std::setprecision(3) << std::setw(10) << secs
+                  << std::setprecision(0) << std::setw(14) << records / secs << " records" << std::endl;
+
+        // random page reads
+        std::uint32_t seed = 31337u;
+        start = BenchClock::now();
+        if (mapped) {
+            MappedFile relation(benchRelationName);
+            for (int i = 0; i < numReads; i++) {
+                seed = seed * 1103515245u + 12345u;
+                const PageId pageNo = 1 + (seed >> 8) % numPages;
+                checksum += relation.pageAt(pageNo)->getFreeSpace();
+            }
+        }
+        else {
+            PageFile relation(benchRelationName, false);
+            for (int i = 0; i < numReads; i++) {
+                seed = seed * 1103515245u + 12345u;
+                const PageId pageNo = 1 + (seed >> 8) % numPages;
+                Page* page;
+                bufMgr->readPage(&relation, pageNo, page);
+                checksum += page->getFreeSpace();
+                bufMgr->unPinPage(&relation, pageNo, false);
+            }
+            bufMgr->flushFile(&relation);
+        }
+        secs = secondsSince(start);
+        std::cout << std::setw(14) << "random page" << std::setw(10) << (mapped ? "mmap" : "pool")
+                  << std::fixed << std::setprecision(3) << std::setw(10) << secs
+                  << std::setprecision(0) << std::setw(14) << numReads / secs << " pages" << std::endl;
+
+        // index build
+        std::string indexName;
+        start = BenchClock::now();
+        BTreeIndex* index = new BTreeIndex(benchRelationName, indexName, bufMgr,
+                                           offsetof(BenchRecord, i), INTEGER, mapped != 0);
+        secs = secondsSince(start);
+        delete index;
+        removeBenchRelation(indexName);
+        std::cout << std::setw(14) << "index build" << std::setw(10) << (mapped ? "mmap" : "pool")
+                  << std::fixed << std::setprecision(3) << std::setw(10) << secs
+                  << std::setprecision(0) << std::setw(14) << numRecords / secs << " records"
+                  << "   (checksum " << checksum << ")" << std::endl;
+
+        delete bufMgr;
+    }
+
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchExtents
+// -----------------------------------------------------------------------------
+
+int countDiskExtents(const std::string& name)
+{
+    // counts runs of physically contiguous blocks, since the file system
+    // reports written and still unwritten preallocated blocks separately
+    const int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    const int maxExtents = 4096;
+    std::vector<char> buffer(sizeof(struct fiemap) + maxExtents * sizeof(struct fiemap_extent));
+    struct fiemap* map = reinterpret_cast<struct fiemap*>(&buffer[0]);
+    map->fm_length = ~0ULL;
+    map->fm_flags = FIEMAP_FLAG_SYNC;
+    map->fm_extent_count = maxExtents;
+    int runs = -1;
+    if (ioctl(fd, FS_IOC_FIEMAP, map) == 0) {
+        runs = 0;
+        for (unsigned i = 0; i < map->fm_mapped_extents; i++) {
+            const struct fiemap_extent& extent = map->fm_extents[i];
+            runs += i == 0 || map->fm_extents[i - 1].fe_physical + map->fm_extents[i - 1].fe_length
+                              != extent.fe_physical;
+        }
+    }
+    close(fd);
+    return runs;
+}
+
+void benchExtents()
+{
+    // Builds an index over a relation in random and in ascending key order,
+    // once growing files a page at a time and once in extents with new nodes
+    // placed near the node they split from.  Then walks the leaves along rightSibPageNo,
+    // counting steps to the next page and to a page within 64 of the last,
+    // and times a full range scan with direct I/O and a small pool, so that
+    // every leaf read goes to the device.
+    const int numRecords = 300000;
+    const PageId extentSizes[] = { 1, 64 };
+    const FileBackendType savedBackend = File::backend();
+
+    std::cout << std::setw(10) << "order" << std::setw(8) << "extent" << std::setw(10) << "leaves" << std::setw(10) << "next %"
+              << std::setw(10) << "near %" << std::setw(12) << "disk exts" << std::setw(12) << "scan secs"
+              << std::setw(14) << "keys/sec" << std::endl;
+
+    for (int run = 0; run < 4; run++) {
+        const bool shuffled = run < 2;
+        File::setExtentPages(extentSizes[run % 2]);
+        createRandomRelation(benchRelationName, numRecords, shuffled);
+
+        std::string indexName;
+        BufMgr* bufMgr = new BufMgr(256);
+        BTreeIndex* index = new BTreeIndex(benchRelationName, indexName, bufMgr,
+                                           offsetof(BenchRecord, i), INTEGER);
+        delete index;
+        delete bufMgr;
+
+        // down the leftmost path to the first leaf, then along the siblings
+        int leaves = 0;
+        int nextSteps = 0;
+        int nearSteps = 0;
+        {
+            BlobFile indexFile(indexName, false);
+            const Page metaPage = indexFile.readPage(1);
+            PageId pageNo = reinterpret_cast<const IndexMetaInfo*>(&metaPage)->rootPageNo;
+            Page page = indexFile.readPage(pageNo);
+            while (reinterpret_cast<const NonLeafNodeInt*>(&page)->level != -1) {
+                pageNo = reinterpret_cast<const NonLeafNodeInt*>(&page)->pageNoArray[0];
+                page = indexFile.readPage(pageNo);
+            }
+            while (true) {
+                leaves++;
+                const PageId nextPageNo = reinterpret_cast<const LeafNodeInt*>(&page)->rightSibPageNo;
+                if (nextPageNo == Page::INVALID_NUMBER) {
+                    break;
+                }
+                const PageId distance = nextPageNo > pageNo ? nextPageNo - pageNo : pageNo - nextPageNo;
+                nextSteps += nextPageNo == pageNo + 1;
+                nearSteps += distance <= 64;
+                pageNo = nextPageNo;
+                page = indexFile.readPage(pageNo);
+            }
+        }
+        const int diskExtents = countDiskExtents(indexName);
+
+        File::setBackend(DIRECT_BACKEND);
+        bufMgr = new BufMgr(64);
+        index = new BTreeIndex(benchRelationName, indexName, bufMgr, offsetof(BenchRecord, i), INTEGER);
+        const int low = 0;
+        const int high = numRecords;
+        int keys = 0;
+        const BenchClock::time_point start = BenchClock::now();
+        index->startScan(&low, GTE, &high, LT);
+        try {
+            RecordId rid;
+            while (1) {
+                index->scanNext(rid);
+                keys++;
+            }
+        }
+        catch (const IndexScanCompletedException&) {
+        }
+        index->endScan();
+        const double secs = secondsSince(start);
+        delete index;
+        delete bufMgr;
+        File::setBackend(savedBackend);
+
+        std::cout << std::setw(10) << (shuffled ? "random" : "ascending") << std::setw(8)
+                  << extentSizes[run % 2] << std::setw(10) << leaves << std::fixed
+                  << std::setprecision(1) << std::setw(10) << 100.0 * nextSteps / (leaves - 1)
+                  << std::setw(10) << 100.0 * nearSteps / (leaves - 1) << std::setw(12) << diskExtents
+                  << std::setprecision(3) << std::setw(12) << secs << std::setprecision(0)
+                  << std::setw(14) << keys / secs << std::endl;
+
+        removeBenchRelation(indexName);
+        removeBenchRelation(benchRelationName);
+    }
+
+    File::setExtentPages(File::DEFAULT_EXTENT_PAGES);
+}
+
+// -----------------------------------------------------------------------------
+// benchFreeMap
+// -----------------------------------------------------------------------------
+
+void fileMegabytes(const std::string& name, double& sizeMB, double& diskMB)
+{
+    struct stat st;
+    sizeMB = diskMB = 0;
+    if (stat(name.c_str(), &st) == 0) {
+        sizeMB = st.st_size / 1048576.0;
+        diskMB = st.st_blocks * 512 / 1048576.0;
+    }
+}
+
+void benchFreeMap()
+{
+    // Grows a BlobFile through the buffer pool past the first free map page,
+    // then churns it: each round disposes of a random quarter of the live
+    // pages in one disposePages call and allocates as many again.  The file
+    // should stop growing, and its disk usage should drop by the deleted
+    // pages until they are reused.  Last, deletes a quarter, closes and
+    // reopens the file, and allocates a quarter, which should reuse them.
+    const int numPages = 80000;
+    const int churn = numPages / 4;
+    const int rounds = 4;
+
+    removeBenchRelation(benchRelationName);
+    BlobFile* file = new BlobFile(benchRelationName, true);
+    BufMgr* bufMgr = new BufMgr(256);
+    std::vector<PageId> live;
+    PageId pageNo;
+    Page* page;
+    for (int i = 0; i < numPages; i++) {
+        bufMgr->allocPage(file, pageNo, page);
+        bufMgr->unPinPage(file, pageNo, true);
+        live.push_back(pageNo);
+    }
+    bufMgr->flushFile(file);
+
+    double sizeMB;
+    double diskMB;
+    fileMegabytes(benchRelationName, sizeMB, diskMB);
+    std::cout << std::fixed << std::setprecision(1) << "grown to " << numPages << " pages: "
+              << sizeMB << " MB, " << diskMB << " MB on disk" << std::endl;
+    std::cout << std::setw(8) << "round" << std::setw(20) << "disk MB deleted" << std::setw(14)
+              << "size MB" << std::setw(14) << "disk MB" << std::setw(12) << "us/alloc" << std::endl;
+
+    std::uint32_t seed = 777u;
+    for (int round = 0; round <= rounds; round++) {
+        // move a random quarter of the live pages to the front
+        for (int i = 0; i < churn; i++) {
+            seed = seed * 1103515245u + 12345u;
+            std::swap(live[i], live[i + (seed >> 8) % (live.size() - i)]);
+        }
+        const std::vector<PageId> victims(live.begin(), live.begin() + churn);
+        live.erase(live.begin(), live.begin() + churn);
+        bufMgr->disposePages(file, victims);
+        bufMgr->flushFile(file);
+        double freedDiskMB;
+        fileMegabytes(benchRelationName, sizeMB, freedDiskMB);
+
+        if (round == rounds) {
+            // this time reopen the file before allocating again
+            delete bufMgr;
+            delete file;
+            file = new BlobFile(benchRelationName, false);
+            bufMgr = new BufMgr(256);
+        }
+
+        const BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < churn; i++) {
+            bufMgr->allocPage(file, pageNo, page);
+            bufMgr->unPinPage(file, pageNo, true);
+            live.push_back(pageNo);
+        }
+        bufMgr->flushFile(file);
+        const double secs = secondsSince(start);
+        fileMegabytes(benchRelationName, sizeMB, diskMB);
+
+        std::cout << std::setw(8) << (round == rounds ? "reopen" : std::to_string(round + 1))
+                  << std::fixed << std::setprecision(1) << std::setw(20) << freedDiskMB
+                  << std::setw(14) << sizeMB << std::setw(14) << diskMB << std::setprecision(2)
+                  << std::setw(12) << secs * 1e6 / churn << std::endl;
+    }
+
+    delete bufMgr;
+    delete file;
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchVectoredIO
+// -----------------------------------------------------------------------------
+
+void benchVectoredIO()
+{
+    // Reads a relation of consecutive pages a page at a time and in runs of
+    // 64, each run one preadv, then dirties all of it in a pool and times
+    // flushFile, whose sorted writes go out as pwritev runs.  Buffered and
+    // with direct I/O.
+    const int numPages = 16384;
+    const int run = 64;
+    const FileBackendType backends[] = { POSIX_BACKEND, DIRECT_BACKEND };
+    const char* backendNames[] = { "posix", "direct" };
+    const FileBackendType savedBackend = File::backend();
+
+    createBenchRelation(benchRelationName, numPages);
+    void* memory = NULL;
+    if (posix_memalign(&memory, FileIO::ALIGNMENT, run * Page::SIZE) != 0) {
+        return;
+    }
+    Page* pages = static_cast<Page*>(memory);
+
+    std::cout << std::setw(8) << "backend" << std::setw(12) << "read" << std::setw(14) << "pages/sec"
+              << std::endl;
+    for (int b = 0; b < 2; b++) {
+        File::setBackend(backends[b]);
+        std::uint64_t checksum = 0;
+        {
+            PageFile file(benchRelationName, false);
+            dropFromOsCache(benchRelationName);
+            BenchClock::time_point start = BenchClock::now();
+            for (PageId pageNo = 1; pageNo <= static_cast<PageId>(numPages); pageNo++) {
+                file.readPageInto(pageNo, pages[0]);
+                checksum += pages[0].getFreeSpace();
+            }
+            double secs = secondsSince(start);
+            std::cout << std::setw(8) << backendNames[b] << std::setw(12) << "by page" << std::fixed
+                      << std::setprecision(0) << std::setw(14) << numPages / secs << std::endl;
+
+            dropFromOsCache(benchRelationName);
+            start = BenchClock::now();
+            for (PageId first = 1; first <= static_cast<PageId>(numPages); first += run) {
+                file.readPages(first, run, pages);
+                for (int i = 0; i < run; i++) {
+                    checksum += pages[i].getFreeSpace();
+                }
+            }
+            secs = secondsSince(start);
+            std::cout << std::setw(8) << backendNames[b] << std::setw(12) << "runs of 64" << std::fixed
+                      << std::setprecision(0) << std::setw(14) << numPages / secs
+                      << "   (checksum " << checksum << ")" << std::endl;
+        }
+
+        // a pool holding the whole relation, every page dirty
+        BufMgr* bufMgr = new BufMgr(numPages);
+        PageFile* file = new PageFile(benchRelationName, false);
+        for (PageId pageNo = 1; pageNo <= static_cast<PageId>(numPages); pageNo++) {
+            Page* page;
+            bufMgr->readPage(file, pageNo, page);
+            bufMgr->unPinPage(file, pageNo, true);
+        }
+        const BenchClock::time_point start = BenchClock::now();
+        bufMgr->flushFile(file);
+        const double secs = secondsSince(start);
+        std::cout << std::setw(8) << backendNames[b] << std::setw(12) << "flushFile" << std::fixed
+                  << std::setprecision(0) << std::setw(14) << numPages / secs << std::endl;
+        delete file;
+        delete bufMgr;
+    }
+
+    free(memory);
+    File::setBackend(savedBackend);
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchRecordView
+// -----------------------------------------------------------------------------
+
+void benchRecordView()
+{
+    // Scans a relation through the pool summing the key of every record,
+    // once copying each record out with getRecord and once reading it in
+    // place with getRecordView, then builds an index over it.
+    const int numRecords = 300000;
+    const int passes = 5;
+    createRandomRelation(benchRelationName, numRecords);
+    BufMgr* bufMgr = new BufMgr(1024);
+
+    std::cout << std::setw(12) << "read" << std::setw(10) << "secs" << std::setw(14) << "records/sec"
+              << std::endl;
+    for (int view = 0; view < 2; view++) {
+        std::int64_t sum = 0;
+        const BenchClock::time_point start = BenchClock::now();
+        for (int pass = 0; pass < passes; pass++) {
+            FileScan scan(benchRelationName, bufMgr);
+            try {
+                RecordId rid;
+                while (1) {
+                    scan.scanNext(rid);
+                    int key;
+                    if (view) {
+                        const RecordView record = scan.getRecordView();
+                        memcpy(&key, record.data() + offsetof(BenchRecord, i), sizeof(key));
+                    }
+                    else {
+                        const std::string record = scan.getRecord();
+                        memcpy(&key, record.data() + offsetof(BenchRecord, i), sizeof(key));
+                    }
+                    sum += key;
+                }
+            }
+            catch (const EndOfFileException&) {
+            }
+        }
+        const double secs = secondsSince(start);
+        std::cout << std::setw(12) << (view ? "view" : "copy") << std::fixed << std::setprecision(3)
+                  << std::setw(10) << secs << std::setprecision(0) << std::setw(14)
+                  << passes * numRecords / secs << "   (sum " << sum << ")" << std::endl;
+    }
+
+    std::string indexName;
+    const BenchClock::time_point start = BenchClock::now();
+    BTreeIndex* index = new BTreeIndex(benchRelationName, indexName, bufMgr,
+                                       offsetof(BenchRecord, i), INTEGER);
+    const double secs = secondsSince(start);
+    delete index;
+    std::cout << std::setw(12) << "index build" << std::fixed << std::setprecision(3) << std::setw(10)
+              << secs << std::setprecision(0) << std::setw(14) << numRecords / secs << std::endl;
+
+    delete bufMgr;
+    removeBenchRelation(indexName);
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchPageChurn
+// -----------------------------------------------------------------------------
+
+void benchPageChurn()
+{
+    // Fills a page, then keeps deleting a random record and inserting new
+    // ones until the page is full again.  Lengths are fixed, so a new record
+    // always fits the hole of the one deleted, or vary, so it often does not.
+    const int rounds = 2000000;
+    std::cout << std::setw(10) << "lengths" << std::setw(10) << "secs" << std::setw(14) << "ops/sec"
+              << std::setw(10) << "records" << std::endl;
+    for (int varying = 0; varying < 2; varying++) {
+        Page page;
+        std::vector<RecordId> live;
+        unsigned seed = 12345;
+        const std::string bytes(200, 'x');
+        std::size_t length = 80;
+        while (page.hasSpaceForRecord(bytes.substr(0, length))) {
+            live.push_back(page.insertRecord(bytes.substr(0, length)));
+            if (varying)
+                length = 20 + (seed = seed * 1103515245 + 12345) % 160;
+        }
+        const std::size_t filled = live.size();
+
+        std::size_t ops = 0;
+        std::size_t checksum = 0;
+        const BenchClock::time_point start = BenchClock::now();
+        for (int round = 0; round < rounds; round++) {
+            seed = seed * 1103515245 + 12345;
+            const std::size_t victim = (seed >> 8) % live.size();
+            page.deleteRecord(live[victim]);
+            live[victim] = live.back();
+            live.pop_back();
+            ops++;
+            while (true) {
+                if (varying)
+                    length = 20 + (seed = seed * 1103515245 + 12345) % 160;
+                const std::string record(bytes.data(), length);
+                if (!page.hasSpaceForRecord(record))
+                    break;
+                live.push_back(page.insertRecord(record));
+                ops++;
+            }
+            checksum += page.getFreeSpace();
+        }
+        const double secs = secondsSince(start);
+        std::cout << std::setw(10) << (varying ? "varying" : "fixed") << std::fixed
+                  << std::setprecision(3) << std::setw(10) << secs << std::setprecision(0)
+                  << std::setw(14) << ops / secs << std::setw(10) << filled
+                  << "   (checksum " << checksum << ")" << std::endl;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// benchPageSlots
+// -----------------------------------------------------------------------------
+
+void benchPageSlots()
+{
+    // A page of 600 small records; deleting a random one and inserting
+    // another reuses its slot, wherever it is in the slot array.
+    const int numRecords = 600;
+    const std::string record(4, 'x');
+    Page page;
+    std::vector<RecordId> live;
+    for (int i = 0; i < numRecords; i++)
+        live.push_back(page.insertRecord(record));
+
+    const int rounds = 2000000;
+    unsigned seed = 12345;
+    BenchClock::time_point start = BenchClock::now();
+    for (int round = 0; round < rounds; round++) {
+        seed = seed * 1103515245 + 12345;
+        const std::size_t victim = (seed >> 8) % live.size();
+        page.deleteRecord(live[victim]);
+        live[victim] = page.insertRecord(record);
+    }
+    double secs = secondsSince(start);
+    std::cout << std::setw(16) << "reuse" << std::fixed << std::setprecision(3) << std::setw(10)
+              << secs << std::setprecision(0) << std::setw(14) << rounds / secs << " deletes+inserts/sec"
+              << std::endl;
+
+    // Keep one record in every 32 slots and scan the page.
+    for (int i = 0; i < numRecords; i++) {
+        if (i % 32 != 0)
+            page.deleteRecord(live[i]);
+    }
+    const int scans = 2000000;
+    std::size_t seen = 0;
+    start = BenchClock::now();
+    for (int scan = 0; scan < scans; scan++) {
+        for (PageIterator iter = page.begin(); iter != page.end(); ++iter)
+            seen += iter.getCurrentRecord().slot_number;
+    }
+    secs = secondsSince(start);
+    std::cout << std::setw(16) << "sparse scan" << std::fixed << std::setprecision(3) << std::setw(10)
+              << secs << std::setprecision(0) << std::setw(14) << scans / secs << " pages/sec"
+              << "   (checksum " << seen << ")" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+// benchFixedPages
+// -----------------------------------------------------------------------------
+
+void benchFixedPages()
+{
+    // The same relation stored on slotted pages and on pages of fixed-length
+    // records: its size, scans through the pool reading records in place,
+    // and an index build.
+    const int numRecords = 300000;
+    const int passes = 5;
+    std::cout << std::setw(10) << "pages" << std::setw(10) << "MB" << std::setw(10) << "rec/page"
+              << std::setw(14) << "scan rec/s" << std::setw(14) << "build rec/s" << std::endl;
+    for (int fixed = 0; fixed < 2; fixed++) {
+        createRandomRelation(benchRelationName, numRecords, true, fixed ? sizeof(BenchRecord) : 0);
+        double sizeMB;
+        double diskMB;
+        fileMegabytes(benchRelationName, sizeMB, diskMB);
+        BufMgr* bufMgr = new BufMgr(1024);
+
+        std::size_t pages = 0;
+        std::int64_t sum = 0;
+        const BenchClock::time_point start = BenchClock::now();
+        for (int pass = 0; pass < passes; pass++) {
+            FileScan scan(benchRelationName, bufMgr);
+            try {
+                RecordId rid;
+                PageId lastPage = Page::INVALID_NUMBER;
+                while (1) {
+                    scan.scanNext(rid);
+                    if (rid.page_number != lastPage) {
+                        lastPage = rid.page_number;
+                        pages++;
+                    }
+                    const RecordView record = scan.getRecordView();
+                    int key;
+                    memcpy(&key, record.data() + offsetof(BenchRecord, i), sizeof(key));
+                    sum += key;
+                }
+            }
+            catch (const EndOfFileException&) {
+            }
+        }
+        const double scanSecs = secondsSince(start);
+
+        std::string indexName;
+        const BenchClock::time_point buildStart = BenchClock::now();
+        BTreeIndex* index = new BTreeIndex(benchRelationName, indexName, bufMgr,
+                                           offsetof(BenchRecord, i), INTEGER);
+        const double buildSecs = secondsSince(buildStart);
+        delete index;
+        delete bufMgr;
+        removeBenchRelation(indexName);
+
+        pages /= passes;
+        std::cout << std::setw(10) << pages << std::fixed << std::setprecision(1) << std::setw(10)
+                  << sizeMB << std::setw(10) << double(numRecords) / pages << std::setprecision(0)
+                  << std::setw(14) << passes * numRecords / scanSecs << std::setw(14)
+                  << numRecords / buildSecs << "   " << (fixed ? "fixed" : "slotted")
+                  << " (sum " << sum << ")" << std::endl;
+    }
+    removeBenchRelation(benchRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// benchPaxPages
+// -----------------------------------------------------------------------------
+
+std::int64_t sumIntColumn(const ColumnView& column)
+{
+    // Sums the ints of the used slots 64 slots at a time, so that a run of
+    // used slots is a plain loop over the values, which the compiler can
+    // vectorise when they are back to back.
+    std::int64_t sum = 0;
+    for (SlotId first = 1; first <= column.num_slots(); first += 64) {
+        const SlotId count = std::min<SlotId>(64, column.num_slots() - first + 1);
+        const std::uint64_t all = count == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << count) - 1;
+        const std::uint64_t used = column.slot_map()[(first - 1) / 64] & all;
+        const char* values = column.value(first);
+        const std::size_t stride = column.stride();
+        for (SlotId i = 0; i < count; i++) {
+            int value;
+            memcpy(&value, values + i * stride, sizeof(value));
+            sum += used == all || ((used >> i) & 1) ? value : 0;
+        }
+    }
+    return sum;
+}
+
+void benchPaxPages()
+{
+    // The same relation on slotted pages, on pages of fixed-length records
+    // and in the PAX layout with the int, its padding, the double and the
+    // string in columns of their own, all held in the pool.  Scans read the
+    // key of every record, whole records, and the key column a page at a
+    // time; then an index is built on the key.
+    const int numRecords = 300000;
+    const int passes = 10;
+    const char* layouts[] = { "slotted", "fixed", "pax" };
+    std::vector<std::uint16_t> columns;
+    columns.push_back(sizeof(int));
+    columns.push_back(offsetof(BenchRecord, d) - sizeof(int));
+    columns.push_back(sizeof(double));
+    columns.push_back(sizeof(BenchRecord) - offsetof(BenchRecord, s));
+
+    std::cout << std::setw(8) << "layout" << std::setw(8) << "pages" << std::setw(14) << "key rec/s"
+              << std::setw(14) << "whole rec/s" << std::setw(14) << "column rec/s"
+              << std::setw(14) << "build rec/s" << std::setw(14) << "in mem rec/s" << std::endl;
+    for (int layout = 0; layout < 3; layout++) {
+        createRandomRelation(benchRelationName, numRecords, true, layout == 1 ? sizeof(BenchRecord) : 0,
+                             layout == 2 ? columns : std::vector<std::uint16_t>());
+        BufMgr* bufMgr = new BufMgr(4096);
+        std::int64_t sum = 0;
+        std::size_t pages = 0;
+
+        double rates[3] = { 0, 0, 0 };
+        for (int mode = 0; mode < 3; mode++) {
+            // column scans need fixed-length records
+            if (mode == 2 && layout == 0)
+                continue;
+            const BenchClock::time_point start = BenchClock::now();
+            for (int pass = 0; pass < passes; pass++) {
+                FileScan scan(benchRelationName, bufMgr);
+                try {
+                    RecordId rid;
+                    while (mode == 0) {
+                        scan.scanNext(rid);
+                        const RecordView key = scan.getFieldView(offsetof(BenchRecord, i), sizeof(int));
+                        int value;
+                        memcpy(&value, key.data(), sizeof(value));
+                        sum += value;
+                    }
+                    while (mode == 1) {
+                        scan.scanNext(rid);
+                        const std::string record = scan.getRecord();
+                        int value;
+                        memcpy(&value, record.data() + offsetof(BenchRecord, i), sizeof(value));
+                        sum += value;
+                    }
+                    while (mode == 2) {
+                        sum += sumIntColumn(scan.scanNextColumn(offsetof(BenchRecord, i), sizeof(int)));
+                        pages++;
+                    }
+                }
+                catch (const EndOfFileException&) {
+                }
+            }
+            rates[mode] = passes * numRecords / secondsSince(start);
+        }
+
+        std::string indexName;
+        const BenchClock::time_point start = BenchClock::now();
+        BTreeIndex* index = new BTreeIndex(benchRelationName, indexName, bufMgr,
+                                           offsetof(BenchRecord, i), INTEGER);
+        const double buildSecs = secondsSince(start);
+        delete index;
+        delete bufMgr;
+        removeBenchRelation(indexName);
+
+        // The key column of pages already in memory, without the scan around
+        // it, to show what the layout itself costs.
+        PageFile file = PageFile::open(benchRelationName);
+        std::vector<Page> resident;
+        for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+            resident.push_back(*iter);
+        pages = resident.size();
+        double memoryRate = 0;
+        if (layout != 0) {
+            const int memoryPasses = 200;
+            const BenchClock::time_point memoryStart = BenchClock::now();
+            for (int pass = 0; pass < memoryPasses; pass++) {
+                for (std::size_t i = 0; i < resident.size(); i++)
+                    sum += sumIntColumn(resident[i].getColumnView(offsetof(BenchRecord, i), sizeof(int)));
+            }
+            memoryRate = memoryPasses * double(numRecords) / secondsSince(memoryStart);
+        }
+
+        std::cout << std::setw(8) << layouts[layout] << std::setw(8) << pages << std::fixed
+                  << std::setprecision(0) << std::setw(14) << rates[0] << std::setw(14) << rates[1]
+                  << std::setw(14) << rates[2] << std::setw(14) << numRecords / buildSecs
+                  << std::setw(14) << memoryRate << "   (sum " << sum << ")" << std::endl;
+    }
+    removeBenchRelation(benchRelationName);
+}
@@ -30,7 +30,7 @@ namespace badgerdb {
 // BTreeIndex::BTreeIndex -- Constructor
 // -----------------------------------------------------------------------------
 
-BTreeIndex::BTreeIndex(const std::string& relationName, std::string& outIndexName, BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType)
+BTreeIndex::BTreeIndex(const std::string& relationName, std::string& outIndexName, BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType, const bool mappedScan)
 {
 
     bufMgr = bufMgrIn;
@@ -45,7 +45,7 @@ BTreeIndex::BTreeIndex(const std::string& relationName, std::string& outIndexNam
 
     nodeOccupancy = INTARRAYNONLEAFSIZE;
 
-    Page* metaPage;
+    WritePageGuard metaPage;
 
     std::ostringstream idxStr;
 
@@ -63,9 +63,9 @@ BTreeIndex::BTreeIndex(const std::string& relationName, std::string& outIndexNam
 
         headerPageNum = file->getFirstPageNo();
 
-        bufMgr->readPage(file, headerPageNum, metaPage);
+        metaPage = bufMgr->fetchPageWrite(file, headerPageNum);
 
-        IndexMetaInfo* metaData = (IndexMetaInfo*)metaPage;
+        IndexMetaInfo* metaData = (IndexMetaInfo*)metaPage.get();
 
         rootPageNum = metaData->rootPageNo;
     }
@@ -77,9 +77,9 @@ BTreeIndex::BTreeIndex(const std::string& relationName, std::string& outIndexNam
 
         PageId firstId;
 
-        bufMgr->allocPage(file, firstId, *&metaPage);
+        metaPage = bufMgr->allocPageWrite(file, firstId);
 
-        IndexMetaInfo* metaData = (IndexMetaInfo*)metaPage;
+        IndexMetaInfo* metaData = (IndexMetaInfo*)metaPage.get();
 
         char* name = (char*)relationName.c_str();
 
@@ -92,15 +92,16 @@ BTreeIndex::BTreeIndex(const std::string& relationName, std::string& outIndexNam
         metaData->rootPageNo = firstId;
 
         headerPageNum = firstId;
-    }
 
-    bufMgr->unPinPage(file, headerPageNum, false);
+        // the newly created header page has just been filled in
+        metaPage.markDirty();
+    }
 
-    Page* rootPage;
+    metaPage.release();
 
-    bufMgr->allocPage(file, rootPageNum, rootPage);
+    WritePageGuard rootPage = bufMgr->allocPageWrite(file, rootPageNum);
 
-    LeafNodeInt* rootNode = (LeafNodeInt*)rootPage;
+    LeafNodeInt* rootNode = (LeafNodeInt*)rootPage.get();
 
     rootNode->level = -1;
 
@@ -108,9 +109,14 @@ BTreeIndex::BTreeIndex(const std::string& relationName, std::string& outIndexNam
 
     rootNode->numKeys = 0;
 
-    bufMgr->unPinPage(file, rootPageNum, true);
+    rootPage.release();
 
-    FileScan fileScan(relationName, bufMgr);
+    // read the relation through a small ring so the scan does not push the
+    // index pages being built out of the pool, or past the pool altogether
+    BufAccessStrategy bulkRead(BufAccessStrategy::BULK_READ_RING_SIZE);
+
+    std::unique_ptr<FileScan> fileScan(mappedScan ? new FileScan(relationName)
+                                                  : new FileScan(relationName, bufMgr, &bulkRead));
 
     try {
 
@@ -118,13 +124,16 @@ BTreeIndex::BTreeIndex(const std::string& relationName, std::string& outIndexNam
 
         while (1) {
 
-            fileScan.scanNext(rid);
+            fileScan->scanNext(rid);
 
-            std::string record = fileScan.getRecord();
+            // read the key in place, and on a PAX page from its column only;
+            // the field may not be aligned for an int
+            const RecordView field = fileScan->getFieldView(attrByteOffset, sizeof(int));
 
-            const int* key = (int*)(record.c_str() + attrByteOffset);
+            int key;
+            memcpy(&key, field.data(), sizeof(key));
 
-            insertEntry(key, rid);
+            insertEntry(&key, rid);
         }
     }
     catch (EndOfFileException& exception) {
@@ -181,13 +190,11 @@ void BTreeIndex::insertEntry(const void* key, const RecordId rid)
 
     //Get the pointer to the root node
 
-    Page* root;
-
-    bufMgr->readPage(file, rootPageNum, root);
+    WritePageGuard root = bufMgr->fetchPageWrite(file, rootPageNum);
 
-    recursionInsert(root, isLeaf(root), rootPageNum, newNode);
+    recursionInsert(root.get(), isLeaf(root.get()), rootPageNum, newNode);
 
-    bufMgr->unPinPage(file, rootPageNum, true);
+    root.markDirty();
 }
 
 void BTreeIndex::split(int isLeaf, Page* nodePage, PageId nodePageId, RIDKeyPair<int> newNode)
@@ -197,15 +204,14 @@ void BTreeIndex::split(int isLeaf, Page* nodePage, PageId nodePageId, RIDKeyPair
 
         LeafNodeInt* curNode = (LeafNodeInt*)nodePage;
 
-        //Create a new leaf page
-
-        Page* newLeafPage;
+        //Create a new leaf page, near the one it splits from so that range
+        //scans along the siblings read nearby pages
 
         PageId newPageNum;
 
-        bufMgr->allocPage(file, newPageNum, newLeafPage);
+        WritePageGuard newLeafPage = bufMgr->allocPageWrite(file, newPageNum, nodePageId);
 
-        LeafNodeInt* newLeafNode = (LeafNodeInt*)newLeafPage;
+        LeafNodeInt* newLeafNode = (LeafNodeInt*)newLeafPage.get();
 
         //Split half of the previous leaf node into newLeafNode
 
@@ -259,13 +265,11 @@ void BTreeIndex::split(int isLeaf, Page* nodePage, PageId nodePageId, RIDKeyPair
 
         if (nodePageId == rootPageNum) {
 
-            Page* newRootPage;
-
             PageId newRootId;
 
-            bufMgr->allocPage(file, newRootId, newRootPage);
+            WritePageGuard newRootPage = bufMgr->allocPageWrite(file, newRootId);
 
-            NonLeafNodeInt* newRoot = (NonLeafNodeInt*)newRootPage;
+            NonLeafNodeInt* newRoot = (NonLeafNodeInt*)newRootPage.get();
 
             newRoot->level = 1;
 
@@ -279,23 +283,19 @@ void BTreeIndex::split(int isLeaf, Page* nodePage, PageId nodePageId, RIDKeyPair
 
             newRoot->numKeys = 1;
 
-            bufMgr->unPinPage(file, nodePageId, 1); //unpin OLD ROOT
+            // the old root stays pinned by insertEntry's guard until it is done
 
             rootPageNum = newRootId;
 
-            Page* metaDataPage;
+            WritePageGuard metaDataPage = bufMgr->fetchPageWrite(file, headerPageNum);
 
-            bufMgr->readPage(file, headerPageNum, metaDataPage);
-
-            IndexMetaInfo* metaData = (IndexMetaInfo*)metaDataPage;
+            IndexMetaInfo* metaData = (IndexMetaInfo*)metaDataPage.get();
 
             metaData->rootPageNo = newRootId;
 
-            bufMgr->unPinPage(file, headerPageNum, false);
+            metaDataPage.markDirty();
 
         }
-
-        bufMgr->unPinPage(file, newPageNum, true);
     }
 
     //Non-Leaf Node
@@ -303,15 +303,13 @@ void BTreeIndex::split(int isLeaf, Page* nodePage, PageId nodePageId, RIDKeyPair
 
         NonLeafNodeInt* curNode = (NonLeafNodeInt*)nodePage;
 
-        //Create a new non leaf page
-
-        Page* newNonLeafPage;
+        //Create a new non leaf page, near the one it splits from
 
         PageId newPageNum;
 
-        bufMgr->allocPage(file, newPageNum, newNonLeafPage);
+        WritePageGuard newNonLeafPage = bufMgr->allocPageWrite(file, newPageNum, nodePageId);
 
-        NonLeafNodeInt* newNonLeafNode = (NonLeafNodeInt*)newNonLeafPage;
+        NonLeafNodeInt* newNonLeafNode = (NonLeafNodeInt*)newNonLeafPage.get();
 
         //Split half of the previous non leaf node into newNonLeafNode
 
@@ -390,13 +388,11 @@ void BTreeIndex::split(int isLeaf, Page* nodePage, PageId nodePageId, RIDKeyPair
 
         if (nodePageId == rootPageNum) {
 
-            Page* newRootPage;
-
             PageId newRootId;
 
-            bufMgr->allocPage(file, newRootId, newRootPage);
+            WritePageGuard newRootPage = bufMgr->allocPageWrite(file, newRootId);
 
-            NonLeafNodeInt* newRoot = (NonLeafNodeInt*)newRootPage;
+            NonLeafNodeInt* newRoot = (NonLeafNodeInt*)newRootPage.get();
 
             newRoot->level = 1;
 
@@ -410,20 +406,14 @@ void BTreeIndex::split(int isLeaf, Page* nodePage, PageId nodePageId, RIDKeyPair
 
             rootPageNum = newRootId;
 
-            Page* metaDataPage;
+            WritePageGuard metaDataPage = bufMgr->fetchPageWrite(file, headerPageNum);
 
-            bufMgr->readPage(file, headerPageNum, metaDataPage);
-
-            IndexMetaInfo* metaData = (IndexMetaInfo*)metaDataPage;
+            IndexMetaInfo* metaData = (IndexMetaInfo*)metaDataPage.get();
 
             metaData->rootPageNo = newRootId;
 
-            bufMgr->unPinPage(file, headerPageNum, true);
-
-            bufMgr->unPinPage(file, newRootId, true);
+            metaDataPage.markDirty();
         }
-
-        bufMgr->unPinPage(file, newPageNum, false);
     }
 }
 
@@ -568,11 +558,9 @@ void BTreeIndex::recursionInsert(Page* nodePage, int leaf, PageId nodePageId, RI
             break;
         }
 
-        Page* child;
-
-        bufMgr->readPage(file, nextPage, child);
+        WritePageGuard child = bufMgr->fetchPageWrite(file, nextPage);
 
-        recursionInsert(child, isLeaf(child), nextPage, newNode);
+        recursionInsert(child.get(), isLeaf(child.get()), nextPage, newNode);
 
         // Check if need to split for nonLeafNode if there is a split
 
@@ -601,7 +589,8 @@ void BTreeIndex::recursionInsert(Page* nodePage, int leaf, PageId nodePageId, RI
             }
         }
 
-        bufMgr->unPinPage(file, nextPage, 0);
+        // the child may have taken the new entry or been split
+        child.markDirty();
     }
 
     //If node is leaf
@@ -631,17 +620,24 @@ void BTreeIndex::setNextScan(PageId nextPage)
 
     currentPageNum = nextPage;
 
-    Page* curPage;
+    // the page scanned before, if any, is unpinned once this one is pinned
+    currentPageData = bufMgr->fetchPageRead(file, currentPageNum);
+}
 
-    bufMgr->readPage(file, currentPageNum, curPage);
+void BTreeIndex::prefetchRightSibling()
+{
+    const LeafNodeInt* curPage = (const LeafNodeInt*)currentPageData.get();
 
-    currentPageData = curPage;
+    if (curPage->rightSibPageNo != Page::INVALID_NUMBER && curPage->numKeys > 0
+        && curPage->keyArray[curPage->numKeys - 1] <= inclHigh) {
+        bufMgr->prefetchAsync(file, curPage->rightSibPageNo, 1);
+    }
 }
 
-int BTreeIndex::isLeaf(Page* page)
+int BTreeIndex::isLeaf(const Page* page)
 {
 
-    LeafNodeInt* node = (LeafNodeInt*)page;
+    const LeafNodeInt* node = (const LeafNodeInt*)page;
 
     if (node->level == -1) {
 
@@ -658,11 +654,11 @@ void BTreeIndex::recurScan()
 
     // determine if current node is leaf or nonleaf
 
-    bool leaf_bool = isLeaf(currentPageData);
+    bool leaf_bool = isLeaf(currentPageData.get());
 
     if (leaf_bool) {
 
-        LeafNodeInt* curPage = (LeafNodeInt*)currentPageData;
+        const LeafNodeInt* curPage = (const LeafNodeInt*)currentPageData.get();
 
         while (true) {
 
@@ -674,11 +670,9 @@ void BTreeIndex::recurScan()
 
                     if (curPage->rightSibPageNo != Page::INVALID_NUMBER) {
 
-                        PageId old_page = currentPageNum;
-
                         setNextScan(curPage->rightSibPageNo);
 
-                        bufMgr->unPinPage(file, old_page, false); // unpin; not dirty
+                        curPage = (const LeafNodeInt*)currentPageData.get();
                     }
                     else {
 
@@ -713,7 +707,7 @@ void BTreeIndex::recurScan()
     // recursive case: if cur page is a nonleaf
     else {
 
-        NonLeafNodeInt* curPage = (NonLeafNodeInt*)currentPageData;
+        const NonLeafNodeInt* curPage = (const NonLeafNodeInt*)currentPageData.get();
 
         while (true) {
 
@@ -725,12 +719,8 @@ void BTreeIndex::recurScan()
 
                 if (nextEntry == curPage->numKeys - 1) {
 
-                    PageId old_page = currentPageNum;
-
                     setNextScan(curPage->pageNoArray[nextEntry + 1]);
 
-                    bufMgr->unPinPage(file, old_page, false); // unpin; not dirty
-
                     recurScan();
 
                     break;
@@ -742,8 +732,6 @@ void BTreeIndex::recurScan()
             // case2: go right
             else if (curPage->keyArray[nextEntry] == inclLow) {
 
-                bufMgr->unPinPage(file, currentPageNum, false);
-
                 setNextScan(curPage->pageNoArray[nextEntry + 1]);
 
                 recurScan();
@@ -754,8 +742,6 @@ void BTreeIndex::recurScan()
             // case3: go left
             else if (curPage->keyArray[nextEntry] > inclLow) {
 
-                bufMgr->unPinPage(file, currentPageNum, false);
-
                 setNextScan(curPage->pageNoArray[nextEntry]);
 
                 recurScan();
@@ -846,7 +832,7 @@ void BTreeIndex::scanNext(RecordId& outRid)
 
     // get current page
 
-    LeafNodeInt* curPage = (LeafNodeInt*)currentPageData;
+    const LeafNodeInt* curPage = (const LeafNodeInt*)currentPageData.get();
 
     // if no more records
 
@@ -869,11 +855,11 @@ void BTreeIndex::scanNext(RecordId& outRid)
 
         if (curPage->rightSibPageNo != Page::INVALID_NUMBER) {
 
-            PageId old_page = currentPageNum;
-
             setNextScan(curPage->rightSibPageNo);
 
-            bufMgr->unPinPage(file, old_page, false); // unpin; not dirty
+            // the scan spans leaves: read the one after this while it is consumed
+
+            prefetchRightSibling();
         }
 
         // there is no next node
@@ -908,50 +894,39 @@ void BTreeIndex::endScan()
 
     scanExecuting = false;
 
-    bufMgr->unPinPage(file, currentPageNum, false);
+    currentPageData.release();
 
     currentPageNum = Page::INVALID_NUMBER;
 
-    currentPageData = nullptr;
-
     nextEntry = -1;
 }
 
 int BTreeIndex::height(PageId cur)
 {
 
-    Page* curPage;
-
-    bufMgr->readPage(file, cur, curPage);
+    ReadPageGuard curPage = bufMgr->fetchPageRead(file, cur);
 
-    bool leaf_bool = isLeaf(curPage);
+    bool leaf_bool = isLeaf(curPage.get());
 
     if (leaf_bool) {
 
-        bufMgr->unPinPage(file, cur, false);
-
         return 0;
     }
     else {
 
-        NonLeafNodeInt* curNode = (NonLeafNodeInt*)curPage;
-
-        int h = 1 + height(curNode->pageNoArray[0]);
+        const NonLeafNodeInt* curNode = (const NonLeafNodeInt*)curPage.get();
 
-        bufMgr->unPinPage(file, cur, false);
-
-        return h;
+        return 1 + height(curNode->pageNoArray[0]);
     }
 }
 
 void BTreeIndex::printLevel(PageId cur, int level)
 {
 
-    Page* curPage;
-
-    bufMgr->readPage(file, cur, curPage);
+    // unpinned on every way out, including the descent to the level below
+    ReadPageGuard curPage = bufMgr->fetchPageRead(file, cur);
 
-    bool leaf_bool = isLeaf(curPage);
+    bool leaf_bool = isLeaf(curPage.get());
 
     if (level == 0) {
 
@@ -961,7 +936,7 @@ void BTreeIndex::printLevel(PageId cur, int level)
 
         if (leaf_bool) {
 
-            LeafNodeInt* curNode = (LeafNodeInt*)curPage;
+            const LeafNodeInt* curNode = (const LeafNodeInt*)curPage.get();
 
             for (int i = 0; i < curNode->numKeys; i++) {
 
@@ -972,15 +947,13 @@ void BTreeIndex::printLevel(PageId cur, int level)
         }
         else {
 
-            NonLeafNodeInt* curNode = (NonLeafNodeInt*)curPage;
+            const NonLeafNodeInt* curNode = (const NonLeafNodeInt*)curPage.get();
 
             for (int i = 0; i < curNode->numKeys; i++) {
 
                 std::cout << curNode->keyArray[i] << std::endl;
             }
         }
-
-        bufMgr->unPinPage(file, cur, false);
     }
     else if (level > 0) {
 
@@ -990,7 +963,7 @@ void BTreeIndex::printLevel(PageId cur, int level)
         }
         else {
 
-            NonLeafNodeInt* curNode = (NonLeafNodeInt*)curPage;
+            const NonLeafNodeInt* curNode = (const NonLeafNodeInt*)curPage.get();
 
             for (int i = 0; i <= curNode->numKeys; i++) {
 
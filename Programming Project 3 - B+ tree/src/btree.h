@@ -8,6 +8,7 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <string>
 #include "string.h"
 #include <sstream>
@@ -265,9 +266,9 @@ private:
     PageId currentPageNum;
 
     /**
-   * Current Page being scanned.
+   * Current Page being scanned, kept pinned until the scan moves on or ends.
    */
-    Page* currentPageData;
+    ReadPageGuard currentPageData;
 
     /**
    * Low INTEGER value for scan.
@@ -330,10 +331,16 @@ public:
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
    * @param attrType						Datatype of attribute over which index is built
+   * @param mappedScan					True to read the base relation through a read-only mapping instead of the buffer pool
+   *                            while building the index, leaving the whole pool to the index pages.  The relation must
+   *                            have no pages left dirty in a buffer pool.  Only the build reads the relation
+   *                            this way; the index's own pages, and so startScan() and scanNext(), always go
+   *                            through the buffer pool.
    * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
    **/
     BTreeIndex(const std::string& relationName, std::string& outIndexName,
-        BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType);
+        BufMgr* bufMgrIn, const int attrByteOffset, const Datatype attrType,
+        const bool mappedScan = false);
 
     /**
    * BTreeIndex Destructor. 
@@ -361,6 +368,8 @@ public:
 	 * If another scan is already executing, that needs to be ended here.
 	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
 	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
+	 * The leaves are read through the buffer pool, never through a MappedFile: they are
+	 * usually still dirty there, and a BlobFile's pages cannot be mapped.
    * @param lowVal	Low value of range, pointer to integer / double / char string
    * @param lowOp		Low operator (GT/GTE)
    * @param highVal	High value of range, pointer to integer / double / char string
@@ -391,7 +400,7 @@ public:
    * @param page - page to check whether it is a leaf or nonleaf
    * @return 1 if the page is a leaf and 0 if the page is a nonleaf
    **/
-    int isLeaf(Page* page);
+    int isLeaf(const Page* page);
 
     /**
    * Recursive method that looks through the tree for the first value in a leaf node that is in range of the current scan (uses global scanning vars)
@@ -404,6 +413,11 @@ public:
    **/
     void setNextScan(PageId nextPage);
 
+    /**
+   * Once a scan has moved along the leaf chain, starts reading the right sibling of the current leaf in the background if the scan range runs past the end of the current leaf.
+   **/
+    void prefetchRightSibling();
+
     /**
    * Recursive method used to find the correct leaf to insert a value.
    * @param curNode - the ptr to the page that is the current node
@@ -5,7 +5,10 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <cstdlib>
 #include <memory>
+#include <new>
+#include <string>
 #include <iostream>
 #include "buffer.h"
 #include "bufHashTbl.h"
@@ -15,100 +18,101 @@
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+/**
+ * Names the file object behind an identity in exceptions; the table does not
+ * keep the object itself, which may already be gone.
+ */
+static std::string fileName(const std::uint64_t fileId)
+{
+  return "file #" + std::to_string(fileId);
+}
+
+std::uint32_t BufHashTbl::hash(const std::uint64_t fileId, const PageId pageNo) const
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  // mix all bits of the file identity with the page number (Fibonacci hashing)
+  std::uint64_t key = fileId;
+  key ^= static_cast<std::uint64_t>(pageNo) << 32 | pageNo;
+  key *= 0x9E3779B97F4A7C15ull;
+  return static_cast<std::uint32_t>(key >> 32) & (HTSIZE - 1);
 }
 
 BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+	: HTSIZE(16), numEntries(0)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  // keep the load factor at or below one half
+  while (HTSIZE < 2 * static_cast<std::uint32_t>(htSize))
+    HTSIZE *= 2;
+
+  void* buckets;
+  if (posix_memalign(&buckets, BUCKET_ALIGNMENT, HTSIZE * sizeof(hashBucket)) != 0)
+    throw std::bad_alloc();
+  ht = static_cast<hashBucket*>(buckets);
+  for(std::uint32_t i=0; i < HTSIZE; i++)
+    ht[i].fileId = NO_FILE;
 }
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
-  delete [] ht;
+  free(ht);
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+std::uint32_t BufHashTbl::probe(const std::uint64_t fileId, const PageId pageNo) const
 {
-  int index = hash(file, pageNo);
-
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
-  }
+  std::uint32_t index = hash(fileId, pageNo);
+  while (ht[index].fileId != NO_FILE &&
+         (ht[index].fileId != fileId || ht[index].pageNo != pageNo))
+    index = (index + 1) & (HTSIZE - 1);
+  return index;
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
+void BufHashTbl::insert(const std::uint64_t fileId, const PageId pageNo, const FrameId frameNo)
+{
+  // always leave one empty bucket so that probes terminate
+  if (numEntries + 1 >= HTSIZE)
   	throw HashTableException();
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  const std::uint32_t index = probe(fileId, pageNo);
+  if (ht[index].fileId != NO_FILE)
+  	throw HashAlreadyPresentException(fileName(fileId), pageNo, ht[index].frameNo);
+
+  ht[index].fileId = fileId;
+  ht[index].pageNo = pageNo;
+  ht[index].frameNo = frameNo;
+  ++numEntries;
 }
 
-void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+bool BufHashTbl::lookup(const std::uint64_t fileId, const PageId pageNo, FrameId &frameNo) const
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-    {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
-    }
-    tmpBuc = tmpBuc->next;
-  }
+  const std::uint32_t index = probe(fileId, pageNo);
+  if (ht[index].fileId == NO_FILE)
+    return false;
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  frameNo = ht[index].frameNo; // return frameNo by reference
+  return true;
 }
 
-void BufHashTbl::remove(const File* file, const PageId pageNo) {
+void BufHashTbl::remove(const std::uint64_t fileId, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
+  std::uint32_t hole = probe(fileId, pageNo);
+  if (ht[hole].fileId == NO_FILE)
+    throw HashNotFoundException(fileName(fileId), pageNo);
 
-  while (tmpBuc)
+  // Backward-shift deletion: move later members of the cluster into the hole
+  // whenever the hole lies on their probe path.
+  std::uint32_t next = (hole + 1) & (HTSIZE - 1);
+  while (ht[next].fileId != NO_FILE)
 	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    }
-		else
+    const std::uint32_t home = hash(ht[next].fileId, ht[next].pageNo);
+    if (((next - home) & (HTSIZE - 1)) >= ((next - hole) & (HTSIZE - 1)))
 		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+      ht[hole] = ht[next];
+      hole = next;
     }
+    next = (next + 1) & (HTSIZE - 1);
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  ht[hole].fileId = NO_FILE;
+  --numEntries;
 }
 
 }
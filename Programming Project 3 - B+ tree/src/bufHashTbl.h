@@ -7,18 +7,26 @@
 
 #pragma once
 
+#include <cstdint>
 #include "file.h"
 
 namespace badgerdb {
 
 /**
 * @brief Declarations for buffer pool hash table
+*
+* A bucket is 16 bytes, so a table aligned to BUCKET_ALIGNMENT keeps four of
+* them to a cache line without any straddling a line boundary.
+*
+* Pages are keyed by File::id() rather than by the file object's address: a
+* file object deleted with clean pages still in the pool may have its address
+* reused by the next one, whose pages must not be found in the old frames.
 */
 struct hashBucket {
 	/**
-	 * pointer a file object (more on this below)
+	 * identity of the file object (File::id()); NO_FILE marks an empty bucket
 	 */
-	File *file;
+	std::uint64_t fileId;
 
 	/**
 	 * page number within a file
@@ -29,43 +37,74 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
-
-	/**
-	 * Next node in the hash table
-	 */
-	hashBucket*   next;
 };
 
+static_assert(64 % sizeof(hashBucket) == 0,
+              "Hash buckets must not straddle cache lines.");
+
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
+* The table uses open addressing with linear probing over a flat array of
+* buckets, four to a cache line.  All memory is allocated by the constructor;
+* inserts and removes never allocate, and removes shift the following entries
+* back instead of leaving tombstones, so probe sequences stay short.
+*
 * @warning This class is not threadsafe.
 */
 class BufHashTbl
 {
  private:
 	/**
-	 *	Size of Hash Table
+	 *	Alignment of the bucket array: one cache line
+	 */
+  static const std::size_t BUCKET_ALIGNMENT = 64;
+
+	/**
+	 *	Number of buckets in the table (always a power of two)
+	 */
+  std::uint32_t HTSIZE;
+
+	/**
+	 *	Number of occupied buckets
 	 */
-  int HTSIZE;
+  std::uint32_t numEntries;
+
 	/**
 	 * Actual Hash table object
 	 */
-  hashBucket**  ht;
+  hashBucket*  ht;
+
+	/**
+	 *	File identity stored in empty buckets.  File::id() never returns it.
+	 */
+  static const std::uint64_t NO_FILE = 0;
 
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * returns hash value between 0 and HTSIZE-1 computed using fileId and pageNo
 	 *
-	 * @param file   	File object
+	 * @param fileId 	File::id() of the file object
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  std::uint32_t hash(const std::uint64_t fileId, const PageId pageNo) const;
+
+	/**
+	 * Returns the bucket holding (fileId, pageNo), or the empty bucket that ends
+	 * its probe sequence if the entry is not present.
+	 *
+	 * @param fileId 	File::id() of the file object
+	 * @param pageNo  Page number in the file
+	 * @return  			Bucket index.
+	 */
+  std::uint32_t probe(const std::uint64_t fileId, const PageId pageNo) const;
 
  public:
 	/**
    * Constructor of BufHashTbl class
+	 *
+	 * @param htSize	Number of entries the table must be able to hold
 	 */
 	BufHashTbl(const int htSize);  // constructor
 
@@ -75,35 +114,35 @@ class BufHashTbl
   ~BufHashTbl(); // destructor
 	
 	/**
-   * Insert entry into hash table mapping (file, pageNo) to frameNo.
+   * Insert entry into hash table mapping (fileId, pageNo) to frameNo.
 	 *
-	 * @param file   	File object
+	 * @param fileId 	File::id() of the file object
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
+   * @throws  HashTableException if the table is full
 	 */
-  void insert(const File* file, const PageId pageNo, const FrameId frameNo);
+  void insert(const std::uint64_t fileId, const PageId pageNo, const FrameId frameNo);
 
 	/**
-   * Check if (file, pageNo) is currently in the buffer pool (ie. in
+   * Check if (fileId, pageNo) is currently in the buffer pool (ie. in
    * the hash table).
 	 *
-	 * @param file  	File object
+	 * @param fileId 	File::id() of the file object
 	 * @param pageNo	Page number in the file
-	 * @param frameNo Frame number reference
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+	 * @param frameNo Frame number reference, set only if the entry is found
+	 * @return  			True if the page entry is in the hash table
 	 */
-  void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
+  bool lookup(const std::uint64_t fileId, const PageId pageNo, FrameId &frameNo) const;
 
 	/**
-   * Delete entry (file,pageNo) from hash table.
+   * Delete entry (fileId, pageNo) from hash table.
 	 *
-	 * @param file   	File object
+	 * @param fileId 	File::id() of the file object
 	 * @param pageNo  Page number in the file
    * @throws HashNotFoundException if the page entry is not found in the hash table 
 	 */
-  void remove(const File* file, const PageId pageNo);  
+  void remove(const std::uint64_t fileId, const PageId pageNo);  
 };
 
 }
@@ -5,14 +5,20 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <exception>
 #include <memory>
+#include <new>
 #include <iostream>
+#include <sys/mman.h>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/badgerdb_exception.h"
 
 namespace badgerdb { 
 
@@ -20,8 +26,9 @@ namespace badgerdb {
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, ReplacementPolicyType policyType, bool hugePages)
+	: numBufs(bufs), writerStop(false), framesHandedOut(0), writerWakeAt(0),
+	  writerLastHandedOut(0), writerAllocRate(0), prefetchBusy(false), prefetchStop(false) {
 	bufDescTable = new BufDesc[bufs];
 
   for (FrameId i = 0; i < bufs; i++) 
@@ -30,16 +37,52 @@ BufMgr::BufMgr(std::uint32_t bufs)
   	bufDescTable[i].valid = false;
   }
 
-  bufPool = new Page[bufs];
+  // Map the pool rather than new it, so that every frame starts on a page
+  // boundary, as direct I/O needs, and the pool can have huge pages.
+  const std::size_t hugePageSize = 2 * 1024 * 1024;
+  bufPoolBytes = static_cast<std::size_t>(bufs) * Page::SIZE;
+  void* pool = MAP_FAILED;
+  if (hugePages)
+  {
+    bufPoolBytes = (bufPoolBytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+    pool = mmap(NULL, bufPoolBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+  if (pool == MAP_FAILED)
+  {
+    // no huge pages reserved, ask for transparent ones instead
+    pool = mmap(NULL, bufPoolBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pool == MAP_FAILED)
+      throw std::bad_alloc();
+    if (hugePages)
+      madvise(pool, bufPoolBytes, MADV_HUGEPAGE);
+  }
+  bufPool = static_cast<Page*>(pool);
+  for (FrameId i = 0; i < bufs; i++)
+    new (&bufPool[i]) Page();
 
+  // one partition per 16 frames or so, rounded to a power of two
+  numPartitions = 1;
+  while (numPartitions < 64 && numPartitions * 16 < bufs)
+    numPartitions *= 2;
+
+  // Each partition's table has a fixed capacity, so size it well above its
+  // expected share of the frames to absorb uneven spreads.
   int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+  hashPartitions = new BufHashPartition[numPartitions];
+  for (std::uint32_t i = 0; i < numPartitions; i++)
+    hashPartitions[i].table = new BufHashTbl (2 * htsize / numPartitions + 1);  // allocate the buffer hash table
+
+  policy = ReplacementPolicy::create(policyType, bufs);
 
-  clockHand = bufs - 1;
+  if (writerConfig.enabled)
+    writer = std::thread(&BufMgr::backgroundWriter, this);
 }
 
 
 BufMgr::~BufMgr() {
+  stopPrefetcher();
+  stopWriter();
+
   //Flush out all unwritten pages
   for (std::uint32_t i = 0; i < numBufs; i++) 
   {
@@ -50,113 +93,834 @@ BufMgr::~BufMgr() {
   	}
   }
 
-	delete hashTable;
+  for (std::uint32_t i = 0; i < numPartitions; i++)
+    delete hashPartitions[i].table;
+	delete [] hashPartitions;
+  delete policy;
   delete [] bufDescTable;
-  delete [] bufPool;
+  munmap(bufPool, bufPoolBytes);
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+void BufMgr::allocBuf(FrameId & frame, const File* file, const PageId pageNo) 
 {
-  // perform first part of clock algorithm to search for 
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+  // The policy offers candidates in its order of preference and claimFrame
+  // latches the first one that is not pinned.  Several threads may look for
+  // a victim at once; frames another thread is working on are skipped.
+  const ReplacementPolicy::FrameClaimer claim = [this](FrameId f) { return claimFrame(f); };
 
-  while (numScanned < 2*numBufs)	//Need to scn twice
+  while (policy->pickVictim(file, pageNo, claim, frame))
   {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+    BufDesc* desc = &bufDescTable[frame];
 
     // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+    if (! desc->valid)
     {
-      break;
+      policy->frameEvicted(frame);
+      noteFrameHandedOut();
+      return;
     }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+    // hasn't been pinned, write it back and use it
+    bool detached = false;
+    try
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      detached = detachFrame(frame);
+    }
+    catch (...)
+    {
+      desc->latch.unlock();
+      throw;
+    }
+
+    if (detached)
+    {
+      policy->frameEvicted(frame);
+      unlinkFileFrame(frame, true);
+      desc->Clear();
+      noteFrameHandedOut();
+      return;
+    }
+
+    // pinned again while we wrote it back, ask for another one
+    desc->latch.unlock();
+  }
+
+  // full buffer pool
+  throw BufferExceededException();
+} // end allocBuf
+
+void BufMgr::noteFrameHandedOut()
+{
+  const std::uint64_t handedOut = ++framesHandedOut;
+  std::uint64_t wakeAt = writerWakeAt.load(std::memory_order_relaxed);
+  if (wakeAt != 0 && handedOut >= wakeAt && writerWakeAt.compare_exchange_strong(wakeAt, 0))
+  {
+    writerWake.notify_one();
+    // On a busy CPU the writer may otherwise not run until this thread's
+    // time slice is up, by which time a small pool has turned over many
+    // times and its victims are dirty again.
+    std::this_thread::yield();
+  }
+}
+
+void BufMgr::allocStrategyBuf(FrameId & frame, const File* file, const PageId pageNo, BufAccessStrategy* strategy)
+{
+  std::lock_guard<std::mutex> strategyGuard(strategy->latch);
+
+  // keep the ring small next to the pool, however it was sized
+  std::uint32_t ringSize = std::min(strategy->ringSize, numBufs / 4);
+  if (ringSize == 0)
+    ringSize = 1;
+  if (strategy->current >= ringSize)
+    strategy->current = 0;
+  BufAccessStrategy::Slot& slot = strategy->ring[strategy->current];
+  strategy->current = (strategy->current + 1) % ringSize;
+
+  // A prefetched page the scan has not read yet is left to the replacement
+  // policy rather than recycled.  Pinned frames are passed over before
+  // latching: the caller may hold their latches itself while it reads a
+  // batch.
+  if (slot.readAhead)
+  {
+    slot.readAhead = false;
+    strategy->unread--;
+  }
+  else if (slot.used && bufDescTable[slot.frameNo].pinCnt == 0 && bufDescTable[slot.frameNo].latch.try_lock())
+  {
+    BufDesc* desc = &bufDescTable[slot.frameNo];
+    bool reused = false;
+
+    if (! desc->valid)
+    {
+      // flushed since; the frame is free
+      reused = desc->pinCnt == 0;
+    }
+    else if (desc->fileId == slot.fileId && desc->pageNo == slot.pageNo && desc->pinCnt == 0)
+    {
+      // still ours, write it back if the scan dirtied it
+      try
       {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
+        reused = detachFrame(slot.frameNo);
+      }
+      catch (...)
+      {
+        desc->latch.unlock();
+        throw;
+      }
+      if (reused)
+      {
+        unlinkFileFrame(slot.frameNo, true);
+        desc->Clear();
       }
     }
-    else
+
+    if (reused)
     {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+      policy->frameEvicted(slot.frameNo);
+      frame = slot.frameNo;
+      slot.fileId = file->id();
+      slot.pageNo = pageNo;
+      return;
     }
+    desc->latch.unlock();
   }
-  
-  // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+
+  // the ring is still filling, or its frame was taken over: get another one
+  allocBuf(frame, file, pageNo);
+  slot.used = true;
+  slot.frameNo = frame;
+  slot.fileId = file->id();
+  slot.pageNo = pageNo;
+}
+
+bool BufMgr::ringHasRoom(BufAccessStrategy* strategy)
+{
+  std::lock_guard<std::mutex> strategyGuard(strategy->latch);
+
+  std::uint32_t ringSize = std::min(strategy->ringSize, numBufs / 4);
+  if (ringSize == 0)
+    ringSize = 1;
+  return strategy->current >= ringSize || ! strategy->ring[strategy->current].readAhead;
+}
+
+void BufMgr::markReadAhead(BufAccessStrategy* strategy, const FrameId frameNo)
+{
+  std::lock_guard<std::mutex> strategyGuard(strategy->latch);
+
+  for (std::uint32_t i = 0; i < strategy->ringSize; i++)
   {
-    throw BufferExceededException();
+    BufAccessStrategy::Slot& slot = strategy->ring[i];
+    if (slot.used && slot.frameNo == frameNo && ! slot.readAhead)
+    {
+      slot.readAhead = true;
+      strategy->unread++;
+      return;
+    }
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+}
+
+void BufMgr::markRead(BufAccessStrategy* strategy, const File* file, const PageId pageNo)
+{
+  // most pages the scan reads were not prefetched
+  if (strategy->unread == 0)
+    return;
+
+  std::lock_guard<std::mutex> strategyGuard(strategy->latch);
+  for (std::uint32_t i = 0; i < strategy->ringSize; i++)
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    BufAccessStrategy::Slot& slot = strategy->ring[i];
+    if (slot.readAhead && slot.fileId == file->id() && slot.pageNo == pageNo)
+    {
+      slot.readAhead = false;
+      strategy->unread--;
+      return;
+    }
   }
+}
+
+bool BufMgr::claimFrame(const FrameId frameNo)
+{
+  BufDesc* desc = &bufDescTable[frameNo];
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+  // Check to see if someone has it pinned, before latching it too: the
+  // frames of a batch readPages is reading are pinned and latched by the
+  // caller.  A frame whose read failed stays pinned by the threads that
+  // waited for it until they let go.
+  if (desc->pinCnt != 0 || ! desc->latch.try_lock())
+    return false;
+  if (desc->pinCnt == 0)
+    return true;
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+  desc->latch.unlock();
+  return false;
+}
+
+bool BufMgr::detachFrame(const FrameId frameNo)
+{
+  BufDesc* desc = &bufDescTable[frameNo];
+  BufHashPartition& part = partitionFor(desc->fileId, desc->pageNo);
+
+  // Nobody can pin the page while we hold its partition latch, so a copy
+  // taken under it cannot be torn by a writer that pins it afterwards.
+  std::unique_lock<std::mutex> partGuard(part.latch);
+  if (desc->pinCnt != 0)
+    return false;
+
+  // flush any existing changes to disk if necessary, leaving the page
+  // reachable until it is written
+  if (desc->dirty)
+  {
+    desc->dirty = false;
+    // copied rather than assigned, so the page is not zeroed first
+    const Page snapshot(bufPool[frameNo]);
+    partGuard.unlock();
+    try
+    {
+      std::lock_guard<std::mutex> ioGuard(ioLatch);
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      desc->file->writePage(desc->pageNo, snapshot);
+      bufStats.writeLatency.record(start);
+    }
+    catch (...)
+    {
+      desc->dirty = true;
+      throw;
+    }
+    bufStats.diskwrites++;
+    bufStats.victimwrites++;
+    desc->counters->diskwrites++;
+    partGuard.lock();
+  }
+
+  // remove previous entry from hash table, unless a reader pinned or
+  // dirtied the page meanwhile
+  if (desc->pinCnt != 0 || desc->dirty)
+    return false;
+  part.table->remove(desc->fileId, desc->pageNo);
+  return true;
+}
 
 	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufAccessStrategy* strategy)
 {
-  // check to see if it is already in the buffer pool
-  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
-  FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  BufHashPartition& part = partitionFor(file->id(), pageNo);
+  part.accesses++;
+
+  while (true)
+  {
+    // check to see if it is already in the buffer pool
+    FrameId frameNo = 0;
+    bool found;
+    {
+      std::lock_guard<std::mutex> partGuard(part.latch);
+      found = part.table->lookup(file->id(), pageNo, frameNo);
+      if (found)
+        bufDescTable[frameNo].pinCnt++;
+    }
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+    //not in the buffer pool, must allocate a new page
+    if (! found)
+      found = loadPage(file, pageNo, strategy, true, frameNo);
+    else if (waitForLoad(frameNo))
+    {
+      // the pin keeps the frame on this page while the policy notes the hit
+      policy->frameAccessed(frameNo);
+      countHit(frameNo);
+    }
+    else
+      found = false;
+
+    if (found)
+    {
+      if (strategy != NULL)
+        markRead(strategy, file, pageNo);
+      page = &bufPool[frameNo];
+      return;
+    }
+    // another thread failed to read it, try for ourselves
   }
-  catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
+}
+
+bool BufMgr::waitForLoad(const FrameId frameNo)
+{
+  BufDesc* desc = &bufDescTable[frameNo];
+  if (desc->loading)
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    // the thread reading the page holds the frame latch until it is done
+    bufStats.pinwaits++;
+    desc->counters->pinwaits++;
+    std::lock_guard<std::mutex> frameGuard(desc->latch);
+  }
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+  if (desc->valid)
+    return true;
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+  // the read failed and the page was dropped, give the pin back
+  desc->pinCnt--;
+  return false;
+}
+
+bool BufMgr::loadPage(File* file, const PageId pageNo, BufAccessStrategy* strategy, const bool pin, FrameId& frameNo)
+{
+  if (! beginLoad(file, pageNo, strategy, pin, frameNo))
+  {
+    // another thread is reading it, or has already
+    if (! pin)
+      return true;
+    if (! waitForLoad(frameNo))
+      return false;
+    policy->frameAccessed(frameNo);
+    countHit(frameNo);
+    return true;
+  }
+
+  // read the page into the new frame; reads need not take ioLatch
+  try
+  {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    file->readPageInto(pageNo, bufPool[frameNo]);
+    bufStats.readLatency.record(start);
+  }
+  catch (...)
+  {
+    endLoad(frameNo, pin, false);
+    throw;
+  }
+  endLoad(frameNo, pin, true);
+  return true;
+}
+
+bool BufMgr::beginLoad(File* file, const PageId pageNo, BufAccessStrategy* strategy, const bool pin, FrameId& frameNo)
+{
+  BufHashPartition& part = partitionFor(file->id(), pageNo);
+
+  // alloc a new frame; its latch keeps other threads off it during the read
+  if (strategy != NULL)
+    allocStrategyBuf(frameNo, file, pageNo, strategy);
+  else
+    allocBuf(frameNo, file, pageNo);
+  BufDesc* desc = &bufDescTable[frameNo];
+
+  // Publish the page before reading it, so that threads wanting it wait for
+  // this read instead of starting their own.  Another thread may have got
+  // there first while we looked for a frame.
+  FrameId existing = 0;
+  bool found;
+  try
+  {
+    std::lock_guard<std::mutex> partGuard(part.latch);
+    found = part.table->lookup(file->id(), pageNo, existing);
+    if (found)
+    {
+      if (pin)
+        bufDescTable[existing].pinCnt++;
+    }
+    else
+    {
+      // insert in the hash table first, so that a full partition leaves
+      // the frame unpublished
+      part.table->insert(file->id(), pageNo, frameNo);
+
+      // set up the entry properly
+      desc->Set(file, pageNo);
+      desc->loading = true;
+      linkFileFrame(frameNo);
+      if (! pin)
+        desc->pinCnt = 0;
+    }
+  }
+  catch (...)
+  {
+    policy->frameFreed(frameNo);
+    desc->latch.unlock();
+    throw;
+  }
+
+  if (found)
+  {
+    policy->frameFreed(frameNo);
+    desc->latch.unlock();
+    frameNo = existing;
+    return false;
+  }
+  return true;
+}
+
+void BufMgr::endLoad(const FrameId frameNo, const bool pin, const bool read)
+{
+  BufDesc* desc = &bufDescTable[frameNo];
+
+  if (! read)
+  {
+    // Withdraw the page.  Threads waiting for it hold pins on the frame,
+    // which keep it from being reused until they have given them back.
+    {
+      BufHashPartition& part = partitionFor(desc->fileId, desc->pageNo);
+      std::lock_guard<std::mutex> partGuard(part.latch);
+      part.table->remove(desc->fileId, desc->pageNo);
+      if (pin)
+        desc->pinCnt--;
+      unlinkFileFrame(frameNo);
+      desc->file = NULL;
+      desc->fileId = 0;
+      desc->pageNo = Page::INVALID_NUMBER;
+      desc->valid = false;
+      desc->loading = false;
+    }
+    policy->frameFreed(frameNo);
+    desc->latch.unlock();
+    return;
+  }
+  bufStats.diskreads++;
+  desc->counters->diskreads++;
+  if (pin)
+  {
+    // read for a request rather than ahead of one
+    bufStats.misses++;
+    desc->counters->misses++;
+  }
+
+  desc->loading = false;
+  policy->frameLoaded(frameNo, desc->file, desc->pageNo);
+  desc->latch.unlock();
+}
+
+void BufMgr::readPages(File* file, const std::vector<PageId>& pageNos, std::vector<Page*>& pages, BufAccessStrategy* strategy)
+{
+  // one entry per distinct page missed
+  enum State { UNPINNED, PINNED, READING, LOADED };
+  struct Wanted
+  {
+    PageId pageNo;
+    FrameId frameNo;
+    State state;
+  };
+
+  // scratch space kept from call to call, so that a batch allocates nothing
+  thread_local std::vector<std::uint64_t> misses;
+  thread_local std::vector<Wanted> wanted;
+  thread_local std::vector<PageId> readNos;
+  thread_local std::vector<Page*> targets;
+
+  const std::size_t count = pageNos.size();
+  pages.assign(count, NULL);
+  misses.clear();
+  wanted.clear();
+
+  // Pin whatever is in the pool already, in the order given, one pin per run
+  // of the same page.  The misses are noted, each tagged with its position.
+  for (std::size_t k = 0; k < count; )
+  {
+    const PageId pageNo = pageNos[k];
+    std::size_t end = k + 1;
+    while (end < count && pageNos[end] == pageNo)
+      end++;
+    BufHashPartition& part = partitionFor(file->id(), pageNo);
+    part.accesses++;
+    FrameId frameNo = 0;
+    bool found;
+    {
+      std::lock_guard<std::mutex> partGuard(part.latch);
+      found = part.table->lookup(file->id(), pageNo, frameNo);
+      if (found)
+        bufDescTable[frameNo].pinCnt++;
+    }
+
+    for (; k < end; k++)
+    {
+      if (found)
+        pages[k] = &bufPool[frameNo];
+      else
+        misses.push_back((static_cast<std::uint64_t>(pageNo) << 32) | k);
+    }
+  }
+
+  // Register the distinct misses in page number order, then read them as one
+  // batch, all in flight at once.  Pages another thread registered in the
+  // meantime are waited for with the hits, once this thread holds no frame
+  // latch.
+  try
+  {
+    if (! misses.empty())
+    {
+      std::sort(misses.begin(), misses.end());
+      for (std::size_t m = 0; m < misses.size(); m++)
+      {
+        const PageId pageNo = static_cast<PageId>(misses[m] >> 32);
+        if (wanted.empty() || wanted.back().pageNo != pageNo)
+        {
+          const Wanted w = {pageNo, 0, UNPINNED};
+          wanted.push_back(w);
+        }
+      }
+
+      readNos.clear();
+      targets.clear();
+      for (std::size_t i = 0; i < wanted.size(); i++)
+      {
+        wanted[i].state = beginLoad(file, wanted[i].pageNo, strategy, true, wanted[i].frameNo) ? READING : PINNED;
+        if (wanted[i].state == READING)
+        {
+          readNos.push_back(wanted[i].pageNo);
+          targets.push_back(&bufPool[wanted[i].frameNo]);
+        }
+      }
+
+      if (! readNos.empty())
+      {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        file->readPagesInto(readNos, targets);
+        for (std::size_t i = 0; i < wanted.size(); i++)
+        {
+          if (wanted[i].state == READING)
+          {
+            bufStats.readLatency.record(start);
+            wanted[i].state = LOADED;
+          }
+        }
+      }
+    }
+  }
+  catch (...)
+  {
+    for (std::size_t i = 0; i < wanted.size(); i++)
+    {
+      if (wanted[i].state == READING)
+        endLoad(wanted[i].frameNo, true, false);
+      else if (wanted[i].state == LOADED)
+        endLoad(wanted[i].frameNo, true, true);
+      if (wanted[i].state == PINNED || wanted[i].state == LOADED)
+        bufDescTable[wanted[i].frameNo].pinCnt--;
+    }
+    releaseBatchPins(pageNos, pages);
+    throw;
+  }
+
+  for (std::size_t i = 0; i < wanted.size(); i++)
+  {
+    if (wanted[i].state == LOADED)
+      endLoad(wanted[i].frameNo, true, true);
+  }
+
+  // wait for the pages other threads were reading
+  try
+  {
+    for (std::size_t k = 0; k < count; k++)
+    {
+      if (pages[k] == NULL || (k > 0 && pageNos[k - 1] == pageNos[k]))
+        continue;
+      FrameId frameNo = static_cast<FrameId>(pages[k] - bufPool);
+      if (! waitForHit(frameNo))
+      {
+        // another thread failed to read it, try for ourselves
+        pages[k] = NULL;
+        Page* page;
+        readPage(file, pageNos[k], page, strategy);
+        frameNo = static_cast<FrameId>(page - bufPool);
+      }
+      for (std::size_t r = k; r < count && pageNos[r] == pageNos[k]; r++)
+        pages[r] = &bufPool[frameNo];
+    }
+
+    for (std::size_t i = 0; i < wanted.size(); i++)
+    {
+      if (wanted[i].state == PINNED && ! waitForHit(wanted[i].frameNo))
+      {
+        wanted[i].state = UNPINNED;
+        Page* page;
+        readPage(file, wanted[i].pageNo, page, strategy);
+        wanted[i].frameNo = static_cast<FrameId>(page - bufPool);
+        wanted[i].state = PINNED;
+      }
+    }
+  }
+  catch (...)
+  {
+    for (std::size_t i = 0; i < wanted.size(); i++)
+    {
+      if (wanted[i].state != UNPINNED)
+        bufDescTable[wanted[i].frameNo].pinCnt--;
+    }
+    releaseBatchPins(pageNos, pages);
+    throw;
+  }
+
+  // Hand out the pages read, with a pin for every further run listing a page.
+  std::size_t i = 0;
+  bool first = true;
+  for (std::size_t m = 0; m < misses.size(); m++)
+  {
+    const std::size_t k = static_cast<std::size_t>(misses[m] & 0xffffffffu);
+    if (wanted[i].pageNo != pageNos[k])
+    {
+      i++;
+      first = true;
+    }
+    pages[k] = &bufPool[wanted[i].frameNo];
+    if (k > 0 && pageNos[k - 1] == pageNos[k])
+      continue;
+    if (! first)
+      bufDescTable[wanted[i].frameNo].pinCnt++;
+    first = false;
+  }
+}
+
+bool BufMgr::waitForHit(const FrameId frameNo)
+{
+  if (! waitForLoad(frameNo))
+    return false;
+  policy->frameAccessed(frameNo);
+  countHit(frameNo);
+  return true;
+}
+
+void BufMgr::releaseBatchPins(const std::vector<PageId>& pageNos, std::vector<Page*>& pages)
+{
+  for (std::size_t k = 0; k < pages.size(); k++)
+  {
+    if (pages[k] != NULL && (k == 0 || pageNos[k - 1] != pageNos[k]))
+      bufDescTable[pages[k] - bufPool].pinCnt--;
+  }
+}
+
+void BufMgr::prefetch(File* file, const PageId firstPageNo, const std::uint32_t count, BufAccessStrategy* strategy)
+{
+  // Pages are read a batch at a time, each batch in flight at once.  Its
+  // frames stay pinned until it is in, so keep it small next to the pool, and
+  // to the ring it is read through, which it must not wrap around.
+  std::uint32_t batchSize = numBufs / 8;
+  if (strategy != NULL)
+    batchSize = std::min(batchSize, std::min(strategy->ringSize, numBufs / 4) / 2);
+  if (batchSize == 0)
+    batchSize = 1;
+
+  std::vector<PageId> readNos;
+  std::vector<FrameId> readFrames;
+  std::vector<Page*> targets;
+  for (std::uint32_t next = 0; next < count; )
+  {
+    // Register the pages that are not in yet, holding a pin on each until it
+    // is read so that registering the next cannot pick its frame.  Only a
+    // hint: stop when the pool is all pinned.
+    readNos.clear();
+    readFrames.clear();
+    targets.clear();
+    bool full = false;
+    for (; next < count && readNos.size() < batchSize; next++)
+    {
+      // the ring is full of pages the scan has yet to get to
+      if (strategy != NULL && ! ringHasRoom(strategy))
+      {
+        full = true;
+        break;
+      }
+
+      const PageId pageNo = firstPageNo + next;
+      BufHashPartition& part = partitionFor(file->id(), pageNo);
+      FrameId frameNo = 0;
+      {
+        std::lock_guard<std::mutex> partGuard(part.latch);
+        if (part.table->lookup(file->id(), pageNo, frameNo))
+          continue;
+      }
+
+      try
+      {
+        if (! beginLoad(file, pageNo, strategy, true, frameNo))
+        {
+          bufDescTable[frameNo].pinCnt--;
+          continue;
+        }
+      }
+      catch (const BadgerDbException&)
+      {
+        full = true;
+        break;
+      }
+      if (strategy != NULL)
+        markReadAhead(strategy, frameNo);
+      readNos.push_back(pageNo);
+      readFrames.push_back(frameNo);
+      targets.push_back(&bufPool[frameNo]);
+    }
+
+    bool read = true;
+    if (! readNos.empty())
+    {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      try
+      {
+        file->readPagesInto(readNos, targets);
+      }
+      catch (const BadgerDbException&)
+      {
+        read = false;
+      }
+
+      for (std::size_t i = 0; i < readNos.size(); i++)
+      {
+        if (read)
+        {
+          bufStats.readLatency.record(start);
+          bufDescTable[readFrames[i]].pinCnt--;
+          endLoad(readFrames[i], false, true);
+          bufStats.prefetches++;
+        }
+        else
+          endLoad(readFrames[i], true, false);
+      }
+    }
+
+    // Some page is past the end of the file, or could not be read: read them
+    // one at a time up to the first that fails, and stop there.
+    if (! read)
+    {
+      for (std::size_t i = 0; i < readNos.size(); i++)
+      {
+        FrameId frameNo = 0;
+        try
+        {
+          loadPage(file, readNos[i], strategy, false, frameNo);
+        }
+        catch (const BadgerDbException&)
+        {
+          return;
+        }
+        bufStats.prefetches++;
+      }
+      return;
+    }
+    if (full)
+      return;
+  }
+}
+
+void BufMgr::prefetchAsync(File* file, const PageId firstPageNo, const std::uint32_t count, BufAccessStrategy* strategy)
+{
+  std::lock_guard<std::mutex> guard(prefetchLatch);
+  if (! prefetcher.joinable())
+    prefetcher = std::thread(&BufMgr::backgroundPrefetcher, this);
+
+  // A request still queued from the same reader is for pages it is about to
+  // read itself; replace it, so that a prefetcher running behind skips ahead
+  // instead of reading pages the reader has already consumed.
+  const PrefetchRequest request = {file, firstPageNo, count, strategy};
+  for (std::deque<PrefetchRequest>::iterator it = prefetchQueue.begin(); it != prefetchQueue.end(); ++it)
+  {
+    if (it->file == file && it->strategy == strategy)
+    {
+      *it = request;
+      return;
+    }
+  }
+  prefetchQueue.push_back(request);
+  prefetchWake.notify_one();
+}
+
+void BufMgr::backgroundPrefetcher()
+{
+  std::unique_lock<std::mutex> lock(prefetchLatch);
+
+  while (true)
+  {
+    while (! prefetchStop && prefetchQueue.empty())
+      prefetchWake.wait(lock);
+    if (prefetchStop)
+      break;
+
+    const PrefetchRequest request = prefetchQueue.front();
+    prefetchQueue.pop_front();
+    prefetchBusy = true;
+    lock.unlock();
+
+    // If its first page is in already, the reader got there before us and
+    // will read the rest sooner than we could; reading them again could
+    // only push out pages it still needs.
+    FrameId frameNo = 0;
+    BufHashPartition& part = partitionFor(request.file->id(), request.firstPageNo);
+    bool overtaken;
+    {
+      std::lock_guard<std::mutex> partGuard(part.latch);
+      overtaken = part.table->lookup(request.file->id(), request.firstPageNo, frameNo);
+    }
+    if (! overtaken)
+      prefetch(request.file, request.firstPageNo, request.count, request.strategy);
+    lock.lock();
+    prefetchBusy = false;
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+    if (prefetchQueue.empty())
+      prefetchIdle.notify_all();
+  }
+}
+
+void BufMgr::drainPrefetches()
+{
+  std::unique_lock<std::mutex> lock(prefetchLatch);
+  while (prefetchBusy || ! prefetchQueue.empty())
+    prefetchIdle.wait(lock);
+}
+
+void BufMgr::stopPrefetcher()
+{
+  {
+    std::lock_guard<std::mutex> guard(prefetchLatch);
+    prefetchStop = true;
   }
+  prefetchWake.notify_all();
+  if (prefetcher.joinable())
+    prefetcher.join();
 }
 
 
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
 {
+  BufHashPartition& part = partitionFor(file->id(), pageNo);
+  std::lock_guard<std::mutex> partGuard(part.latch);
+
   // lookup in hashtable
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  if (! part.table->lookup(file->id(), pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
 
   if (dirty == true) bufDescTable[frameNo].dirty = dirty;
 
@@ -168,66 +932,713 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
   else bufDescTable[frameNo].pinCnt--;
 }
 
-void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
+void BufMgr::unPinFrame(const FrameId frameNo, const bool dirty)
+{
+  BufDesc* desc = &bufDescTable[frameNo];
+
+  // dirty first: whoever sees the pin gone must see the page dirty
+  if (dirty)
+    desc->dirty = true;
+  desc->pinCnt--;
+}
+
+ReadPageGuard BufMgr::fetchPageRead(File* file, const PageId pageNo, BufAccessStrategy* strategy)
+{
+  Page* page;
+  readPage(file, pageNo, page, strategy);
+  return ReadPageGuard(this, static_cast<FrameId>(page - bufPool), page);
+}
+
+WritePageGuard BufMgr::fetchPageWrite(File* file, const PageId pageNo, BufAccessStrategy* strategy)
+{
+  Page* page;
+  readPage(file, pageNo, page, strategy);
+  return WritePageGuard(this, static_cast<FrameId>(page - bufPool), page);
+}
+
+WritePageGuard BufMgr::allocPageWrite(File* file, PageId& pageNo, const PageId nearPageNo)
+{
+  Page* page;
+  allocPage(file, pageNo, page, nearPageNo);
+  WritePageGuard guard(this, static_cast<FrameId>(page - bufPool), page);
+  guard.markDirty();
+  return guard;
+}
+
+void BufMgr::unPinPages(File* file, const std::vector<PageId>& pageNos, const bool dirty)
+{
+  // one pin per run of the same page, as readPages took them
+  for (std::size_t k = 0; k < pageNos.size(); k++)
+  {
+    if (k > 0 && pageNos[k] == pageNos[k - 1])
+      continue;
+    BufHashPartition& part = partitionFor(file->id(), pageNos[k]);
+    std::lock_guard<std::mutex> partGuard(part.latch);
+
+    FrameId frameNo = 0;
+    if (! part.table->lookup(file->id(), pageNos[k], frameNo))
+      throw HashNotFoundException(file->filename(), pageNos[k]);
+    if (bufDescTable[frameNo].pinCnt == 0)
+      throw PageNotPinnedException(file->filename(), pageNos[k], frameNo);
+
+    if (dirty)
+      bufDescTable[frameNo].dirty = true;
+    bufDescTable[frameNo].pinCnt--;
+  }
+}
+
+void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page, const PageId nearPageNo) 
 {
   FrameId frameNo;
 
   // alloc a new frame
-  allocBuf(frameNo);
+  allocBuf(frameNo, file, Page::INVALID_NUMBER);
+  BufDesc* desc = &bufDescTable[frameNo];
 
   // allocate a new page in the file
-	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  try
+  {
+    std::lock_guard<std::mutex> ioGuard(ioLatch);
+    file->allocatePageNear(pageNo, bufPool[frameNo], nearPageNo);
+  }
+  catch (...)
+  {
+    policy->frameFreed(frameNo);
+    desc->latch.unlock();
+    throw;
+  }
   page = &bufPool[frameNo];
 
-  // set up the entry properly
-  bufDescTable[frameNo].Set(file, pageNo);
+  try
+  {
+    BufHashPartition& part = partitionFor(file->id(), pageNo);
+    std::lock_guard<std::mutex> partGuard(part.latch);
+
+    // insert in the hash table first, so that a full partition leaves the
+    // frame unpublished
+    part.table->insert(file->id(), pageNo, frameNo);
+
+    // set up the entry properly
+    desc->Set(file, pageNo);
+    linkFileFrame(frameNo);
+  }
+  catch (...)
+  {
+    policy->frameFreed(frameNo);
+    desc->latch.unlock();
+    throw;
+  }
 
-  // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  policy->frameLoaded(frameNo, file, pageNo);
+  desc->latch.unlock();
 }
 
 void BufMgr::flushFile(const File* file) 
 {
-  for (std::uint32_t i = 0; i < numBufs; i++)
+  // nothing may be on its way into the pool for the file
+  drainPrefetches();
+
+  // The file's frames, latched in frame order: this is the one place that
+  // waits for a frame latch while holding others, and the order keeps two
+  // flushes from waiting on each other.
+  std::vector<FrameId> frames;
+  {
+    std::lock_guard<std::mutex> listGuard(fileFramesLatch);
+    std::unordered_map<std::uint64_t, FileFrames>::const_iterator it = fileFrames.find(file->id());
+    if (it != fileFrames.end())
+    {
+      frames.reserve(it->second.count);
+      for (FrameId i = it->second.head; i != BufDesc::NO_FRAME; i = bufDescTable[i].fileNext)
+        frames.push_back(i);
+    }
+  }
+  std::sort(frames.begin(), frames.end());
+
+  // Take each frame's page out of the hash table and keep the frame latched
+  // until the page is written and the frame freed.  A pinned page stops the
+  // flush, once the pages taken so far are written.
+  std::vector<std::unique_lock<std::mutex> > latches;
+  std::vector<FrameId> detached;
+  std::vector<std::pair<PageId, FrameId> > dirty;
+  std::exception_ptr failure;
+  for (std::size_t f = 0; f < frames.size(); f++)
 	{
+    const FrameId i = frames[f];
   	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file)
-		{
+    std::unique_lock<std::mutex> frameGuard(tmpbuf->latch);
+
+    // evicted since we looked
+    if (tmpbuf->fileId != file->id())
+      continue;
+    try
+    {
+		  if (tmpbuf->valid == false)
+  		  throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, false);
+
+      BufHashPartition& part = partitionFor(file->id(), tmpbuf->pageNo);
+      std::lock_guard<std::mutex> partGuard(part.latch);
 	    if (tmpbuf->pinCnt > 0)
-  			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+  		  throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+
+    	part.table->remove(file->id(), tmpbuf->pageNo);
+    }
+    catch (...)
+    {
+      failure = std::current_exception();
+      break;
+    }
 
-	    if (tmpbuf->dirty == true)
-			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
-    	}
+    latches.push_back(std::move(frameGuard));
+    detached.push_back(i);
+	  if (tmpbuf->dirty == true)
+      dirty.push_back(std::make_pair(tmpbuf->pageNo, i));
+  }
 
-    	hashTable->remove(file,tmpbuf->pageNo);
-    	tmpbuf->Clear();
-  	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
-  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+  // write the dirty pages in one batch, in page number order so that the
+  // writes go out sequentially
+  if (! dirty.empty())
+  {
+    std::sort(dirty.begin(), dirty.end());
+    std::vector<PageId> writeNos;
+    std::vector<const Page*> sources;
+    for (std::size_t d = 0; d < dirty.size(); d++)
+    {
+      writeNos.push_back(dirty[d].first);
+      sources.push_back(&bufPool[dirty[d].second]);
+    }
+
+    File* writeFile = bufDescTable[dirty[0].second].file;
+    try
+    {
+      std::lock_guard<std::mutex> ioGuard(ioLatch);
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      writeFile->writePages(writeNos, sources);
+      for (std::size_t d = 0; d < dirty.size(); d++)
+        bufStats.writeLatency.record(start);
+    }
+    catch (...)
+    {
+      // put the pages back, still dirty
+      for (std::size_t d = 0; d < detached.size(); d++)
+      {
+        BufDesc* tmpbuf = &(bufDescTable[detached[d]]);
+        BufHashPartition& part = partitionFor(file->id(), tmpbuf->pageNo);
+        std::lock_guard<std::mutex> partGuard(part.latch);
+        part.table->insert(file->id(), tmpbuf->pageNo, detached[d]);
+      }
+      throw;
+    }
+    bufStats.diskwrites += dirty.size();
+    bufDescTable[dirty[0].second].counters->diskwrites += dirty.size();
   }
+
+  for (std::size_t d = 0; d < detached.size(); d++)
+  {
+    const FrameId i = detached[d];
+    bufDescTable[i].dirty = false;
+    unlinkFileFrame(i);
+    bufDescTable[i].Clear();
+    policy->frameFreed(i);
+  }
+  latches.clear();
+
+  if (failure)
+    std::rethrow_exception(failure);
+
+  // and the file header, which the file keeps in memory until now
+  std::lock_guard<std::mutex> ioGuard(ioLatch);
+  file->flushHeader();
+}
+
+void BufMgr::linkFileFrame(const FrameId frameNo)
+{
+  BufDesc* desc = &bufDescTable[frameNo];
+  std::lock_guard<std::mutex> listGuard(fileFramesLatch);
+
+  std::unordered_map<std::uint64_t, FileFrames>::iterator it = fileFrames.find(desc->fileId);
+  if (it == fileFrames.end())
+  {
+    const FileFrames empty = {BufDesc::NO_FRAME, 0, &fileCounters[desc->file->filename()]};
+    it = fileFrames.insert(std::make_pair(desc->fileId, empty)).first;
+  }
+  desc->counters = it->second.counters;
+
+  desc->filePrev = BufDesc::NO_FRAME;
+  desc->fileNext = it->second.head;
+  if (it->second.head != BufDesc::NO_FRAME)
+    bufDescTable[it->second.head].filePrev = frameNo;
+  it->second.head = frameNo;
+  it->second.count++;
+}
+
+void BufMgr::unlinkFileFrame(const FrameId frameNo, const bool evicted)
+{
+  BufDesc* desc = &bufDescTable[frameNo];
+  if (evicted)
+  {
+    bufStats.evictions++;
+    desc->counters->evictions++;
+  }
+
+  std::lock_guard<std::mutex> listGuard(fileFramesLatch);
+
+  std::unordered_map<std::uint64_t, FileFrames>::iterator it = fileFrames.find(desc->fileId);
+  if (it == fileFrames.end())
+    return;
+
+  if (desc->filePrev != BufDesc::NO_FRAME)
+    bufDescTable[desc->filePrev].fileNext = desc->fileNext;
+  else
+    it->second.head = desc->fileNext;
+  if (desc->fileNext != BufDesc::NO_FRAME)
+    bufDescTable[desc->fileNext].filePrev = desc->filePrev;
+  desc->fileNext = desc->filePrev = BufDesc::NO_FRAME;
+
+  // forget files with no pages left, their File objects may be gone soon
+  if (--it->second.count == 0)
+    fileFrames.erase(it);
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo)
 {
 	//Deallocate from file altogether
+  drainPrefetches();
+
   //See if it is in the buffer pool
+  BufHashPartition& part = partitionFor(file->id(), pageNo);
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  {
+    std::lock_guard<std::mutex> partGuard(part.latch);
+    if (! part.table->lookup(file->id(), pageNo, frameNo))
+      throw HashNotFoundException(file->filename(), pageNo);
+  }
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+  {
+    BufDesc* desc = &bufDescTable[frameNo];
+    std::lock_guard<std::mutex> frameGuard(desc->latch);
+    std::lock_guard<std::mutex> partGuard(part.latch);
 
-	hashTable->remove(file, pageNo);
+    // the frame may have been recycled while we waited for its latch
+    if (desc->valid && desc->fileId == file->id() && desc->pageNo == pageNo)
+    {
+	    // clear the page
+      unlinkFileFrame(frameNo);
+	    desc->Clear();
+
+	    part.table->remove(file->id(), pageNo);
+      policy->frameFreed(frameNo);
+    }
+  }
 
   // deallocate it in the file	
+  std::lock_guard<std::mutex> ioGuard(ioLatch);
   file->deletePage(pageNo);
 }
 
+void BufMgr::disposePages(File* file, const std::vector<PageId>& pageNos)
+{
+  drainPrefetches();
+
+  for (std::size_t i = 0; i < pageNos.size(); i++)
+  {
+    const PageId pageNo = pageNos[i];
+    BufHashPartition& part = partitionFor(file->id(), pageNo);
+    FrameId frameNo = 0;
+    {
+      std::lock_guard<std::mutex> partGuard(part.latch);
+      if (! part.table->lookup(file->id(), pageNo, frameNo))
+        continue;
+    }
+
+    BufDesc* desc = &bufDescTable[frameNo];
+    std::lock_guard<std::mutex> frameGuard(desc->latch);
+    std::lock_guard<std::mutex> partGuard(part.latch);
+
+    // the frame may have been recycled while we waited for its latch
+    if (desc->valid && desc->fileId == file->id() && desc->pageNo == pageNo)
+    {
+      unlinkFileFrame(frameNo);
+      desc->Clear();
+
+      part.table->remove(file->id(), pageNo);
+      policy->frameFreed(frameNo);
+    }
+  }
+
+  // deallocate them in the file together
+  std::lock_guard<std::mutex> ioGuard(ioLatch);
+  file->deletePages(pageNos);
+}
+
+BufWriterConfig BufMgr::getWriterConfig()
+{
+  std::lock_guard<std::mutex> guard(writerLatch);
+  return writerConfig;
+}
+
+void BufMgr::setWriterConfig(const BufWriterConfig& config)
+{
+  stopWriter();
+
+  std::lock_guard<std::mutex> guard(writerLatch);
+  writerConfig = config;
+  writerStop = false;
+  if (writerConfig.enabled)
+    writer = std::thread(&BufMgr::backgroundWriter, this);
+}
+
+void BufMgr::stopWriter()
+{
+  {
+    std::lock_guard<std::mutex> guard(writerLatch);
+    writerStop = true;
+  }
+  writerWake.notify_all();
+  if (writer.joinable())
+    writer.join();
+}
+
+void BufMgr::backgroundWriter()
+{
+  std::vector<FrameId> candidates;
+  std::vector<Page> snapshots(WRITE_BEHIND_BATCH);
+  std::unique_lock<std::mutex> lock(writerLatch);
+
+  // until the first round has measured it, expect a quarter of the pool
+  // to be taken per round
+  writerLastHandedOut = framesHandedOut;
+  writerAllocRate = numBufs / 4.0 / writerConfig.allocMultiplier;
+  writerWakeAt = writerLastHandedOut + numBufs / 8 + 1;
+
+  while (! writerStop)
+  {
+    writerWake.wait_for(lock, std::chrono::milliseconds(writerConfig.delayMs));
+    if (writerStop)
+      break;
+
+    const BufWriterConfig config = writerConfig;
+    lock.unlock();
+    writerRound(config, candidates, snapshots);
+    lock.lock();
+  }
+  writerWakeAt = 0;
+}
+
+void BufMgr::writerRound(const BufWriterConfig& config, std::vector<FrameId>& candidates, std::vector<Page>& snapshots)
+{
+  bufStats.bgrounds++;
+
+  // Expect as many frames to be taken before the next round as were since
+  // the last one, or as the running average says if that is more, so that
+  // a lull does not leave the writer behind once the load comes back.
+  const std::uint64_t handedOut = framesHandedOut;
+  const double recent = static_cast<double>(handedOut - writerLastHandedOut);
+  writerLastHandedOut = handedOut;
+  writerAllocRate += (recent - writerAllocRate) / ALLOC_RATE_ROUNDS;
+  const double expected = std::max(recent, writerAllocRate) * config.allocMultiplier;
+  const std::uint32_t upcoming = static_cast<std::uint32_t>(std::min(std::ceil(expected), static_cast<double>(numBufs)));
+
+  // clean the pages the policy is going to evict next, and come back once
+  // half of their frames have been taken
+  candidates.clear();
+  policy->candidateVictims(upcoming, candidates);
+  writeBehind(candidates, config.maxPagesPerRound, snapshots);
+  writerWakeAt = framesHandedOut + upcoming / 2 + 1;
+
+  // past the high-water mark, bring the whole pool down to the low one
+  std::uint32_t numDirty = 0;
+  for (std::uint32_t i = 0; i < numBufs; i++)
+  {
+    if (bufDescTable[i].dirty)
+      numDirty++;
+  }
+  if (numDirty <= config.highWater * numBufs)
+    return;
+
+  candidates.clear();
+  for (std::uint32_t i = 0; i < numBufs; i++)
+  {
+    if (bufDescTable[i].dirty)
+      candidates.push_back(i);
+  }
+  writeBehind(candidates, numDirty - static_cast<std::uint32_t>(config.lowWater * numBufs), snapshots);
+}
+
+std::uint32_t BufMgr::writeBehind(const std::vector<FrameId>& frames, const std::uint32_t limit, std::vector<Page>& snapshots)
+{
+  struct Copy
+  {
+    File* file;
+    PageId pageNo;
+    FrameId frameNo;
+    std::size_t slot;
+
+    bool operator<(const Copy& rhs) const
+    {
+      return file < rhs.file || (file == rhs.file && pageNo < rhs.pageNo);
+    }
+  };
+  std::vector<Copy> batch;
+  std::vector<PageId> writeNos;
+  std::vector<const Page*> sources;
+  std::uint32_t written = 0;
+
+  std::size_t next = 0;
+  while (next < frames.size() && written < limit)
+  {
+    // Copy up to a batch of dirty, unpinned frames, keeping each latched so
+    // that it is not reused until its copy is written.  The pages stay in the
+    // pool; a reader pinning and dirtying one meanwhile marks it dirty again.
+    batch.clear();
+    for (; next < frames.size() && batch.size() < snapshots.size() && written + batch.size() < limit; next++)
+    {
+      const FrameId frameNo = frames[next];
+      BufDesc* desc = &bufDescTable[frameNo];
+
+      // cheap look first, without latching
+      if (! desc->dirty || desc->pinCnt != 0)
+        continue;
+      if (! desc->latch.try_lock())
+        continue;
+      if (! desc->valid)
+      {
+        desc->latch.unlock();
+        continue;
+      }
+
+      {
+        BufHashPartition& part = partitionFor(desc->fileId, desc->pageNo);
+        std::lock_guard<std::mutex> partGuard(part.latch);
+        if (desc->pinCnt != 0 || ! desc->dirty)
+        {
+          desc->latch.unlock();
+          continue;
+        }
+        desc->dirty = false;
+        snapshots[batch.size()] = bufPool[frameNo];
+      }
+      const Copy copy = {desc->file, desc->pageNo, frameNo, batch.size()};
+      batch.push_back(copy);
+    }
+
+    // write the copies, one batch per file
+    std::sort(batch.begin(), batch.end());
+    for (std::size_t first = 0; first < batch.size(); )
+    {
+      std::size_t last = first;
+      writeNos.clear();
+      sources.clear();
+      for (; last < batch.size() && batch[last].file == batch[first].file; last++)
+      {
+        writeNos.push_back(batch[last].pageNo);
+        sources.push_back(&snapshots[batch[last].slot]);
+      }
+
+      bool ok = true;
+      try
+      {
+        std::lock_guard<std::mutex> ioGuard(ioLatch);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        batch[first].file->writePages(writeNos, sources);
+        for (std::size_t k = first; k < last; k++)
+          bufStats.writeLatency.record(start);
+      }
+      catch (...)
+      {
+        // leave them for eviction to write and report
+        ok = false;
+      }
+
+      for (std::size_t k = first; k < last; k++)
+      {
+        BufDesc* desc = &bufDescTable[batch[k].frameNo];
+        if (ok)
+        {
+          bufStats.diskwrites++;
+          bufStats.bgwrites++;
+          desc->counters->diskwrites++;
+          written++;
+        }
+        else
+          desc->dirty = true;
+        desc->latch.unlock();
+      }
+      first = last;
+    }
+  }
+  return written;
+}
+
+void BufMgr::sumPartitionStats()
+{
+  std::uint64_t accesses = 0;
+  std::uint64_t hits = 0;
+  for (std::uint32_t i = 0; i < numPartitions; i++)
+  {
+    accesses += hashPartitions[i].accesses;
+    hits += hashPartitions[i].hits;
+  }
+  bufStats.accesses = accesses;
+  bufStats.hits = hits;
+}
+
+void BufMgr::clearBufStats()
+{
+  bufStats.clear();
+  for (std::uint32_t i = 0; i < numPartitions; i++)
+  {
+    hashPartitions[i].accesses = 0;
+    hashPartitions[i].hits = 0;
+  }
+
+  std::lock_guard<std::mutex> listGuard(fileFramesLatch);
+  for (std::map<std::string, BufFileCounters>::iterator it = fileCounters.begin(); it != fileCounters.end(); ++it)
+    it->second.clear();
+}
+
+void BufMgr::getFileStats(std::map<std::string, BufFileStats>& stats)
+{
+  stats.clear();
+
+  std::lock_guard<std::mutex> listGuard(fileFramesLatch);
+  for (std::map<std::string, BufFileCounters>::const_iterator it = fileCounters.begin(); it != fileCounters.end(); ++it)
+  {
+    const BufFileStats fileStats = {it->second.hits, it->second.misses, it->second.pinwaits,
+                                    it->second.diskreads, it->second.diskwrites, it->second.evictions};
+    stats[it->first] = fileStats;
+  }
+}
+
+// Writes a file name as a quoted string, for either format.
+static void printQuoted(std::ostream& out, const std::string& name)
+{
+  out << '"';
+  for (std::size_t i = 0; i < name.size(); i++)
+  {
+    if (name[i] == '"' || name[i] == '\\')
+      out << '\\';
+    out << name[i];
+  }
+  out << '"';
+}
+
+void BufMgr::printStats(std::ostream& out, const BufStatsFormat format)
+{
+  std::map<std::string, BufFileStats> files;
+  getFileStats(files);
+  sumPartitionStats();
+
+  const char* names[] = {"accesses", "hits", "misses", "evictions", "pinwaits", "diskreads", "diskwrites",
+                         "victimwrites", "bgwrites", "bgrounds", "prefetches"};
+  const std::uint64_t values[] = {bufStats.accesses, bufStats.hits, bufStats.misses, bufStats.evictions, bufStats.pinwaits,
+                        bufStats.diskreads, bufStats.diskwrites, bufStats.victimwrites, bufStats.bgwrites,
+                        bufStats.bgrounds, bufStats.prefetches};
+  const int numValues = sizeof(values) / sizeof(values[0]);
+
+  const char* latencyNames[] = {"read", "write"};
+  const BufLatencyHistogram* latencies[] = {&bufStats.readLatency, &bufStats.writeLatency};
+
+  const char* fileNames[] = {"hits", "misses", "pinwaits", "diskreads", "diskwrites", "evictions"};
+  const int numFileValues = sizeof(fileNames) / sizeof(fileNames[0]);
+
+  if (format == STATS_TEXT)
+  {
+    out << "badgerdb_buffer_frames " << numBufs << "\n";
+    for (int i = 0; i < numValues; i++)
+      out << "badgerdb_buffer_" << names[i] << "_total " << values[i] << "\n";
+
+    // cumulative buckets, as monitoring systems expect
+    for (int l = 0; l < 2; l++)
+    {
+      std::uint64_t cumulative = 0;
+      for (int b = 0; b < BufLatencyHistogram::NUM_BUCKETS; b++)
+      {
+        cumulative += latencies[l]->buckets[b];
+        out << "badgerdb_buffer_" << latencyNames[l] << "_latency_usec_bucket{le=\"";
+        if (b < BufLatencyHistogram::NUM_BUCKETS - 1)
+          out << BufLatencyHistogram::bucketLimit(b);
+        else
+          out << "+Inf";
+        out << "\"} " << cumulative << "\n";
+      }
+      out << "badgerdb_buffer_" << latencyNames[l] << "_latency_usec_sum " << latencies[l]->totalUsec << "\n";
+      out << "badgerdb_buffer_" << latencyNames[l] << "_latency_usec_count " << cumulative << "\n";
+    }
+
+    for (std::map<std::string, BufFileStats>::const_iterator it = files.begin(); it != files.end(); ++it)
+    {
+      const std::uint64_t fileValues[] = {it->second.hits, it->second.misses, it->second.pinwaits,
+                                          it->second.diskreads, it->second.diskwrites, it->second.evictions};
+      for (int i = 0; i < numFileValues; i++)
+      {
+        out << "badgerdb_buffer_file_" << fileNames[i] << "_total{file=";
+        printQuoted(out, it->first);
+        out << "} " << fileValues[i] << "\n";
+      }
+    }
+    out.flush();
+    return;
+  }
+
+  out << "{\"frames\":" << numBufs;
+  for (int i = 0; i < numValues; i++)
+    out << ",\"" << names[i] << "\":" << values[i];
+
+  for (int l = 0; l < 2; l++)
+  {
+    out << ",\"" << latencyNames[l] << "LatencyUsec\":{\"buckets\":[";
+    for (int b = 0; b < BufLatencyHistogram::NUM_BUCKETS; b++)
+      out << (b > 0 ? "," : "") << latencies[l]->buckets[b];
+    out << "],\"sum\":" << latencies[l]->totalUsec << ",\"count\":" << latencies[l]->count() << "}";
+  }
+
+  out << ",\"files\":{";
+  for (std::map<std::string, BufFileStats>::const_iterator it = files.begin(); it != files.end(); ++it)
+  {
+    const std::uint64_t fileValues[] = {it->second.hits, it->second.misses, it->second.pinwaits,
+                                        it->second.diskreads, it->second.diskwrites, it->second.evictions};
+    if (it != files.begin())
+      out << ",";
+    printQuoted(out, it->first);
+    out << ":{";
+    for (int i = 0; i < numFileValues; i++)
+      out << (i > 0 ? "," : "") << "\"" << fileNames[i] << "\":" << fileValues[i];
+    out << "}";
+  }
+  out << "}}" << std::endl;
+}
+
+PageGuard::PageGuard(PageGuard&& other)
+  : bufMgr(other.bufMgr), frameNo(other.frameNo), page(other.page), dirty(other.dirty)
+{
+  other.page = NULL;
+  other.dirty = false;
+}
+
+PageGuard& PageGuard::operator=(PageGuard&& other)
+{
+  if (this != &other)
+  {
+    release();
+    bufMgr = other.bufMgr;
+    frameNo = other.frameNo;
+    page = other.page;
+    dirty = other.dirty;
+    other.page = NULL;
+    other.dirty = false;
+  }
+  return *this;
+}
+
+void PageGuard::release()
+{
+  if (page == NULL)
+    return;
+  bufMgr->unPinFrame(frameNo, dirty);
+  page = NULL;
+  dirty = false;
+}
+
 void BufMgr::printSelf(void) 
 {
   BufDesc* tmpbuf;
@@ -9,7 +9,18 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "replacement.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace badgerdb {
 
@@ -18,6 +29,52 @@ namespace badgerdb {
 */
 class BufMgr;
 
+/**
+* @brief Usage counters of one file's pages in the buffer pool
+*
+* One instance per file name is kept for the life of the buffer manager, so
+* frames can count into it without a lookup.
+*/
+struct BufFileCounters
+{
+	/**
+   * Requests for a page of the file found in the pool, and not found
+	 */
+  std::atomic<std::uint64_t> hits;
+  std::atomic<std::uint64_t> misses;
+
+	/**
+   * Requests for a page of the file that had to wait for another thread
+   * to finish reading it in
+	 */
+  std::atomic<std::uint64_t> pinwaits;
+
+	/**
+   * Pages of the file read from and written to disk
+	 */
+  std::atomic<std::uint64_t> diskreads;
+  std::atomic<std::uint64_t> diskwrites;
+
+	/**
+   * Pages of the file pushed out of the pool to make room for others
+	 */
+  std::atomic<std::uint64_t> evictions;
+
+	/**
+   * Clear all values
+	 */
+  void clear()
+  {
+		hits = misses = pinwaits = 0;
+		diskreads = diskwrites = evictions = 0;
+  }
+
+  BufFileCounters()
+  {
+		clear();
+  }
+};
+
 /**
 * @brief Class for maintaining information about buffer pool frames
 */
@@ -25,12 +82,25 @@ class BufDesc {
 
 	friend class BufMgr;
 
+ public:
+	/**
+   * Frame number marking the end of a frame list
+	 */
+  static const FrameId NO_FRAME = ~static_cast<FrameId>(0);
+
  private:
 	/**
    * Pointer to file to which corresponding frame is assigned
 	 */
   File* file;
 
+	/**
+   * File::id() of the file object, which keys the frame's page in the hash
+   * table and the file frame lists.  Unlike the pointer it stays meaningful
+   * after the object is gone.
+	 */
+  std::uint64_t fileId;
+
 	/**
    * Page within file to which corresponding frame is assigned
 	 */
@@ -42,14 +112,19 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
+   * Number of times this page has been pinned.  Pins are taken under the
+   * latch of the page's hash partition, so they never need the frame latch.
+   * A PageGuard drops its pin without any latch.
 	 */
-  int pinCnt;
+  std::atomic<int> pinCnt;
 
 	/**
-   * True if page is dirty;  false otherwise
+   * True if page is dirty;  false otherwise.  Set by whoever holds a pin,
+   * before dropping it, and cleared under the latch of the page's hash
+   * partition once the page is unpinned; the background writer peeks at it
+   * without one.
 	 */
-  bool dirty;
+  std::atomic<bool> dirty;
 
 	/**
    * True if page is valid
@@ -57,9 +132,29 @@ class BufDesc {
   bool valid;
 
 	/**
-   * Has this buffer frame been reference recently
+   * True while the page is being read in.  The reading thread holds the
+   * latch meanwhile, so threads that find the page wait on it.
+	 */
+  std::atomic<bool> loading;
+
+	/**
+   * Latch held while the frame is being (re)assigned to a page: during
+   * eviction, while the page is read in, and while it is flushed.
+	 */
+  std::mutex latch;
+
+	/**
+   * Neighbours in the list of frames holding pages of the same file, or
+   * NO_FRAME at either end.  Guarded by BufMgr's fileFramesLatch.
 	 */
-  bool refbit;
+  FrameId fileNext;
+  FrameId filePrev;
+
+	/**
+   * Counters of the file the frame holds a page of.  Set with the frame
+   * list links and left behind when the frame is cleared.
+	 */
+  BufFileCounters* counters;
 
 	/**
    * Initialize buffer frame for a new user
@@ -68,10 +163,11 @@ class BufDesc {
 	{
     pinCnt = 0;
 		file = NULL;
+		fileId = 0;
 		pageNo = Page::INVALID_NUMBER;
     dirty = false;
-    refbit = false;
 		valid = false;
+    loading = false;
   };
 
 	/**
@@ -84,11 +180,12 @@ class BufDesc {
   void Set(File* filePtr, PageId pageNum)
 	{ 
 		file = filePtr;
+		fileId = filePtr->id();
     pageNo = pageNum;
     pinCnt = 1;
     dirty = false;
     valid = true;
-    refbit = true;
+    loading = false;
   }
 
   void Print()
@@ -103,8 +200,7 @@ class BufDesc {
 
 		std::cout << "valid:" << valid << " ";
 		std::cout << "pinCnt:" << pinCnt << " ";
-		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "dirty:" << dirty << "\n";
   }
 
 	/**
@@ -113,6 +209,83 @@ class BufDesc {
   BufDesc()
 	{
   	Clear();
+    fileNext = filePrev = NO_FRAME;
+    counters = NULL;
+  }
+};
+
+
+/**
+* @brief Histogram of I/O latencies, in power of two microsecond buckets
+*
+* Bucket 0 counts latencies under 1us, bucket i those from 2^(i-1) up to
+* 2^i us, and the last bucket everything slower.
+*/
+struct BufLatencyHistogram
+{
+	/**
+   * Number of buckets; the last one starts at about half a second
+	 */
+  static const int NUM_BUCKETS = 21;
+
+	/**
+   * Number of latencies recorded in each bucket
+	 */
+  std::atomic<std::uint64_t> buckets[NUM_BUCKETS];
+
+	/**
+   * Sum of all latencies recorded, in microseconds
+	 */
+  std::atomic<std::uint64_t> totalUsec;
+
+	/**
+   * Record the time elapsed since an I/O started.
+	 *
+	 * @param start	Time the I/O was issued
+	 */
+  void record(const std::chrono::steady_clock::time_point& start)
+  {
+		const std::uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - start).count();
+		int bucket = 0;
+		while (bucket < NUM_BUCKETS - 1 && (static_cast<std::uint64_t>(1) << bucket) <= usec)
+			bucket++;
+		buckets[bucket]++;
+		totalUsec += usec;
+  }
+
+	/**
+   * Upper bound of a bucket in microseconds; none for the last bucket
+	 */
+  static std::uint64_t bucketLimit(const int bucket)
+  {
+		return static_cast<std::uint64_t>(1) << bucket;
+  }
+
+	/**
+   * Number of latencies recorded
+	 */
+  std::uint64_t count() const
+  {
+		std::uint64_t total = 0;
+		for (int i = 0; i < NUM_BUCKETS; i++)
+			total += buckets[i];
+		return total;
+  }
+
+	/**
+   * Clear all values
+	 */
+  void clear()
+  {
+		for (int i = 0; i < NUM_BUCKETS; i++)
+			buckets[i] = 0;
+		totalUsec = 0;
+  }
+
+  BufLatencyHistogram()
+  {
+		clear();
   }
 };
 
@@ -123,19 +296,66 @@ class BufDesc {
 struct BufStats
 {
 	/**
-   * Total number of accesses to buffer pool
+   * Total number of page requests to the buffer pool.  Counted per hash
+   * partition, and only summed in here by BufMgr::getBufStats and
+   * BufMgr::printStats.
+	 */
+  std::atomic<std::uint64_t> accesses;
+
+	/**
+   * Requests satisfied from the pool, including pages another thread was
+   * still reading in, and requests that had to read the page.  Hits are
+   * counted per hash partition like accesses.
+	 */
+  std::atomic<std::uint64_t> hits;
+  std::atomic<std::uint64_t> misses;
+
+	/**
+   * Number of valid pages pushed out of the pool to make room for others
+	 */
+  std::atomic<std::uint64_t> evictions;
+
+	/**
+   * Number of requests that found their page still being read in by
+   * another thread and had to wait for it
 	 */
-  int accesses;
+  std::atomic<std::uint64_t> pinwaits;
 
 	/**
    * Number of pages read from disk (including allocs)
 	 */
-  int diskreads;
+  std::atomic<std::uint64_t> diskreads;
 
 	/**
    * Number of pages written back to disk
 	 */
-  int diskwrites;
+  std::atomic<std::uint64_t> diskwrites;
+
+	/**
+   * Number of dirty victims written back on the foreground read/alloc path
+	 */
+  std::atomic<std::uint64_t> victimwrites;
+
+	/**
+   * Number of pages written back by the background writer
+	 */
+  std::atomic<std::uint64_t> bgwrites;
+
+	/**
+   * Number of rounds the background writer has run
+	 */
+  std::atomic<std::uint64_t> bgrounds;
+
+	/**
+   * Number of pages read into the pool by prefetch() before being asked for
+	 */
+  std::atomic<std::uint64_t> prefetches;
+
+	/**
+   * Latencies of the disk reads and writes counted above
+	 */
+  BufLatencyHistogram readLatency;
+  BufLatencyHistogram writeLatency;
 
 	/**
    * Clear all values 
@@ -143,6 +363,11 @@ struct BufStats
   void clear()
   {
 		accesses = diskreads = diskwrites = 0;
+		hits = misses = evictions = pinwaits = 0;
+		victimwrites = bgwrites = bgrounds = 0;
+		prefetches = 0;
+		readLatency.clear();
+		writeLatency.clear();
   }
       
 	/**
@@ -156,25 +381,383 @@ struct BufStats
 
 
 /**
-* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+* @brief Usage of one file's pages in the buffer pool, as returned by
+* BufMgr::getFileStats
 */
-class BufMgr 
+struct BufFileStats
+{
+  std::uint64_t hits;
+  std::uint64_t misses;
+  std::uint64_t pinwaits;
+  std::uint64_t diskreads;
+  std::uint64_t diskwrites;
+  std::uint64_t evictions;
+};
+
+
+/**
+* @brief Formats BufMgr::printStats can write
+*/
+enum BufStatsFormat {
+    STATS_TEXT, /* One "name{labels} value" line per counter */
+    STATS_JSON /* A single JSON object */
+};
+
+
+/**
+* @brief Tunables of the buffer manager's background writer
+*
+* Every round the writer cleans the dirty, unpinned frames the replacement
+* policy would hand out next, so that allocBuf rarely has to write a victim
+* itself.  How far ahead it cleans follows how fast allocBuf has been taking
+* frames: allocMultiplier times the larger of the frames taken since the last
+* round and a running average of that.  The next round starts once half of
+* those frames are gone, or after delayMs milliseconds if that is sooner.
+* When more than highWater of the pool is dirty the writer also cleans the
+* rest of the pool until no more than lowWater is.
+*
+* The writer is off unless enabled: it only pays for itself when foreground
+* threads would otherwise stall on dirty victims.
+*/
+struct BufWriterConfig
+{
+	/**
+   * Run the background writer at all; off by default
+	 */
+  bool enabled;
+
+	/**
+   * Milliseconds the writer sleeps between rounds
+	 */
+  std::uint32_t delayMs;
+
+	/**
+   * Most pages written per round from the policy's victim candidates
+	 */
+  std::uint32_t maxPagesPerRound;
+
+	/**
+   * Frames cleaned ahead of the policy per round, as a multiple of the
+   * frames allocBuf is expected to take before the next one
+	 */
+  double allocMultiplier;
+
+	/**
+   * Dirty fraction of the pool above which the writer cleans the whole pool
+	 */
+  double highWater;
+
+	/**
+   * Dirty fraction of the pool the writer brings it back down to
+	 */
+  double lowWater;
+
+	/**
+   * Constructor of BufWriterConfig class, with the default settings
+	 */
+  BufWriterConfig()
+    : enabled(false), delayMs(10), maxPagesPerRound(64), allocMultiplier(2.0),
+      highWater(0.5), lowWater(0.25)
+  {
+  }
+};
+
+
+/**
+* @brief Ring of frames that a large sequential read recycles
+*
+* Passing a strategy to BufMgr::readPage makes pages missed under it reuse
+* the strategy's own few frames, round robin, instead of taking victims from
+* the replacement policy.  A scan bigger than the pool then displaces at most
+* a ring's worth of other pages.  A frame only goes back to the ring while it
+* still holds the page the ring put there and nobody has it pinned; otherwise
+* the ring takes a fresh frame from the pool in its place.
+*
+* A strategy belongs to one scan.  Its latch only lets the buffer manager's
+* prefetcher fill the ring alongside the scan.  A slot the prefetcher filled
+* is not recycled until the scan has read its page, and the prefetcher stops
+* once the ring is full of such slots, so read-ahead never outruns the ring.
+*/
+class BufAccessStrategy
+{
+	friend class BufMgr;
+
+ public:
+	/**
+   * Ring size used for bulk reads: 16 frames, 128KB of pages
+	 */
+  static const std::uint32_t BULK_READ_RING_SIZE = 16;
+
+	/**
+   * Constructor of BufAccessStrategy class
+	 *
+	 * @param ringSize	Number of frames to recycle; the buffer manager uses at most a quarter of its pool
+	 */
+  explicit BufAccessStrategy(const std::uint32_t ringSize = BULK_READ_RING_SIZE)
+    : ringSize(ringSize > 0 ? ringSize : 1), current(0), unread(0)
+  {
+    ring = new Slot[this->ringSize];
+    for (std::uint32_t i = 0; i < this->ringSize; i++)
+    {
+      ring[i].used = false;
+      ring[i].readAhead = false;
+    }
+  }
+
+	/**
+   * Destructor of BufAccessStrategy class
+	 */
+  ~BufAccessStrategy()
+  {
+    delete [] ring;
+  }
+
+ private:
+	/**
+   * Frame filled through the ring, and the page it was filled with
+	 */
+  struct Slot
+  {
+    bool used;
+    bool readAhead;
+    FrameId frameNo;
+    std::uint64_t fileId;
+    PageId pageNo;
+  };
+
+  BufAccessStrategy(const BufAccessStrategy&);
+  BufAccessStrategy& operator=(const BufAccessStrategy&);
+
+	/**
+   * Number of slots in the ring
+	 */
+  std::uint32_t ringSize;
+
+	/**
+   * Slot the next miss is placed in
+	 */
+  std::uint32_t current;
+
+	/**
+   * Number of slots filled by the prefetcher whose page the scan has not
+   * read yet (readAhead set)
+	 */
+  std::atomic<std::uint32_t> unread;
+
+	/**
+   * Latch protecting the ring
+	 */
+  std::mutex latch;
+
+	/**
+   * The ring itself
+	 */
+  Slot* ring;
+};
+
+
+/**
+* @brief Pin on a page in the buffer pool, dropped when the guard goes away
+*
+* A guard holds the frame of its page, so releasing it takes neither a hash
+* lookup nor a latch.  Guards can be moved but not copied; a moved-from or
+* released guard holds nothing.  See ReadPageGuard and WritePageGuard.
+*/
+class PageGuard
 {
+	friend class BufMgr;
+
+ public:
+	/**
+   * Constructs a guard holding nothing
+	 */
+  PageGuard() : bufMgr(NULL), frameNo(0), page(NULL), dirty(false) {}
+
+  PageGuard(PageGuard&& other);
+  PageGuard& operator=(PageGuard&& other);
+
+	/**
+   * Unpins the page, if the guard holds one
+	 */
+  ~PageGuard()
+  {
+    release();
+  }
+
+	/**
+   * Unpins the page now, marking it dirty if it was written.
+	 */
+  void release();
+
+	/**
+   * True if the guard holds a page
+	 */
+  bool holdsPage() const
+  {
+    return page != NULL;
+  }
+
+	/**
+   * Page number of the page held
+	 */
+  PageId pageNo() const
+  {
+    return page->page_number();
+  }
+
+ protected:
+  PageGuard(BufMgr* bufMgr, const FrameId frameNo, Page* page)
+    : bufMgr(bufMgr), frameNo(frameNo), page(page), dirty(false) {}
+
+	/**
+   * Buffer manager the page is pinned in, its frame, and the page itself
+	 */
+  BufMgr* bufMgr;
+  FrameId frameNo;
+  Page* page;
+
+	/**
+   * True if the page has to be written back
+	 */
+  bool dirty;
+
  private:
+  PageGuard(const PageGuard&);
+  PageGuard& operator=(const PageGuard&);
+};
+
+
+/**
+* @brief Guard on a page that is only read
+*/
+class ReadPageGuard : public PageGuard
+{
+	friend class BufMgr;
+
+ public:
+  ReadPageGuard() {}
+
 	/**
-   * Current position of clockhand in our buffer pool
+   * The page held
 	 */
-  FrameId clockHand;
+  const Page* get() const
+  {
+    return page;
+  }
+
+  const Page* operator->() const
+  {
+    return page;
+  }
+
+ private:
+  ReadPageGuard(BufMgr* bufMgr, const FrameId frameNo, Page* page)
+    : PageGuard(bufMgr, frameNo, page) {}
+};
+
+
+/**
+* @brief Guard on a page that may be changed
+*
+* The page is written back only if markDirty() has been called.
+*/
+class WritePageGuard : public PageGuard
+{
+	friend class BufMgr;
+
+ public:
+  WritePageGuard() {}
 
+	/**
+   * The page held
+	 */
+  Page* get() const
+  {
+    return page;
+  }
+
+  Page* operator->() const
+  {
+    return page;
+  }
+
+	/**
+   * Note that the page has been changed and must be written back.
+	 */
+  void markDirty()
+  {
+    dirty = true;
+  }
+
+ private:
+  WritePageGuard(BufMgr* bufMgr, const FrameId frameNo, Page* page)
+    : PageGuard(bufMgr, frameNo, page) {}
+};
+
+
+/**
+* @brief One independently latched slice of the buffer pool hash table
+*/
+struct BufHashPartition
+{
+	/**
+   * Latch protecting the table and the pin counts of the pages it maps
+	 */
+  std::mutex latch;
+
+	/**
+   * Hash table mapping (File, page) to frame for the pages of this partition
+	 */
+  BufHashTbl *table;
+
+	/**
+   * This partition's share of BufStats::accesses and BufStats::hits.  Kept
+   * next to the latch, whose cache line a request takes anyway, so threads
+   * counting requests for different partitions do not contend.
+	 */
+  std::atomic<std::uint64_t> accesses;
+  std::atomic<std::uint64_t> hits;
+
+  BufHashPartition()
+    : table(NULL), accesses(0), hits(0)
+  {
+  }
+};
+
+
+/**
+* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* The buffer manager may be shared by several threads.  The hash table is
+* split into partitions, each guarded by its own latch, and every frame has a
+* latch of its own, so threads touching different pages rarely contend.
+* Latches are always taken in the order frame, partition, I/O.  The choice
+* of victim frame is delegated to a ReplacementPolicy.
+*/
+class BufMgr 
+{
+	friend class PageGuard;
+
+ private:
 	/**
    * Number of frames in the buffer pool
 	 */
   std::uint32_t numBufs;
+
+	/**
+   * Size of the memory mapped for bufPool
+	 */
+  std::size_t bufPoolBytes;
+
+	/**
+   * Number of hash table partitions (always a power of two)
+	 */
+  std::uint32_t numPartitions;
 	
 	/**
-   * Hash table mapping (File, page) to frame
+   * Partitioned hash table mapping (File, page) to frame
 	 */
-  BufHashTbl *hashTable;
+  BufHashPartition *hashPartitions;
 
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
@@ -187,31 +770,369 @@ class BufMgr
   BufStats bufStats;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Serialises the calls that change File objects: page writes, allocation
+   * and deletion read and rewrite the file's page lists.  Page reads may run
+   * concurrently with them and each other, so they go without it.
+	 */
+  std::mutex ioLatch;
+
+	/**
+   * Policy choosing the frame to reuse when the pool is full
+	 */
+  ReplacementPolicy *policy;
+
+	/**
+   * Head of the list of frames holding pages of a file, linked through the
+   * frames' BufDesc, and the length of the list
+	 */
+  struct FileFrames
+  {
+    FrameId head;
+    std::uint32_t count;
+    BufFileCounters* counters;
+  };
+
+	/**
+   * Frame list of every file with pages in the pool, so that flushFile only
+   * visits the frames of its file.  The latch guards the map and the links,
+   * and is taken last, after any frame or partition latch.
+	 */
+  std::unordered_map<std::uint64_t, FileFrames> fileFrames;
+  std::mutex fileFramesLatch;
+
+	/**
+   * Usage counters of every file that has had pages in the pool, by file
+   * name.  Entries are never removed, so frames may point into the map.
+   * Guarded by fileFramesLatch.
+	 */
+  std::map<std::string, BufFileCounters> fileCounters;
+
+	/**
+	 * Add a frame just assigned to a page to its file's frame list.
+	 *
+	 * @param frameNo Frame, whose latch the caller holds
+	 */
+  void linkFileFrame(const FrameId frameNo);
+
+	/**
+	 * Remove a frame about to be cleared from its file's frame list.
+	 *
+	 * @param frameNo Frame, whose latch the caller holds
+	 * @param evicted True if the page is being pushed out for another one
+	 */
+  void unlinkFileFrame(const FrameId frameNo, const bool evicted = false);
+
+	/**
+	 * Count a request that found its page in the pool.
+	 *
+	 * @param frameNo Frame holding the page, pinned by the caller
 	 */
-  void advanceClock()
+  void countHit(const FrameId frameNo)
   {
-		clockHand = (clockHand + 1) % numBufs;
+		BufDesc* desc = &bufDescTable[frameNo];
+		partitionFor(desc->fileId, desc->pageNo).hits++;
+		desc->counters->hits++;
   }
 
 	/**
-	 * Allocate a free frame.  
+	 * Sum the partitions' access and hit counts into bufStats.
+	 */
+  void sumPartitionStats();
+
+	/**
+   * Background writer thread, and the settings it runs with
+	 */
+  std::thread writer;
+  BufWriterConfig writerConfig;
+
+	/**
+   * Latch and condition variable the writer sleeps on, and its stop flag
+	 */
+  std::mutex writerLatch;
+  std::condition_variable writerWake;
+  bool writerStop;
+
+	/**
+   * Frames allocBuf has handed out, and the count at which it wakes the
+   * writer for its next round, or 0 if the writer is not waiting on it
+	 */
+  std::atomic<std::uint64_t> framesHandedOut;
+  std::atomic<std::uint64_t> writerWakeAt;
+
+	/**
+   * Frames handed out as of the writer's last round, and its running
+   * average of the frames handed out per round; only the writer uses them
+	 */
+  std::uint64_t writerLastHandedOut;
+  double writerAllocRate;
+
+	/**
+	 * Number of rounds the writer's average of frames handed out spans
+	 */
+  static const std::uint32_t ALLOC_RATE_ROUNDS = 16;
+
+	/**
+	 * Count a frame handed out by allocBuf, waking the writer if it asked to
+	 * be woken by now.
+	 */
+  void noteFrameHandedOut();
+
+	/**
+	 * Body of the background writer thread.
+	 */
+  void backgroundWriter();
+
+	/**
+	 * Run one round of the background writer.
+	 *
+	 * @param config    Settings to run it with
+	 * @param candidates Scratch space for the policy's victim candidates
+	 * @param snapshots Scratch pages for writeBehind
+	 */
+  void writerRound(const BufWriterConfig& config, std::vector<FrameId>& candidates, std::vector<Page>& snapshots);
+
+	/**
+	 * Write back those of the given frames that are dirty and unpinned,
+	 * leaving their pages in the pool.  Each page is copied while it cannot be
+	 * pinned, and the copies are written a batch at a time, all of a file's
+	 * in flight at once.
+	 *
+	 * @param frames   Frames to clean
+	 * @param limit    Most pages to write
+	 * @param snapshots Pages to copy them into; as many are written per batch
+	 * @return  			Number of pages written
+	 */
+  std::uint32_t writeBehind(const std::vector<FrameId>& frames, const std::uint32_t limit, std::vector<Page>& snapshots);
+
+	/**
+	 * Number of pages the background writer copies and writes at a time
+	 */
+  static const std::uint32_t WRITE_BEHIND_BATCH = 32;
+
+	/**
+	 * Stop the background writer thread if it is running.
+	 */
+  void stopWriter();
+
+	/**
+   * Pages prefetchAsync() has been asked to read
+	 */
+  struct PrefetchRequest
+  {
+    File* file;
+    PageId firstPageNo;
+    std::uint32_t count;
+    BufAccessStrategy* strategy;
+  };
+
+	/**
+   * Prefetch thread, started on the first prefetchAsync(), and its queue
+	 */
+  std::thread prefetcher;
+  std::deque<PrefetchRequest> prefetchQueue;
+
+	/**
+   * Latch and condition variables for the prefetch queue; prefetchBusy is
+   * true while a request taken off the queue is being read
+	 */
+  std::mutex prefetchLatch;
+  std::condition_variable prefetchWake;
+  std::condition_variable prefetchIdle;
+  bool prefetchBusy;
+  bool prefetchStop;
+
+	/**
+	 * Read a page that is not in the pool into a new frame.  If another
+	 * thread gets to it first, that thread's frame is used instead.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param strategy Ring to allocate the frame from, or NULL
+	 * @param pin     True to return the page pinned, once it has been read
+	 * @param frameNo Frame holding the page returned via this variable
+	 * @return  			False if another thread was reading the page and failed
+	 */
+  bool loadPage(File* file, const PageId pageNo, BufAccessStrategy* strategy, const bool pin, FrameId& frameNo);
+
+	/**
+	 * First half of loadPage: take a frame for a page that is not in the pool
+	 * and register the page, still unread, in the hash table.  If another
+	 * thread registered it meanwhile, that thread's frame is returned, pinned
+	 * if requested but possibly still being read.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param strategy Ring to allocate the frame from, or NULL
+	 * @param pin     True to pin the page
+	 * @param frameNo Frame holding the page returned via this variable
+	 * @return  			True if the caller must now read the page into the frame,
+	 *                whose latch it holds, and then call endLoad
+	 * @throws BufferExceededException If no frame can be allocated
+	 */
+  bool beginLoad(File* file, const PageId pageNo, BufAccessStrategy* strategy, const bool pin, FrameId& frameNo);
+
+	/**
+	 * Second half of loadPage: publish a page read into a frame by beginLoad,
+	 * or withdraw it if the read failed, and release the frame latch.
+	 *
+	 * @param frameNo Frame the page was read into
+	 * @param pin     Whether beginLoad pinned the page
+	 * @param read    True if the read succeeded
+	 */
+  void endLoad(const FrameId frameNo, const bool pin, const bool read);
+
+	/**
+	 * Wait until a page just pinned has been read in, if it is still being read.
+	 *
+	 * @param frameNo Frame holding the page
+	 * @return  			False, with the pin dropped, if the read failed
+	 */
+  bool waitForLoad(const FrameId frameNo);
+
+	/**
+	 * Like waitForLoad, and count the page as a hit once it is in.
+	 *
+	 * @param frameNo Frame holding the page
+	 * @return  			False, with the pin dropped, if the read failed
+	 */
+  bool waitForHit(const FrameId frameNo);
+
+	/**
+	 * Drop the pins readPages holds on the pages it has handed out so far,
+	 * one per run of the same page.
+	 *
+	 * @param pageNos Page numbers passed to readPages
+	 * @param pages  	Pages handed out, NULL where none has been yet
+	 */
+  void releaseBatchPins(const std::vector<PageId>& pageNos, std::vector<Page*>& pages);
+
+	/**
+	 * Body of the prefetch thread.
+	 */
+  void backgroundPrefetcher();
+
+	/**
+	 * Wait until every queued prefetch has been carried out.
+	 */
+  void drainPrefetches();
+
+	/**
+	 * Stop the prefetch thread if it is running.
+	 */
+  void stopPrefetcher();
+
+	/**
+	 * Drop a pin held by a PageGuard.  The pin keeps the frame on its page,
+	 * so no lookup is needed.
+	 *
+	 * @param frameNo Frame holding the page
+	 * @param dirty		True if the page needs to be marked dirty
+	 */
+  void unPinFrame(const FrameId frameNo, const bool dirty);
+
+	/**
+	 * Returns the hash partition responsible for the given page.
+	 *
+	 * @param fileId 	File::id() of the file object
+	 * @param pageNo  Page number in the file
+	 * @return  			Partition holding the mapping for (fileId, pageNo)
+	 */
+  BufHashPartition& partitionFor(const std::uint64_t fileId, const PageId pageNo)
+  {
+		std::uint64_t key = fileId * 0xC2B2AE3D27D4EB4Full ^ (static_cast<std::uint64_t>(pageNo) * 0x9E3779B1u);
+		key ^= key >> 32;
+		key ^= key >> 16;
+		return hashPartitions[key & (numPartitions - 1)];
+  }
+
+	/**
+	 * Allocate a free frame for the given page.  
+	 * The frame is returned with its latch held; the caller releases it once
+	 * the frame has been assigned to a page.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param file   	File of the page the frame is for
+	 * @param pageNo  Page number of the page the frame is for, or Page::INVALID_NUMBER if not yet known
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
-  void allocBuf(FrameId & frame);
+  void allocBuf(FrameId & frame, const File* file, const PageId pageNo);
+
+	/**
+	 * Allocate a frame for the given page from an access strategy's ring,
+	 * reusing the frame in the ring's current slot if it can and falling back
+	 * to allocBuf otherwise.  The frame is returned with its latch held.
+	 *
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param file   	File of the page the frame is for
+	 * @param pageNo  Page number of the page the frame is for
+	 * @param strategy Ring to allocate from
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocStrategyBuf(FrameId & frame, const File* file, const PageId pageNo, BufAccessStrategy* strategy);
+
+	/**
+	 * Check whether a ring can take another prefetched page, that is whether
+	 * its current slot does not hold one the scan has yet to read.
+	 *
+	 * @param strategy Ring to check
+	 * @return  			True if prefetching through the ring may go on
+	 */
+  bool ringHasRoom(BufAccessStrategy* strategy);
+
+	/**
+	 * Mark the ring slot holding a frame as filled by the prefetcher.
+	 *
+	 * @param strategy Ring the page was read through
+	 * @param frameNo Frame the page was read into
+	 */
+  void markReadAhead(BufAccessStrategy* strategy, const FrameId frameNo);
+
+	/**
+	 * Note that the scan owning a ring has read a page, so that the slot the
+	 * prefetcher put it in may be recycled.
+	 *
+	 * @param strategy Ring of the scan
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  void markRead(BufAccessStrategy* strategy, const File* file, const PageId pageNo);
+
+	/**
+	 * Latch a frame offered by the replacement policy if it can be reused.
+	 *
+	 * @param frameNo Candidate frame
+	 * @return  			True, with the frame latch held, if the frame is free or its page is unpinned
+	 */
+  bool claimFrame(const FrameId frameNo);
+
+	/**
+	 * Detach a valid, unpinned frame from its page, writing it back if dirty.
+	 * The page stays in the hash table until it is safely on disk, so a
+	 * concurrent reader never fetches a stale copy.  The caller must hold the
+	 * frame latch.
+	 *
+	 * @param frameNo Frame to evict
+	 * @return  			False if the page was pinned or dirtied meanwhile and the frame cannot be used
+	 */
+  bool detachFrame(const FrameId frameNo);
 
  public:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Actual buffer pool from which frames are allocated.  Every frame is
+   * aligned to FileIO::ALIGNMENT, so files opened with DIRECT_BACKEND read
+   * and write them without a bounce buffer.
 	 */
   Page* bufPool;
 
 	/**
    * Constructor of BufMgr class
+	 *
+	 * @param bufs   	Number of frames in the buffer pool
+	 * @param policyType  Page replacement policy to use
+	 * @param hugePages  Back the pool with huge pages: reserved ones if the
+	 *                   system has any free, transparent ones otherwise
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, ReplacementPolicyType policyType = CLOCK, bool hugePages = false);
 	
 	/**
    * Destructor of BufMgr class
@@ -226,8 +1147,84 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param strategy Ring to read the page into on a miss, or NULL to take a frame from the replacement policy
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Reads the given page like readPage, for reading only, and returns a
+	 * guard that unpins it.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file to be read
+	 * @param strategy Ring to read the page into on a miss, or NULL to take a frame from the replacement policy
+	 * @return  			Guard holding the page
+	 */
+  ReadPageGuard fetchPageRead(File* file, const PageId pageNo, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Reads the given page like readPage, for reading and writing, and
+	 * returns a guard that unpins it.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file to be read
+	 * @param strategy Ring to read the page into on a miss, or NULL to take a frame from the replacement policy
+	 * @return  			Guard holding the page
+	 */
+  WritePageGuard fetchPageWrite(File* file, const PageId pageNo, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Read pages the caller is about to ask for into the pool, without pinning
+	 * them.  Pages already in the pool are skipped; reading stops quietly at
+	 * the first page that cannot be read or when no frame is free.
+	 *
+	 * @param file   	File object
+	 * @param firstPageNo First page number to read
+	 * @param count   Number of consecutive page numbers to read
+	 * @param strategy Ring to read the pages into, or NULL
+	 */
+  void prefetch(File* file, const PageId firstPageNo, const std::uint32_t count, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Like prefetch(), but queued for a background thread so that the caller
+	 * can go on working on the pages it has.  Until flushFile() has been
+	 * called on the file, it must only be used through the buffer manager,
+	 * and the strategy, if any, must be kept alive.
+	 *
+	 * @param file   	File object
+	 * @param firstPageNo First page number to read
+	 * @param count   Number of consecutive page numbers to read
+	 * @param strategy Ring to read the pages into, or NULL
+	 */
+  void prefetchAsync(File* file, const PageId firstPageNo, const std::uint32_t count, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Reads a batch of pages and returns a pointer to each of them, pinned.
+	 * A page is read only once, and pinned once for each run of consecutive
+	 * entries naming it.  All the lookups are done first, in the order given;
+	 * the pages that were not in the pool are then read in one pass in page
+	 * number order.  If any page cannot be read or no frame is left for it,
+	 * no page of the batch stays pinned.
+	 *
+	 * @param file   	File object
+	 * @param pageNos Page numbers in the file to be read
+	 * @param pages  	Page pointers, in the order of pageNos, returned via this vector
+	 * @param strategy Ring to read the missing pages into, or NULL to take frames from the replacement policy
+	 * @throws BufferExceededException If the pool has fewer unpinned frames than the batch has distinct pages
+	 */
+  void readPages(File* file, const std::vector<PageId>& pageNos, std::vector<Page*>& pages, BufAccessStrategy* strategy = NULL);
+
+	/**
+	 * Unpin a batch of pages read by readPages, once for each run of
+	 * consecutive entries naming a page, as readPages pinned them.
+	 *
+	 * @param file   	File object
+	 * @param pageNos Page numbers, as passed to readPages
+	 * @param dirty		True if the pages need to be marked dirty
+	 * @throws  HashNotFoundException If a page is not in the buffer pool
+	 * @throws  PageNotPinnedException If a page is not pinned; the pages before it have been unpinned
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void unPinPages(File* file, const std::vector<PageId>& pageNos, const bool dirty);
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -246,11 +1243,24 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
 	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 * @param nearPageNo Page to place the new one near on disk, if the file can, or Page::INVALID_NUMBER
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page, const PageId nearPageNo = Page::INVALID_NUMBER); 
+
+	/**
+	 * Allocates a new page like allocPage and returns a guard that unpins it.
+	 * The new page is already marked dirty.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  The number assigned to the page in the file is returned via this reference.
+	 * @param nearPageNo Page to place the new one near on disk, if the file can, or Page::INVALID_NUMBER
+	 * @return  			Guard holding the page
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page); 
+  WritePageGuard allocPageWrite(File* file, PageId& pageNo, const PageId nearPageNo = Page::INVALID_NUMBER);
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Writes out all dirty pages of the file to disk, and then the file
+	 * header, which the file otherwise keeps in memory until it is closed.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
 	 * Otherwise Error returned.
 	 *
@@ -270,25 +1280,63 @@ class BufMgr
   void disposePage(File* file, const PageId PageNo);
 
 	/**
+	 * Delete several pages from file and also from buffer pool where present, letting the file
+	 * give their disk space back at once.  Pages not in the buffer pool are not an error.
+	 *
+	 * @param file   	File object
+	 * @param pageNos Page numbers
+	 */
+  void disposePages(File* file, const std::vector<PageId>& pageNos);
+
+	/**
    * Print member variable values. 
 	 */
   void  printSelf();
 
 	/**
-   * Get buffer pool usage statistics
+   * Get buffer pool usage statistics, with the partitions' access and hit
+   * counts summed in as of this call
 	 */
   BufStats & getBufStats()
   {
+		sumPartitionStats();
 		return bufStats;
   }
 
 	/**
-   * Clear buffer pool usage statistics
+   * Clear buffer pool usage statistics, including those of every file
 	 */
-  void clearBufStats() 
-  {
-		bufStats.clear();
-  }
+  void clearBufStats();
+
+	/**
+	 * Get the usage statistics of each file that has had pages in the pool.
+	 *
+	 * @param stats		Statistics by file name returned via this map
+	 */
+  void getFileStats(std::map<std::string, BufFileStats>& stats);
+
+	/**
+	 * Write the buffer pool usage statistics, global and per file, for
+	 * monitoring.  Only counters are read, so this is cheap enough to be
+	 * sampled periodically while the pool is in use.
+	 *
+	 * @param out			Stream to write to
+	 * @param format	STATS_TEXT for "name{labels} value" lines, STATS_JSON for a JSON object
+	 */
+  void printStats(std::ostream& out, const BufStatsFormat format = STATS_TEXT);
+
+	/**
+   * Get the background writer settings
+	 */
+  BufWriterConfig getWriterConfig();
+
+	/**
+	 * Change the background writer settings, starting or stopping the writer
+	 * thread as needed.
+	 *
+	 * @param config  New settings
+	 */
+  void setWriterConfig(const BufWriterConfig& config);
 };
 
 }
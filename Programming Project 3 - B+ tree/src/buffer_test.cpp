@@ -0,0 +1,293 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "page_iterator.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/page_pinned_exception.h"
+
+#define checkPassFail(a, b)                                               \
+    \
+{                                                                  \
+        if ((a) == (b))                                                   \
+            std::cout << "\nTest passed at line no:" << __LINE__ << "\n"; \
+        else {                                                            \
+            std::cout << "\nTest FAILS at line no:" << __LINE__;          \
+            std::cout << "\nExpected:" << (b);                            \
+            std::cout << "\nActual:" << (a);                              \
+            std::cout << std::endl;                                       \
+            exit(1);                                                      \
+        }                                                                 \
+    \
+}
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+
+const std::string fileName = "bufferTest.db";
+const int numPages = 20;
+const int numFrames = 10;
+
+PageFile* file1;
+BufMgr* bufMgr;
+
+// -----------------------------------------------------------------------------
+// Forward declarations
+// -----------------------------------------------------------------------------
+
+void createFile();
+void deleteFile();
+std::string pageRecord(const PageId pageNo);
+int pinCount(const PageId pageNo);
+bool flushSucceeds();
+void test1();
+void test2();
+void test3();
+void test4();
+void test5();
+
+int main(int argc, char** argv)
+{
+    test1();
+    test2();
+    test3();
+    test4();
+    test5();
+
+    return 0;
+}
+
+void test1()
+{
+    // A run of one page is read once and pinned once
+    std::cout << "--------------------" << std::endl;
+    std::cout << "readPages with a run of one page" << std::endl;
+    createFile();
+    const PageId runNos[] = {3, 3, 3};
+    const std::vector<PageId> pageNos(runNos, runNos + 3);
+    std::vector<Page*> pages;
+    bufMgr->readPages(file1, pageNos, pages);
+
+    checkPassFail(pages.size(), pageNos.size())
+    checkPassFail(pages[0] == pages[1] && pages[1] == pages[2], true)
+    checkPassFail(pages[0]->begin() != pages[0]->end() && *pages[0]->begin() == pageRecord(3), true)
+    checkPassFail(bufMgr->getBufStats().diskreads, 1u)
+    checkPassFail(pinCount(3), 1)
+    deleteFile();
+}
+
+void test2()
+{
+    // A page named again after other pages is pinned once per run, and
+    // unPinPages gives back exactly the pins readPages took
+    std::cout << "--------------------" << std::endl;
+    std::cout << "readPages with non-adjacent repeats" << std::endl;
+    createFile();
+    const PageId repeatNos[] = {3, 5, 3, 7, 5, 5};
+    const std::vector<PageId> pageNos(repeatNos, repeatNos + 6);
+    std::vector<Page*> pages;
+    bufMgr->readPages(file1, pageNos, pages);
+
+    int wrong = 0;
+    for (std::size_t k = 0; k < pageNos.size(); k++) {
+        if (pages[k]->begin() == pages[k]->end() || *pages[k]->begin() != pageRecord(pageNos[k])) {
+            wrong++;
+        }
+    }
+    checkPassFail(wrong, 0)
+    checkPassFail(pages[0] == pages[2] && pages[1] == pages[4] && pages[4] == pages[5], true)
+    checkPassFail(bufMgr->getBufStats().diskreads, 3u)
+
+    // change a page through the batch and give the pins back dirty
+    pages[3]->insertRecord("changed");
+    bufMgr->unPinPages(file1, pageNos, true);
+    checkPassFail(flushSucceeds(), true)
+
+    Page page = file1->readPage(7);
+    int records = 0;
+    for (PageIterator iter = page.begin(); iter != page.end(); ++iter) {
+        records++;
+    }
+    checkPassFail(records, 2)
+
+    // read again, the pins are counted one at a time
+    bufMgr->readPages(file1, pageNos, pages);
+    checkPassFail(pinCount(3), 2)
+    checkPassFail(pinCount(5), 2)
+    checkPassFail(pinCount(7), 1)
+    deleteFile();
+}
+
+void test3()
+{
+    // Pages already in the pool, pinned or not, mix with pages read in
+    std::cout << "--------------------" << std::endl;
+    std::cout << "readPages with hits and misses" << std::endl;
+    createFile();
+    Page* page4;
+    Page* page6;
+    bufMgr->readPage(file1, 4, page4);
+    bufMgr->readPage(file1, 6, page6);
+    bufMgr->unPinPage(file1, 6, false);
+
+    const PageId mixedNos[] = {4, 8, 4, 6, 9, 8};
+    const std::vector<PageId> pageNos(mixedNos, mixedNos + 6);
+    std::vector<Page*> pages;
+    bufMgr->readPages(file1, pageNos, pages);
+    checkPassFail(pages[0] == page4 && pages[2] == page4 && pages[3] == page6, true)
+    checkPassFail(bufMgr->getBufStats().diskreads, 4u)
+
+    bufMgr->unPinPages(file1, pageNos, false);
+    checkPassFail(pinCount(4), 1)
+    checkPassFail(pinCount(6), 0)
+    checkPassFail(pinCount(8), 0)
+    checkPassFail(pinCount(9), 0)
+    bufMgr->unPinPage(file1, 4, false);
+    checkPassFail(flushSucceeds(), true)
+    deleteFile();
+}
+
+void test4()
+{
+    // A page that cannot be read leaves no page of the batch pinned
+    std::cout << "--------------------" << std::endl;
+    std::cout << "readPages with a page that cannot be read" << std::endl;
+    createFile();
+    Page* page;
+    bufMgr->readPage(file1, 2, page);
+    bufMgr->unPinPage(file1, 2, false);
+
+    const PageId badNos[] = {2, 3, 2, numPages + 5, 3};
+    const std::vector<PageId> pageNos(badNos, badNos + 5);
+    std::vector<Page*> pages;
+    bool threw = false;
+    try {
+        bufMgr->readPages(file1, pageNos, pages);
+    }
+    catch (const InvalidPageException& e) {
+        threw = true;
+    }
+    checkPassFail(threw, true)
+    checkPassFail(pinCount(2), 0)
+    checkPassFail(flushSucceeds(), true)
+    deleteFile();
+}
+
+void test5()
+{
+    // More distinct pages than frames is refused, leaving nothing pinned,
+    // while repeats do not count against the pool
+    std::cout << "--------------------" << std::endl;
+    std::cout << "readPages with more pages than frames" << std::endl;
+    createFile();
+    std::vector<PageId> pageNos;
+    for (PageId pageNo = 2; pageNo < 2 + numFrames + 1; pageNo++) {
+        pageNos.push_back(pageNo);
+    }
+    std::vector<Page*> pages;
+    bool threw = false;
+    try {
+        bufMgr->readPages(file1, pageNos, pages);
+    }
+    catch (const BufferExceededException& e) {
+        threw = true;
+    }
+    checkPassFail(threw, true)
+    checkPassFail(flushSucceeds(), true)
+
+    pageNos.pop_back();
+    pageNos.push_back(2);
+    bufMgr->readPages(file1, pageNos, pages);
+    checkPassFail(pinCount(2), 2)
+    bufMgr->unPinPages(file1, pageNos, false);
+    checkPassFail(flushSucceeds(), true)
+    deleteFile();
+}
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+
+void createFile()
+{
+    // A file of numPages pages each holding one record naming it, and a fresh
+    // pool in front of it
+    try {
+        File::remove(fileName);
+    }
+    catch (const FileNotFoundException& e) {
+    }
+
+    file1 = new PageFile(fileName, true);
+    for (int i = 0; i < numPages; i++) {
+        PageId pageNo;
+        Page page = file1->allocatePage(pageNo);
+        page.insertRecord(pageRecord(pageNo));
+        file1->writePage(pageNo, page);
+    }
+    bufMgr = new BufMgr(numFrames);
+}
+
+void deleteFile()
+{
+    delete bufMgr;
+    delete file1;
+    File::remove(fileName);
+}
+
+std::string pageRecord(const PageId pageNo)
+{
+    return "page " + std::to_string(pageNo);
+}
+
+int pinCount(const PageId pageNo)
+{
+    // Counts the pins on a page by taking them back one at a time until the
+    // buffer manager refuses, then puts them back.
+    int pins = 0;
+    while (1) {
+        try {
+            bufMgr->unPinPage(file1, pageNo, false);
+            pins++;
+        }
+        catch (const PageNotPinnedException& e) {
+            break;
+        }
+        catch (const HashNotFoundException& e) {
+            break;
+        }
+    }
+    Page* page;
+    for (int i = 0; i < pins; i++) {
+        bufMgr->readPage(file1, pageNo, page);
+    }
+    return pins;
+}
+
+bool flushSucceeds()
+{
+    try {
+        bufMgr->flushFile(file1);
+    }
+    catch (const PagePinnedException& e) {
+        return false;
+    }
+    return true;
+}
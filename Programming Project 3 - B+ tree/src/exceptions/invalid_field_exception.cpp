@@ -0,0 +1,27 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "invalid_field_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+InvalidFieldException::InvalidFieldException(
+    const PageId page_num, const std::size_t offset, const std::size_t length)
+    : BadgerDbException(""),
+      page_number_(page_num),
+      offset_(offset),
+      length_(length) {
+  std::stringstream ss;
+  ss << "Field of " << length_ << " bytes at offset " << offset_
+     << " is not within one record or column of page " << page_number_ << ".";
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,66 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a field is asked for that is not
+ *        within the records of a page, or not within one of the columns the
+ *        page splits its records into.
+ */
+class InvalidFieldException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an invalid field exception for the given field.
+   *
+   * @param page_num  Number of page the field was asked of.
+   * @param offset    Offset of the field in the record.
+   * @param length    Number of bytes in the field.
+   */
+  InvalidFieldException(const PageId page_num, const std::size_t offset,
+                        const std::size_t length);
+
+  /**
+   * Returns the page number of the page that caused this exception.
+   */
+  PageId page_number() const { return page_number_; }
+
+  /**
+   * Returns the offset in the record of the field that caused this exception.
+   */
+  std::size_t offset() const { return offset_; }
+
+  /**
+   * Returns the length in bytes of the field that caused this exception.
+   */
+  std::size_t length() const { return length_; }
+
+ protected:
+  /**
+   * Page number of the page that caused this exception.
+   */
+  const PageId page_number_;
+
+  /**
+   * Offset of the field that caused this exception.
+   */
+  const std::size_t offset_;
+
+  /**
+   * Length of the field that caused this exception.
+   */
+  const std::size_t length_;
+};
+
+}
@@ -0,0 +1,66 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a record put into a page of
+ *        fixed-length records is not of that length.
+ */
+class InvalidRecordLengthException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an invalid record length exception for the given page.
+   *
+   * @param page_num    Number of page the record was put into.
+   * @param length      Length of the record in bytes.
+   * @param expected    Length of the page's records in bytes.
+   */
+  InvalidRecordLengthException(const PageId page_num,
+                               const std::size_t length,
+                               const std::size_t expected);
+
+  /**
+   * Returns the page number of the page that caused this exception.
+   */
+  PageId page_number() const { return page_number_; }
+
+  /**
+   * Returns the length in bytes of the record that caused this exception.
+   */
+  std::size_t length() const { return length_; }
+
+  /**
+   * Returns the length in bytes of the page's records.
+   */
+  std::size_t expected_length() const { return expected_length_; }
+
+ protected:
+  /**
+   * Page number of the page that caused this exception.
+   */
+  const PageId page_number_;
+
+  /**
+   * Length of the record that caused this exception.
+   */
+  const std::size_t length_;
+
+  /**
+   * Length of the page's records.
+   */
+  const std::size_t expected_length_;
+};
+
+}
@@ -7,24 +7,470 @@
 
 #include "file.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <cstdio>
+#include <cstring>
+#include <exception>
 #include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
+#include "exceptions/invalid_field_exception.h"
 #include "exceptions/invalid_page_exception.h"
+#include "exceptions/invalid_record_length_exception.h"
+#include "exceptions/read_only_file_exception.h"
 #include "file_iterator.h"
+#include "io_engine.h"
 #include "page.h"
 
 namespace badgerdb {
 
+void FileIO::readBatch(FileIORequest* requests, const std::size_t count) {
+  for (std::size_t i = 0; i < count; i++)
+    read(requests[i].buf, requests[i].len, requests[i].pos);
+}
+
+void FileIO::writeBatch(const FileIORequest* requests, const std::size_t count) {
+  for (std::size_t i = 0; i < count; i++) {
+    if (requests[i].head == NULL)
+      write(requests[i].buf, requests[i].len, requests[i].pos);
+    else
+      write(requests[i].head, requests[i].head_len, requests[i].buf,
+            requests[i].len, requests[i].pos);
+  }
+}
+
+/**
+ * @brief FileIO over a std::fstream.  The stream has one position for reads
+ *        and writes alike, so calls take turns.
+ */
+class StreamFileIO : public FileIO {
+ public:
+  StreamFileIO(const std::string& name, const bool create_new)
+  : FileIO(name)
+  {
+    std::ios_base::openmode mode =
+        std::fstream::in | std::fstream::out | std::fstream::binary;
+    if (create_new)
+      mode = mode | std::fstream::trunc;
+    stream_.open(name, mode);
+    if (!stream_)
+      throw FileIOException(name, "open", errno);
+  }
+
+  void read(char* buf, const std::size_t len, const std::streamoff pos) override {
+    std::lock_guard<std::mutex> guard(latch_);
+    stream_.seekg(pos, std::ios::beg);
+    stream_.read(buf, len);
+    const std::streamsize got = stream_.gcount();
+    if (got < static_cast<std::streamsize>(len)) {
+      // past the end of the file; clear the stream's error for the next call
+      stream_.clear();
+      memset(buf + got, '\0', len - got);
+    }
+  }
+
+  void write(const char* buf, const std::size_t len, const std::streamoff pos) override {
+    std::lock_guard<std::mutex> guard(latch_);
+    stream_.seekp(pos, std::ios::beg);
+    stream_.write(buf, len);
+    flushOrThrow();
+  }
+
+  void write(const char* head, const std::size_t head_len,
+             const char* body, const std::size_t body_len,
+             const std::streamoff pos) override {
+    std::lock_guard<std::mutex> guard(latch_);
+    stream_.seekp(pos, std::ios::beg);
+    stream_.write(head, head_len);
+    stream_.write(body, body_len);
+    flushOrThrow();
+  }
+
+ private:
+  void flushOrThrow() {
+    stream_.flush();
+    if (!stream_) {
+      stream_.clear();
+      throw FileIOException(filename_, "write", EIO);
+    }
+  }
+
+  std::fstream stream_;
+  std::mutex latch_;
+};
+
+/**
+ * @brief FileIO over a file descriptor.  pread and pwrite carry their own
+ *        offset, so calls need no latch and reads run concurrently.
+ */
+class PosixFileIO : public FileIO {
+ public:
+  PosixFileIO(const std::string& name, const bool create_new,
+              const int flags = 0)
+  : FileIO(name)
+  {
+    fd_ = ::open(name.c_str(), O_RDWR | flags | (create_new ? O_CREAT | O_TRUNC : 0), 0666);
+    if (fd_ < 0)
+      throw FileIOException(name, "open", errno);
+  }
+
+  ~PosixFileIO() {
+    ::close(fd_);
+  }
+
+  void read(char* buf, const std::size_t len, const std::streamoff pos) override {
+    std::size_t done = 0;
+    while (done < len) {
+      const ssize_t got = ::pread(fd_, buf + done, len - done, pos + done);
+      if (got < 0) {
+        if (errno == EINTR)
+          continue;
+        throw FileIOException(filename_, "read", errno);
+      }
+      if (got == 0) {
+        // past the end of the file
+        memset(buf + done, '\0', len - done);
+        break;
+      }
+      done += got;
+    }
+  }
+
+  void write(const char* buf, const std::size_t len, const std::streamoff pos) override {
+    std::size_t done = 0;
+    while (done < len) {
+      const ssize_t put = ::pwrite(fd_, buf + done, len - done, pos + done);
+      if (put < 0) {
+        if (errno == EINTR)
+          continue;
+        throw FileIOException(filename_, "write", errno);
+      }
+      done += put;
+    }
+  }
+
+  void write(const char* head, const std::size_t head_len,
+             const char* body, const std::size_t body_len,
+             const std::streamoff pos) override {
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>(head);
+    iov[0].iov_len = head_len;
+    iov[1].iov_base = const_cast<char*>(body);
+    iov[1].iov_len = body_len;
+    ssize_t put;
+    do {
+      put = ::pwritev(fd_, iov, 2, pos);
+    } while (put < 0 && errno == EINTR);
+    if (put < 0)
+      throw FileIOException(filename_, "write", errno);
+    finishWrite(head, head_len, body, body_len, pos, put);
+  }
+
+  void readBatch(FileIORequest* requests, const std::size_t count) override {
+    std::vector<std::size_t> done(count);
+    runBatch(requests, count, false /* write */, done);
+    // the end of the file, most likely; read() zero-fills it
+    for (std::size_t i = 0; i < count; i++) {
+      if (done[i] < requests[i].len)
+        read(requests[i].buf + done[i], requests[i].len - done[i], requests[i].pos + done[i]);
+    }
+  }
+
+  void writeBatch(const FileIORequest* requests, const std::size_t count) override {
+    std::vector<std::size_t> done(count);
+    runBatch(requests, count, true /* write */, done);
+    for (std::size_t i = 0; i < count; i++) {
+      const std::size_t head_len = requests[i].head == NULL ? 0 : requests[i].head_len;
+      finishWrite(requests[i].head, head_len, requests[i].buf, requests[i].len,
+                  requests[i].pos, done[i]);
+    }
+  }
+
+  void preallocate(const std::streamoff pos, const std::size_t len) override {
+    int error;
+    do {
+      error = ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, pos, len) == 0 ? 0 : errno;
+    } while (error == EINTR);
+    // a filesystem without fallocate just doesn't get the space up front
+    if (error != 0 && error != EOPNOTSUPP && error != ENOSYS)
+      throw FileIOException(filename_, "preallocate", error);
+  }
+
+  void punchHole(const std::streamoff pos, const std::size_t len) override {
+    int error;
+    do {
+      error = ::fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos, len) == 0 ?
+          0 : errno;
+    } while (error == EINTR);
+    // nor does one without hole punching get the space back
+    if (error != 0 && error != EOPNOTSUPP && error != ENOSYS)
+      throw FileIOException(filename_, "punch a hole in", error);
+  }
+
+ private:
+  /**
+   * Finishes a write of head and body of which only the first done bytes
+   * made it out, a buffer at a time.
+   */
+  void finishWrite(const char* head, const std::size_t head_len,
+                   const char* body, const std::size_t body_len,
+                   const std::streamoff pos, const std::size_t done) {
+    if (done < head_len) {
+      write(head + done, head_len - done, pos + done);
+      write(body, body_len, pos + head_len);
+    }
+    else if (done < head_len + body_len) {
+      write(body + (done - head_len), head_len + body_len - done, pos + done);
+    }
+  }
+
+  /**
+   * Runs a batch through the I/O engine.  Requests for consecutive bytes of
+   * the file, as the pages of a sorted flush or of a scan's read-ahead are,
+   * go as one preadv or pwritev, up to MAX_RUN_BYTES at a time.  Sets done
+   * to the number of bytes moved for each request.
+   */
+  void runBatch(const FileIORequest* requests, const std::size_t count, const bool write,
+                std::vector<std::size_t>& done) {
+    std::vector<struct iovec> iovs(2 * count);
+    std::vector<IORequest> batch;
+    std::vector<std::size_t> firsts;
+    std::size_t used = 0;
+    std::size_t run_len = 0;
+    for (std::size_t i = 0; i < count; i++) {
+      const std::size_t head_len = requests[i].head == NULL ? 0 : requests[i].head_len;
+      const std::size_t len = head_len + requests[i].len;
+      if (batch.empty() || batch.back().pos + static_cast<std::streamoff>(run_len) != requests[i].pos ||
+          batch.back().iovcnt + 2 > IOV_MAX || run_len + len > MAX_RUN_BYTES) {
+        IORequest request;
+        request.fd = fd_;
+        request.write = write;
+        request.iov = &iovs[used];
+        request.iovcnt = 0;
+        request.pos = requests[i].pos;
+        batch.push_back(request);
+        firsts.push_back(i);
+        run_len = 0;
+      }
+      if (head_len > 0) {
+        iovs[used].iov_base = const_cast<char*>(requests[i].head);
+        iovs[used++].iov_len = head_len;
+        batch.back().iovcnt++;
+      }
+      iovs[used].iov_base = requests[i].buf;
+      iovs[used++].iov_len = requests[i].len;
+      batch.back().iovcnt++;
+      run_len += len;
+    }
+    if (batch.empty())
+      return;
+    IOEngine::get()->run(&batch[0], batch.size());
+
+    // share each run's bytes out among its requests, in order
+    firsts.push_back(count);
+    for (std::size_t r = 0; r < batch.size(); r++) {
+      if (batch[r].result < 0)
+        throw FileIOException(filename_, write ? "write" : "read", -batch[r].result);
+      std::size_t moved = batch[r].result;
+      for (std::size_t i = firsts[r]; i < firsts[r + 1]; i++) {
+        const std::size_t len = requests[i].len + (requests[i].head == NULL ? 0 : requests[i].head_len);
+        done[i] = std::min(moved, len);
+        moved -= done[i];
+      }
+    }
+  }
+
+  /**
+   * Most bytes joined into one vectored request, so that a long run still
+   * leaves the engine several requests to keep in flight.
+   */
+  static const std::size_t MAX_RUN_BYTES = 1 << 20;
+
+  int fd_;
+};
+
+/**
+ * @brief PosixFileIO with O_DIRECT.  Aligned requests go straight between the
+ *        caller's memory and the device; the rest are widened to whole blocks
+ *        in a bounce buffer.
+ */
+class DirectFileIO : public PosixFileIO {
+ public:
+  DirectFileIO(const std::string& name, const bool create_new)
+  : PosixFileIO(name, create_new, O_DIRECT)
+  {
+  }
+
+  void read(char* buf, const std::size_t len, const std::streamoff pos) override {
+    if (aligned(buf, len, pos)) {
+      PosixFileIO::read(buf, len, pos);
+      return;
+    }
+    const std::streamoff start = blockStart(pos);
+    const std::size_t span = blockEnd(pos + len) - start;
+    char* bounce = allocBounce(span);
+    try {
+      PosixFileIO::read(bounce, span, start);
+    }
+    catch (...) {
+      free(bounce);
+      throw;
+    }
+    memcpy(buf, bounce + (pos - start), len);
+    free(bounce);
+  }
+
+  void write(const char* buf, const std::size_t len, const std::streamoff pos) override {
+    if (aligned(buf, len, pos)) {
+      PosixFileIO::write(buf, len, pos);
+      return;
+    }
+    // Read, patch and write back the blocks around it.  Only the file header
+    // and the header of a page are written this way, and those are written
+    // under the buffer manager's ioLatch, but take turns here all the same.
+    std::lock_guard<std::mutex> guard(patchLatch_);
+    const std::streamoff start = blockStart(pos);
+    const std::size_t span = blockEnd(pos + len) - start;
+    char* bounce = allocBounce(span);
+    try {
+      if (start != pos || span != len)
+        PosixFileIO::read(bounce, span, start);
+      memcpy(bounce + (pos - start), buf, len);
+      PosixFileIO::write(bounce, span, start);
+    }
+    catch (...) {
+      free(bounce);
+      throw;
+    }
+    free(bounce);
+  }
+
+  void write(const char* head, const std::size_t head_len,
+             const char* body, const std::size_t body_len,
+             const std::streamoff pos) override {
+    if (head + head_len == body) {
+      write(head, head_len + body_len, pos);
+      return;
+    }
+    char* joined = allocBounce(head_len + body_len);
+    memcpy(joined, head, head_len);
+    memcpy(joined + head_len, body, body_len);
+    try {
+      write(joined, head_len + body_len, pos);
+    }
+    catch (...) {
+      free(joined);
+      throw;
+    }
+    free(joined);
+  }
+
+  void readBatch(FileIORequest* requests, const std::size_t count) override {
+    // Aligned pages go to the device as they are, the rest widened to whole
+    // blocks in bounce buffers, like the page headers a flush reads first,
+    // and all of them together.
+    std::vector<FileIORequest> direct(requests, requests + count);
+    std::vector<char*> bounces(count, static_cast<char*>(NULL));
+    try {
+      for (std::size_t i = 0; i < count; i++) {
+        if (aligned(requests[i].buf, requests[i].len, requests[i].pos))
+          continue;
+        const std::streamoff start = blockStart(requests[i].pos);
+        const std::size_t span = blockEnd(requests[i].pos + requests[i].len) - start;
+        bounces[i] = allocBounce(span);
+        const FileIORequest widened = {bounces[i], span, start, NULL, 0};
+        direct[i] = widened;
+      }
+      if (count > 0)
+        PosixFileIO::readBatch(&direct[0], count);
+      for (std::size_t i = 0; i < count; i++) {
+        if (bounces[i] != NULL)
+          memcpy(requests[i].buf, bounces[i] + (requests[i].pos - direct[i].pos), requests[i].len);
+      }
+    }
+    catch (...) {
+      for (std::size_t i = 0; i < count; i++)
+        free(bounces[i]);
+      throw;
+    }
+    for (std::size_t i = 0; i < count; i++)
+      free(bounces[i]);
+  }
+
+  void writeBatch(const FileIORequest* requests, const std::size_t count) override {
+    std::vector<FileIORequest> direct;
+    direct.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+      if (requests[i].head == NULL &&
+          aligned(requests[i].buf, requests[i].len, requests[i].pos))
+        direct.push_back(requests[i]);
+      else if (requests[i].head == NULL)
+        write(requests[i].buf, requests[i].len, requests[i].pos);
+      else
+        write(requests[i].head, requests[i].head_len, requests[i].buf,
+              requests[i].len, requests[i].pos);
+    }
+    if (!direct.empty())
+      PosixFileIO::writeBatch(&direct[0], direct.size());
+  }
+
+ private:
+  static bool aligned(const char* buf, const std::size_t len, const std::streamoff pos) {
+    return reinterpret_cast<std::uintptr_t>(buf) % ALIGNMENT == 0 &&
+        len % ALIGNMENT == 0 && pos % ALIGNMENT == 0;
+  }
+
+  static std::streamoff blockStart(const std::streamoff pos) {
+    return pos - pos % ALIGNMENT;
+  }
+
+  static std::streamoff blockEnd(const std::streamoff pos) {
+    return blockStart(pos + ALIGNMENT - 1);
+  }
+
+  char* allocBounce(const std::size_t len) {
+    void* bounce;
+    const int error = posix_memalign(&bounce, ALIGNMENT, blockEnd(len));
+    if (error != 0)
+      throw FileIOException(filename_, "allocate a buffer for", error);
+    return static_cast<char*>(bounce);
+  }
+
+  std::mutex patchLatch_;
+};
+
+FileIO* FileIO::open(const std::string& name, const FileBackendType backend,
+                     const bool create_new) {
+  if (backend == STREAM_BACKEND)
+    return new StreamFileIO(name, create_new);
+  if (backend == DIRECT_BACKEND)
+    return new DirectFileIO(name, create_new);
+  return new PosixFileIO(name, create_new);
+}
+
 File::StreamMap File::open_streams_;
 File::CountMap File::open_counts_;
+FileBackendType File::backend_ = POSIX_BACKEND;
+PageId File::extent_pages_ = File::DEFAULT_EXTENT_PAGES;
+std::atomic<std::uint64_t> File::last_id_(0);
 
 void File::remove(const std::string& filename) {
 	std::cout << "HELLO BEFORE \n\n\n\n\n" << std::endl;
@@ -56,9 +502,33 @@ bool File::exists(const std::string& filename) {
 }
 
 File::~File() {
-  close();
+  try {
+    close();
+  } catch (...) {
+    // A destructor has nowhere to report a failed header write.
+  }
+}
+
+
+void File::readPages(const PageId first_page_number, const PageId count, Page* pages) const {
+  std::vector<PageId> page_numbers(count);
+  std::vector<Page*> targets(count);
+  for (PageId i = 0; i < count; i++) {
+    page_numbers[i] = first_page_number + i;
+    targets[i] = &pages[i];
+  }
+  readPagesInto(page_numbers, targets);
 }
 
+void File::writePages(const PageId first_page_number, const PageId count, const Page* pages) {
+  std::vector<PageId> page_numbers(count);
+  std::vector<const Page*> sources(count);
+  for (PageId i = 0; i < count; i++) {
+    page_numbers[i] = first_page_number + i;
+    sources[i] = &pages[i];
+  }
+  writePages(page_numbers, sources);
+}
 
 PageId File::getFirstPageNo() {
   const FileHeader& header = readHeader();
@@ -71,62 +541,192 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* last_used_page */, 0 /* num_free_pages */,
+                         0 /* first_free_page */, 0 /* record_length */,
+                         0 /* num_columns */, {} /* column_lengths */};
     writeHeader(header);
   }
 }
 
 void File::openIfNeeded(const bool create_new) {
+  id_ = ++last_id_;
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    open_file_ = open_streams_[filename_];
+    stream_ = open_file_->stream;
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
       if (already_exists) {
         throw FileExistsException(filename_);
       }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    // New files are truncated on open.
+    std::shared_ptr<OpenFile> open_file(new OpenFile());
+    open_file->stream.reset(FileIO::open(filename_, backend_, create_new));
+    // A new file gets its header from the constructor; an existing one's is
+    // read once, here, and kept in memory from now on.
+    if (!create_new) {
+      open_file->stream->read(reinterpret_cast<char*>(&open_file->header),
+                              sizeof(FileHeader), 0 /* pos */);
+    }
+    open_file->header_dirty = false;
+    open_file->extent_pages = extent_pages_;
+    open_file->preallocated_end = 0;
+    open_file->default_extent = NO_EXTENT;
+    open_file->free_map_loaded = false;
+    open_file_ = open_file;
+    stream_ = open_file_->stream;
+    open_streams_[filename_] = open_file_;
     open_counts_[filename_] = 1;
   }
 }
 
 void File::close() {
+  // The last File object open on the file writes its header back.  The file
+  // is closed even if that fails.
+  std::exception_ptr failure;
+  if (open_file_ && open_counts_[filename_] == 1) {
+    try {
+      flushHeader();
+    } catch (...) {
+      failure = std::current_exception();
+    }
+  }
+
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
   stream_.reset();
+  open_file_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
     open_streams_.erase(filename_);
     open_counts_.erase(filename_);
   }
+
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
-  return header;
+  std::lock_guard<std::mutex> guard(open_file_->header_latch);
+  return open_file_->header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  std::lock_guard<std::mutex> guard(open_file_->header_latch);
+  open_file_->header = header;
+  open_file_->header_dirty = true;
+}
+
+void File::preallocateExtent(const PageId page_number) {
+  if (page_number < open_file_->preallocated_end) {
+    return;
+  }
+  const PageId extent_pages = open_file_->extent_pages;
+  const PageId end = (page_number / extent_pages + 1) * extent_pages;
+  stream_->preallocate(pagePosition(page_number),
+                       static_cast<std::size_t>(end - page_number) * Page::SIZE);
+  open_file_->preallocated_end = end;
+}
+
+void File::loadFreeMap() {
+  if (open_file_->free_map_loaded) {
+    return;
+  }
+  const PageId chunks = (readHeader().num_pages + FREE_MAP_CHUNK_PAGES - 1) / FREE_MAP_CHUNK_PAGES;
+  std::vector<std::uint64_t>& free_map = open_file_->free_map;
+  free_map.assign(chunks * FREE_MAP_WORDS, 0);
+  open_file_->free_map_dirty.assign(chunks, false);
+  // Free map pages never written, like the tail of the header page of a file
+  // from before free maps, read as zeros: no free pages.
+  std::vector<char> chunk(Page::SIZE);
+  for (PageId c = 0; c < chunks; c++) {
+    stream_->read(&chunk[0], Page::SIZE, pagePosition(c * FREE_MAP_CHUNK_PAGES));
+    memcpy(&free_map[c * FREE_MAP_WORDS], &chunk[FREE_MAP_OFFSET],
+           FREE_MAP_WORDS * sizeof(std::uint64_t));
+  }
+  open_file_->free_map_loaded = true;
+}
+
+bool File::isPageFree(const PageId page_number) const {
+  const std::vector<std::uint64_t>& free_map = open_file_->free_map;
+  const PageId word = page_number / 64;
+  return word < free_map.size() && (free_map[word] >> (page_number % 64) & 1) != 0;
+}
+
+void File::setPageFree(const PageId page_number, const bool free) {
+  std::vector<std::uint64_t>& free_map = open_file_->free_map;
+  const PageId chunk = page_number / FREE_MAP_CHUNK_PAGES;
+  if (chunk >= open_file_->free_map_dirty.size()) {
+    free_map.resize((chunk + 1) * FREE_MAP_WORDS, 0);
+    open_file_->free_map_dirty.resize(chunk + 1, false);
+  }
+  const std::uint64_t bit = static_cast<std::uint64_t>(1) << (page_number % 64);
+  if (free) {
+    free_map[page_number / 64] |= bit;
+  } else {
+    free_map[page_number / 64] &= ~bit;
+  }
+  open_file_->free_map_dirty[chunk] = true;
+}
+
+PageId File::findFreePage(const PageId begin, PageId end) const {
+  const std::vector<std::uint64_t>& free_map = open_file_->free_map;
+  end = std::min<PageId>(end, free_map.size() * 64);
+  for (PageId page_number = begin; page_number < end; ) {
+    // the bits from page_number to the end of its word
+    const std::uint64_t bits = free_map[page_number / 64] >> (page_number % 64);
+    if (bits != 0) {
+      const PageId found = page_number + __builtin_ctzll(bits);
+      return found < end ? found : Page::INVALID_NUMBER;
+    }
+    page_number = (page_number / 64 + 1) * 64;
+  }
+  return Page::INVALID_NUMBER;
+}
+
+void File::flushHeader() const {
+  std::lock_guard<std::mutex> guard(open_file_->header_latch);
+  if (!open_file_->free_map_loaded) {
+    if (open_file_->header_dirty) {
+      stream_->write(reinterpret_cast<const char*>(&open_file_->header), sizeof(FileHeader),
+                     0 /* pos */);
+      open_file_->header_dirty = false;
+    }
+    return;
+  }
+
+  // The header shares its page with the first free map page, so the two go
+  // out together.
+  std::vector<bool>& dirty = open_file_->free_map_dirty;
+  if (open_file_->header_dirty && !dirty.empty()) {
+    dirty[0] = true;
+  }
+  std::vector<char> chunk(Page::SIZE);
+  for (PageId c = 0; c < dirty.size(); c++) {
+    if (!dirty[c]) {
+      continue;
+    }
+    memset(&chunk[0], 0, FREE_MAP_OFFSET);
+    if (c == 0) {
+      memcpy(&chunk[0], &open_file_->header, sizeof(FileHeader));
+    }
+    memcpy(&chunk[FREE_MAP_OFFSET], &open_file_->free_map[c * FREE_MAP_WORDS],
+           FREE_MAP_WORDS * sizeof(std::uint64_t));
+    stream_->write(&chunk[0], Page::SIZE, pagePosition(c * FREE_MAP_CHUNK_PAGES));
+    dirty[c] = false;
+  }
+  open_file_->header_dirty = false;
 }
 
 
@@ -137,13 +737,61 @@ PageFile PageFile::create(const std::string& filename) {
   return PageFile(filename, true /* create_new */);
 }
 
+PageFile PageFile::create(const std::string& filename,
+                           const std::uint16_t record_length) {
+  // Checked before the file is made, so that no file is left behind whose
+  // pages cannot hold a single record.
+  if (record_length == 0 || record_length > Page::DATA_SIZE) {
+    throw InvalidRecordLengthException(Page::INVALID_NUMBER, record_length,
+                                       Page::DATA_SIZE);
+  }
+  return PageFile(filename, true /* create_new */, record_length);
+}
+
+PageFile PageFile::create(const std::string& filename,
+                           const std::vector<std::uint16_t>& column_lengths) {
+  std::size_t record_length = 0;
+  for (std::size_t i = 0; i < column_lengths.size(); i++) {
+    if (i == Page::MAX_COLUMNS || column_lengths[i] == 0) {
+      throw InvalidFieldException(Page::INVALID_NUMBER, record_length,
+                                  column_lengths[i]);
+    }
+    record_length += column_lengths[i];
+  }
+  if (record_length == 0) {
+    throw InvalidFieldException(Page::INVALID_NUMBER, 0, 0);
+  }
+  // The total is checked as laid out, with each minipage padded to 8 bytes,
+  // before the file is made, and before it is narrowed to the header's
+  // 16 bits.
+  if (record_length > Page::DATA_SIZE ||
+      Page::capacity(record_length, column_lengths.data(),
+                     column_lengths.size()) == 0) {
+    throw InvalidRecordLengthException(Page::INVALID_NUMBER, record_length,
+                                       Page::DATA_SIZE);
+  }
+
+  PageFile file(filename, true /* create_new */, record_length);
+  FileHeader header = file.readHeader();
+  header.num_columns = column_lengths.size();
+  std::copy(column_lengths.begin(), column_lengths.end(), header.column_lengths);
+  file.writeHeader(header);
+  return file;
+}
+
 PageFile PageFile::open(const std::string& filename) {
   return PageFile(filename, false /* create_new */);
 }
 
-PageFile::PageFile(const std::string& name, const bool create_new)
+PageFile::PageFile(const std::string& name, const bool create_new,
+                   const std::uint16_t record_length)
 : File(name, create_new)
 {
+  if (create_new && record_length > 0) {
+    FileHeader header = readHeader();
+    header.record_length = record_length;
+    writeHeader(header);
+  }
 }
 
 PageFile::~PageFile() {
@@ -164,98 +812,96 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
+  allocatePageInto(new_page_number, new_page);
+  return new_page;
+}
+
+void PageFile::allocatePageInto(PageId &new_page_number, Page& new_page) {
+  FileHeader header = readHeader();
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
-    header.first_free_page = new_page.next_page_number();
+    // Free pages were cleared when they were deleted, so only the free list
+    // pointer needs reading.
+    new_page_number = header.first_free_page;
+    header.first_free_page = readPageHeader(new_page_number).next_page_number;
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   }
 	else
 	{
-    new_page.set_page_number(header.num_pages);
-		new_page_number = new_page.page_number();
-
-    if (header.first_used_page == Page::INVALID_NUMBER)
-		{
-      header.first_used_page = new_page.page_number();
-    }
-		else
-		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
-    }
+    new_page_number = header.num_pages;
+    preallocateExtent(new_page_number);
     ++header.num_pages;
   }
-  writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
+  new_page.initialize(header.record_length, header.column_lengths,
+                      header.num_columns);
+  new_page.set_page_number(new_page_number);
+
+  // Link the new page in at the tail of the used list.
+  new_page.set_prev_page_number(header.last_used_page);
+  if (header.last_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = new_page_number;
+  } else {
+    PageHeader tail = readPageHeader(header.last_used_page);
+    tail.next_page_number = new_page_number;
+    writePageHeader(header.last_used_page, tail);
   }
-  writeHeader(header);
+  header.last_used_page = new_page_number;
 
-  return new_page;
+  writePage(new_page_number, new_page.header_, new_page);
+  writeHeader(header);
 }
 
 Page PageFile::readPage(const PageId page_number) const {
+  Page page;
+  readPageInto(page_number, page);
+  return page;
+}
+
+void PageFile::readPageInto(const PageId page_number, Page& page) const {
   FileHeader header = readHeader();
 
 	if (page_number >= header.num_pages)
 	{
 		throw InvalidPageException(page_number, filename_);
 	}
-	return readPage(page_number, false /* allow_free */);
+	readPageInto(page_number, page, false /* allow_free */);
 }
 
-Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
+void PageFile::readPagesInto(const std::vector<PageId>& page_numbers,
+                             const std::vector<Page*>& pages) const {
+  FileHeader header = readHeader();
+
+  std::vector<FileIORequest> requests(page_numbers.size());
+  for (std::size_t i = 0; i < page_numbers.size(); i++) {
+    if (page_numbers[i] >= header.num_pages) {
+      throw InvalidPageException(page_numbers[i], filename_);
+    }
+    const FileIORequest request = {reinterpret_cast<char*>(pages[i]), Page::SIZE,
+                                   pagePosition(page_numbers[i]), NULL, 0};
+    requests[i] = request;
+  }
+  if (requests.empty()) {
+    return;
+  }
+  stream_->readBatch(&requests[0], requests.size());
+
+  for (std::size_t i = 0; i < page_numbers.size(); i++) {
+    if (!pages[i]->isUsed()) {
+      throw InvalidPageException(page_numbers[i], filename_);
+    }
+  }
+}
+
+void PageFile::readPageInto(const PageId page_number, Page& page,
+                            const bool allow_free) const {
+  // One read of the whole page, straight into the caller's memory.
+  stream_->read(reinterpret_cast<char*>(&page), Page::SIZE, pagePosition(page_number));
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
@@ -265,43 +911,96 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 		// Page has been deleted since it was read.
 		throw InvalidPageException(new_page_number, filename_);
 	}
-	// Page on disk may have had its next page pointer updated since it was read;
-	// we don't modify that, but we do keep all the other modifications to the
-	// page header.
+	// Page on disk may have had its next and previous page pointers updated
+	// since it was read; we don't modify those, but we do keep all the other
+	// modifications to the page header.
 	const PageId next_page_number = header.next_page_number;
+	const PageId prev_page_number = header.prev_page_number;
 	header = new_page.header_;
 	header.next_page_number = next_page_number;
+	header.prev_page_number = prev_page_number;
 	writePage(new_page_number, header, new_page);
 }
 
+void PageFile::writePages(const std::vector<PageId>& page_numbers,
+                          const std::vector<const Page*>& pages) {
+  if (page_numbers.empty()) {
+    return;
+  }
+
+  // As in writePage(), each page keeps the list pointers it has on disk; read
+  // all their headers first.
+  std::vector<PageHeader> headers(page_numbers.size());
+  std::vector<FileIORequest> requests(page_numbers.size());
+  for (std::size_t i = 0; i < page_numbers.size(); i++) {
+    const FileIORequest request = {reinterpret_cast<char*>(&headers[i]), sizeof(PageHeader),
+                                   pagePosition(page_numbers[i]), NULL, 0};
+    requests[i] = request;
+  }
+  stream_->readBatch(&requests[0], requests.size());
+
+  for (std::size_t i = 0; i < page_numbers.size(); i++) {
+    if (headers[i].current_page_number == Page::INVALID_NUMBER) {
+      // Page has been deleted since it was read.
+      throw InvalidPageException(page_numbers[i], filename_);
+    }
+    const PageId next_page_number = headers[i].next_page_number;
+    const PageId prev_page_number = headers[i].prev_page_number;
+    headers[i] = pages[i]->header_;
+    headers[i].next_page_number = next_page_number;
+    headers[i].prev_page_number = prev_page_number;
+
+    char* page = const_cast<char*>(reinterpret_cast<const char*>(pages[i]));
+    if (headers[i].next_page_number == pages[i]->header_.next_page_number &&
+        headers[i].prev_page_number == pages[i]->header_.prev_page_number) {
+      const FileIORequest request = {page, Page::SIZE, pagePosition(page_numbers[i]), NULL, 0};
+      requests[i] = request;
+    } else {
+      const FileIORequest request = {page + sizeof(PageHeader), Page::DATA_SIZE,
+                                     pagePosition(page_numbers[i]),
+                                     reinterpret_cast<const char*>(&headers[i]),
+                                     sizeof(PageHeader)};
+      requests[i] = request;
+    }
+  }
+  stream_->writeBatch(&requests[0], requests.size());
+}
+
 void PageFile::deletePage(const PageId page_number) {
   FileHeader header = readHeader();
+  if (page_number >= header.num_pages) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  const PageHeader existing_header = readPageHeader(page_number);
+  if (existing_header.current_page_number == Page::INVALID_NUMBER) {
+    throw InvalidPageException(page_number, filename_);
+  }
 
-  Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+  // Unlink the page from the used list, pointing its neighbours (or the file
+  // header, at either end of the list) past it.
+  const PageId next_page_number = existing_header.next_page_number;
+  const PageId prev_page_number = existing_header.prev_page_number;
+  if (prev_page_number == Page::INVALID_NUMBER) {
+    header.first_used_page = next_page_number;
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    PageHeader prev_header = readPageHeader(prev_page_number);
+    prev_header.next_page_number = next_page_number;
+    writePageHeader(prev_page_number, prev_header);
+  }
+  if (next_page_number == Page::INVALID_NUMBER) {
+    header.last_used_page = prev_page_number;
+  } else {
+    PageHeader next_header = readPageHeader(next_page_number);
+    next_header.prev_page_number = prev_page_number;
+    writePageHeader(next_page_number, next_header);
   }
+
   // Clear the page and add it to the head of the free list.
-  existing_page.initialize();
-  existing_page.set_next_page_number(header.first_free_page);
+  Page cleared_page;
+  cleared_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
-  }
-  writePage(page_number, existing_page.header_, existing_page);
+  writePage(page_number, cleared_page.header_, cleared_page);
   writeHeader(header);
 }
 
@@ -316,19 +1015,28 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  // Usually the header is the page's own, and the page can go out as it lies
+  // in memory.
+  if (memcmp(&header, &new_page.header_, sizeof(PageHeader)) == 0) {
+    stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE,
+                   pagePosition(page_number));
+    return;
+  }
+  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader),
+                 &new_page.data_[0], Page::DATA_SIZE, pagePosition(page_number));
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader), pagePosition(page_number));
   return header;
 }
 
+void PageFile::writePageHeader(const PageId page_number, const PageHeader& header) {
+  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader),
+                 pagePosition(page_number));
+}
+
 
 
 
@@ -342,6 +1050,7 @@ BlobFile BlobFile::open(const std::string& filename) {
 
 BlobFile::BlobFile(const std::string& name, const bool create_new)
 : File(name, create_new) {
+  loadFreeMap();
 }
 
 BlobFile::~BlobFile() {
@@ -350,6 +1059,7 @@ BlobFile::~BlobFile() {
 BlobFile::BlobFile(const BlobFile& other)
 : File(other.filename_, false /* create_new */)
 {
+  loadFreeMap();
 }
 
 BlobFile& BlobFile::operator=(const BlobFile& rhs) {
@@ -358,43 +1068,377 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
   openIfNeeded(false /* create_new */);
+  loadFreeMap();
   return *this;
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
 	Page new_page;
+	allocatePageInto(new_page_number, new_page);
+	return new_page;
+}
 
-	new_page_number = header.num_pages;
+void BlobFile::allocatePageInto(PageId &new_page_number, Page& new_page) {
+  allocatePageNear(new_page_number, new_page, Page::INVALID_NUMBER);
+}
+
+void BlobFile::allocatePageNear(PageId &new_page_number, Page& new_page,
+                                const PageId near_page_number) {
+  FileHeader header = readHeader();
+  std::map<PageId, Extent>& extents = open_file_->extents;
+  const PageId extent_pages = open_file_->extent_pages;
+  // single page extents leave no room to place a page near another
+  const bool placed = extent_pages > 1;
+  const bool hinted = placed && near_page_number != Page::INVALID_NUMBER &&
+                      near_page_number < header.num_pages;
+
+  // A hinted page goes in the hinted page's extent, or else in the extent
+  // that takes that one's overflow.  Each extent has its own overflow
+  // extent, so that pages split off from different parts of the file stay
+  // apart.  Pages without a hint go to the default extent.
+  const PageId home = hinted ? near_page_number / extent_pages : open_file_->default_extent;
+  PageId candidates[2] = {home, NO_EXTENT};
+  std::map<PageId, Extent>::iterator it = extents.find(home);
+  if (hinted && it != extents.end()) {
+    candidates[1] = it->second.overflow;
+  }
+  PageId extent = NO_EXTENT;
+  new_page_number = Page::INVALID_NUMBER;
+  for (int c = 0; c < 2 && new_page_number == Page::INVALID_NUMBER; c++) {
+    if (candidates[c] != NO_EXTENT) {
+      extent = candidates[c];
+      new_page_number = takeFromExtent(extent, header);
+    }
+  }
+
+  // Then the lowest free page anywhere, so that deleted pages, and those
+  // reserved but left over when the file was last closed, are used before
+  // the file grows.
+  if (new_page_number == Page::INVALID_NUMBER) {
+    new_page_number = takeFreePage(header);
+    extent = new_page_number / extent_pages;
+  }
+
+  // Otherwise open a new extent at the end of the file, reserving the rest
+  // of it.  Its pages are marked free right away, so that the free map on
+  // disk never leaves them unaccounted for.
+  while (new_page_number == Page::INVALID_NUMBER) {
+    const PageId first = header.num_pages;
+    extent = first / extent_pages;
+    const PageId end = (extent + 1) * extent_pages;
+    preallocateExtent(first);
+    header.num_pages = end;
+    if (!placed) {
+      // the first page of each stretch of FREE_MAP_CHUNK_PAGES holds the
+      // free map
+      if (first % FREE_MAP_CHUNK_PAGES != 0) {
+        new_page_number = first;
+      }
+      continue;
+    }
+    for (PageId page_number = first; page_number < end; page_number++) {
+      if (page_number % FREE_MAP_CHUNK_PAGES != 0) {
+        setPageFree(page_number, true);
+        header.num_free_pages++;
+      }
+    }
+    const Extent opened = {first, NO_EXTENT};
+    extents[extent] = opened;
+    new_page_number = takeFromExtent(extent, header);
+  }
+
+  if (placed && extent != home) {
+    if (!hinted) {
+      open_file_->default_extent = extent;
+    } else {
+      // An extent filled before the file was opened has no entry yet.
+      it = extents.find(home);
+      if (it == extents.end()) {
+        const Extent full = {(home + 1) * extent_pages, extent};
+        extents[home] = full;
+      } else {
+        it->second.overflow = extent;
+      }
+    }
+  }
 
 	if (header.first_used_page == Page::INVALID_NUMBER) {
-		header.first_used_page = header.num_pages;
+		header.first_used_page = new_page_number;
 	}
+	header.last_used_page = new_page_number;
 
-	++header.num_pages;
-
+	new_page.initialize();
 	writePage(new_page_number, new_page);
 	writeHeader(header);
+}
 
-	return new_page;
+PageId BlobFile::takeFromExtent(const PageId extent, FileHeader& header) {
+  if (header.num_free_pages == 0) {
+    return Page::INVALID_NUMBER;
+  }
+  const PageId extent_pages = open_file_->extent_pages;
+  const PageId page_number = findFreePage(extent * extent_pages, (extent + 1) * extent_pages);
+  if (page_number == Page::INVALID_NUMBER) {
+    return Page::INVALID_NUMBER;
+  }
+  setPageFree(page_number, false);
+  header.num_free_pages--;
+  const std::map<PageId, Extent>::iterator it = open_file_->extents.find(extent);
+  if (it != open_file_->extents.end() && page_number >= it->second.next) {
+    it->second.next = page_number + 1;
+  }
+  return page_number;
+}
+
+PageId BlobFile::takeFreePage(FileHeader& header) {
+  const PageId extent_pages = open_file_->extent_pages;
+  PageId begin = 0;
+  while (header.num_free_pages > 0) {
+    const PageId page_number = findFreePage(begin, header.num_pages);
+    if (page_number == Page::INVALID_NUMBER) {
+      break;
+    }
+    // skip the rest of an extent opened since the file was opened
+    const PageId extent = page_number / extent_pages;
+    const std::map<PageId, Extent>::iterator it = open_file_->extents.find(extent);
+    if (it != open_file_->extents.end() && page_number >= it->second.next) {
+      begin = (extent + 1) * extent_pages;
+      continue;
+    }
+    setPageFree(page_number, false);
+    header.num_free_pages--;
+    return page_number;
+  }
+  return Page::INVALID_NUMBER;
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readPageInto(page_number, page);
 	return page;
 }
 
+void BlobFile::readPageInto(const PageId page_number, Page& page) const {
+	// a page past the end reads as zeros, not as a frame's old contents
+	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE, pagePosition(page_number));
+}
+
+void BlobFile::readPagesInto(const std::vector<PageId>& page_numbers,
+                             const std::vector<Page*>& pages) const {
+	std::vector<FileIORequest> requests(page_numbers.size());
+	for (std::size_t i = 0; i < page_numbers.size(); i++) {
+		const FileIORequest request = {reinterpret_cast<char*>(pages[i]), Page::SIZE,
+		                               pagePosition(page_numbers[i]), NULL, 0};
+		requests[i] = request;
+	}
+	if (!requests.empty())
+		stream_->readBatch(&requests[0], requests.size());
+}
+
+void BlobFile::writePages(const std::vector<PageId>& page_numbers,
+                          const std::vector<const Page*>& pages) {
+	std::vector<FileIORequest> requests(page_numbers.size());
+	for (std::size_t i = 0; i < page_numbers.size(); i++) {
+		const FileIORequest request = {const_cast<char*>(reinterpret_cast<const char*>(pages[i])),
+		                               Page::SIZE, pagePosition(page_numbers[i]), NULL, 0};
+		requests[i] = request;
+	}
+	if (!requests.empty())
+		stream_->writeBatch(&requests[0], requests.size());
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE, pagePosition(new_page_number));
 }
 
-//delePage should not be called for a blob_file, not supported
 void BlobFile::deletePage(const PageId page_number) {
-	throw InvalidPageException(page_number, filename_);
+  releasePages(std::vector<PageId>(1, page_number), false /* punch */);
+}
+
+void BlobFile::deletePages(const std::vector<PageId>& page_numbers) {
+  releasePages(page_numbers, true /* punch */);
+}
+
+void BlobFile::releasePages(const std::vector<PageId>& page_numbers, const bool punch) {
+  FileHeader header = readHeader();
+  const std::map<PageId, Extent>& extents = open_file_->extents;
+  std::vector<PageId> sorted(page_numbers);
+  std::sort(sorted.begin(), sorted.end());
+  for (std::size_t i = 0; i < sorted.size(); i++) {
+    const PageId page_number = sorted[i];
+    const std::map<PageId, Extent>::const_iterator it =
+        extents.find(page_number / open_file_->extent_pages);
+    const bool reserved = it != extents.end() && page_number >= it->second.next;
+    if (page_number >= header.num_pages || page_number % FREE_MAP_CHUNK_PAGES == 0 ||
+        reserved || isPageFree(page_number) || (i > 0 && sorted[i - 1] == page_number)) {
+      throw InvalidPageException(page_number, filename_);
+    }
+  }
+
+  for (std::size_t i = 0; i < sorted.size(); i++) {
+    setPageFree(sorted[i], true);
+  }
+  header.num_free_pages += sorted.size();
+  writeHeader(header);
+
+  if (!punch) {
+    return;
+  }
+  for (std::size_t i = 0; i < sorted.size(); ) {
+    std::size_t run = 1;
+    while (i + run < sorted.size() && sorted[i + run] == sorted[i] + run) {
+      run++;
+    }
+    stream_->punchHole(pagePosition(sorted[i]), run * Page::SIZE);
+    i += run;
+  }
+}
+
+MappedFile::MappedFile(const std::string& name)
+: File(name, false /* create_new */),
+  fd_(-1),
+  mapping_(NULL),
+  last_page_(Page::INVALID_NUMBER),
+  sequential_run_(0),
+  random_run_(0),
+  advice_(MADV_NORMAL)
+{
+  fd_ = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    throw FileIOException(name, "open", errno);
+  }
+  // Nothing is mapped until a page is asked for.
+  Mapping* empty = new Mapping();
+  empty->base = NULL;
+  empty->length = 0;
+  mappings_.push_back(empty);
+  mapping_.store(empty);
+}
+
+MappedFile::~MappedFile() {
+  for (std::size_t i = 0; i < mappings_.size(); i++) {
+    if (mappings_[i]->base != NULL) {
+      munmap(mappings_[i]->base, mappings_[i]->length);
+    }
+    delete mappings_[i];
+  }
+  ::close(fd_);
+}
+
+const Page* MappedFile::pageAt(const PageId page_number) const {
+  if (page_number == Page::INVALID_NUMBER || page_number >= readHeader().num_pages) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  const std::size_t position = static_cast<std::size_t>(pagePosition(page_number));
+  const Mapping* mapping = mapping_.load(std::memory_order_acquire);
+  if (mapping->length < position + Page::SIZE) {
+    mapping = grow(page_number);
+  }
+  noteAccess(page_number, mapping);
+
+  const Page* page = reinterpret_cast<const Page*>(mapping->base + position);
+  if (page->page_number() == Page::INVALID_NUMBER) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  return page;
+}
+
+const MappedFile::Mapping* MappedFile::grow(const PageId page_number) const {
+  std::lock_guard<std::mutex> guard(mapping_latch_);
+  const std::size_t needed = static_cast<std::size_t>(pagePosition(page_number)) + Page::SIZE;
+  const Mapping* current = mapping_.load(std::memory_order_relaxed);
+  if (current->length >= needed) {
+    // another thread got here first
+    return current;
+  }
+
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    throw FileIOException(filename_, "stat", errno);
+  }
+  const std::size_t length = static_cast<std::size_t>(st.st_size);
+  if (length < needed) {
+    // allocated, but not yet written
+    throw InvalidPageException(page_number, filename_);
+  }
+  void* base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd_, 0);
+  if (base == MAP_FAILED) {
+    throw FileIOException(filename_, "map", errno);
+  }
+  madvise(base, length, advice_.load(std::memory_order_relaxed));
+
+  Mapping* mapping = new Mapping();
+  mapping->base = static_cast<char*>(base);
+  mapping->length = length;
+  mappings_.push_back(mapping);
+  mapping_.store(mapping, std::memory_order_release);
+  return mapping;
+}
+
+void MappedFile::noteAccess(const PageId page_number, const Mapping* mapping) const {
+  const PageId last_page = last_page_.exchange(page_number, std::memory_order_relaxed);
+  if (page_number == last_page) {
+    return;
+  }
+
+  int advice;
+  if (page_number == last_page + 1) {
+    random_run_.store(0, std::memory_order_relaxed);
+    if (sequential_run_.load(std::memory_order_relaxed) < ADVICE_RUN &&
+        sequential_run_.fetch_add(1, std::memory_order_relaxed) + 1 < ADVICE_RUN) {
+      return;
+    }
+    advice = MADV_SEQUENTIAL;
+  } else {
+    sequential_run_.store(0, std::memory_order_relaxed);
+    if (random_run_.load(std::memory_order_relaxed) < ADVICE_RUN &&
+        random_run_.fetch_add(1, std::memory_order_relaxed) + 1 < ADVICE_RUN) {
+      return;
+    }
+    advice = MADV_RANDOM;
+  }
+  if (advice_.exchange(advice, std::memory_order_relaxed) != advice) {
+    // only advice; nothing to do if the kernel won't take it
+    madvise(mapping->base, mapping->length, advice);
+  }
+}
+
+Page MappedFile::allocatePage(PageId &new_page_number) {
+  throw ReadOnlyFileException(filename_);
+}
+
+void MappedFile::allocatePageInto(PageId &new_page_number, Page& new_page) {
+  throw ReadOnlyFileException(filename_);
+}
+
+Page MappedFile::readPage(const PageId page_number) const {
+  Page page;
+  readPageInto(page_number, page);
+  return page;
+}
+
+void MappedFile::readPageInto(const PageId page_number, Page& page) const {
+  memcpy(&page, pageAt(page_number), Page::SIZE);
+}
+
+void MappedFile::readPagesInto(const std::vector<PageId>& page_numbers,
+                               const std::vector<Page*>& pages) const {
+  for (std::size_t i = 0; i < page_numbers.size(); i++) {
+    readPageInto(page_numbers[i], *pages[i]);
+  }
+}
+
+void MappedFile::writePage(const PageId page_number, const Page& new_page) {
+  throw ReadOnlyFileException(filename_);
+}
+
+void MappedFile::writePages(const std::vector<PageId>& page_numbers,
+                            const std::vector<const Page*>& pages) {
+  throw ReadOnlyFileException(filename_);
+}
+
+void MappedFile::deletePage(const PageId page_number) {
+  throw ReadOnlyFileException(filename_);
 }
 
 }
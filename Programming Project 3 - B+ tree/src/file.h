@@ -7,10 +7,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "page.h"
 
@@ -18,6 +24,185 @@ namespace badgerdb {
 
 class FileIterator;
 
+/**
+ * @brief How files opened from now on do their page I/O.
+ */
+enum FileBackendType {
+  /**
+   * Positional pread and pwrite on a file descriptor.  Reads of one file can
+   * run concurrently, and writes go to the OS without a flush.
+   */
+  POSIX_BACKEND,
+
+  /**
+   * A std::fstream, one operation at a time, flushed after each write.
+   */
+  STREAM_BACKEND,
+
+  /**
+   * pread and pwrite with O_DIRECT, bypassing the OS page cache so that the
+   * buffer pool is the only cache.  Whole pages read into or written from
+   * memory aligned to FileIO::ALIGNMENT, as the buffer pool's frames are, go
+   * straight to the device; anything else goes through a bounce buffer.
+   */
+  DIRECT_BACKEND
+};
+
+/**
+ * @brief One read or write of a batch handed to a FileIO.
+ */
+struct FileIORequest {
+  /**
+   * Buffer to read into, or bytes to write.
+   */
+  char* buf;
+
+  /**
+   * Number of bytes in buf.
+   */
+  std::size_t len;
+
+  /**
+   * Offset from the beginning of the file.
+   */
+  std::streamoff pos;
+
+  /**
+   * For writes, bytes to write just ahead of buf, or NULL.
+   */
+  const char* head;
+
+  /**
+   * Number of bytes in head.
+   */
+  std::size_t head_len;
+};
+
+/**
+ * @brief Reads and writes bytes at given offsets of an open file.
+ *
+ * Each call stands on its own, so the calls of several threads may be mixed
+ * freely; whether they also run concurrently is up to the backend.
+ */
+class FileIO {
+ public:
+  /**
+   * Alignment of memory, offsets and lengths that direct I/O requires.
+   */
+  static const std::size_t ALIGNMENT = 4096;
+
+  /**
+   * Opens the given file with the given backend.
+   *
+   * @param name        Name of file.
+   * @param backend     Backend to use.
+   * @param create_new  Whether to create the file, or truncate it if it exists.
+   * @return  The open file.
+   * @throws  FileIOException   If the file can't be opened.
+   */
+  static FileIO* open(const std::string& name, const FileBackendType backend,
+                      const bool create_new);
+
+  virtual ~FileIO() {}
+
+  /**
+   * Reads len bytes at the given offset.  Bytes past the end of the file read
+   * as zeros.
+   *
+   * @param buf   Buffer to read into.
+   * @param len   Number of bytes to read.
+   * @param pos   Offset from the beginning of the file.
+   * @throws  FileIOException   If the read fails.
+   */
+  virtual void read(char* buf, const std::size_t len, const std::streamoff pos) = 0;
+
+  /**
+   * Writes len bytes at the given offset.
+   *
+   * @param buf   Bytes to write.
+   * @param len   Number of bytes to write.
+   * @param pos   Offset from the beginning of the file.
+   * @throws  FileIOException   If the write fails.
+   */
+  virtual void write(const char* buf, const std::size_t len, const std::streamoff pos) = 0;
+
+  /**
+   * Writes two buffers back to back at the given offset, as one write where
+   * the backend can.
+   *
+   * @param head      First bytes to write.
+   * @param head_len  Number of bytes in head.
+   * @param body      Bytes to write after head.
+   * @param body_len  Number of bytes in body.
+   * @param pos       Offset from the beginning of the file.
+   * @throws  FileIOException   If the write fails.
+   */
+  virtual void write(const char* head, const std::size_t head_len,
+                     const char* body, const std::size_t body_len,
+                     const std::streamoff pos) = 0;
+
+  /**
+   * Carries out a batch of reads, as read() would each of them.  Backends
+   * that can keep many requests in flight do.
+   *
+   * @param requests  Reads to carry out.
+   * @param count     Number of reads.
+   * @throws  FileIOException   If a read fails.  The others may or may not
+   *                            have been carried out.
+   */
+  virtual void readBatch(FileIORequest* requests, const std::size_t count);
+
+  /**
+   * Carries out a batch of writes, as write() would each of them.  Backends
+   * that can keep many requests in flight do.
+   *
+   * @param requests  Writes to carry out.
+   * @param count     Number of writes.
+   * @throws  FileIOException   If a write fails.  The others may or may not
+   *                            have been carried out.
+   */
+  virtual void writeBatch(const FileIORequest* requests, const std::size_t count);
+
+  /**
+   * Reserves disk space for the given range of the file without changing its
+   * size, so that pages written there later land together on disk.  Backends
+   * that can't do nothing.
+   *
+   * @param pos   Offset from the beginning of the file.
+   * @param len   Number of bytes to reserve.
+   * @throws  FileIOException   If the space can't be reserved.
+   */
+  virtual void preallocate(const std::streamoff pos, const std::size_t len) {}
+
+  /**
+   * Gives the disk space of the given range of the file back to the
+   * filesystem without changing the file's size.  The range reads as zeros
+   * afterwards.  Backends that can't do nothing, and the range keeps its
+   * contents.
+   *
+   * @param pos   Offset from the beginning of the file.
+   * @param len   Number of bytes to release.
+   * @throws  FileIOException   If the space can't be released.
+   */
+  virtual void punchHole(const std::streamoff pos, const std::size_t len) {}
+
+  /**
+   * Returns the name of the file.
+   */
+  const std::string& filename() const { return filename_; }
+
+ protected:
+  explicit FileIO(const std::string& name) : filename_(name) {}
+
+  /**
+   * Name of the file.
+   */
+  const std::string filename_;
+};
+
+static_assert(Page::SIZE % FileIO::ALIGNMENT == 0,
+              "Pages must be a whole number of direct I/O blocks.");
+
 /**
  * @brief Header metadata for files on disk which contain pages.
  */
@@ -32,6 +217,12 @@ struct FileHeader {
    */
   PageId first_used_page;
 
+  /**
+   * Page number of the last used page in the file, where newly allocated
+   * pages are linked in.
+   */
+  PageId last_used_page;
+
   /**
    * Number of free pages (allocated but unused) in the file.
    */
@@ -42,6 +233,23 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Length of every record in a file of fixed-length records, whose pages
+   * keep their records in a dense array, or 0 if the pages are slotted.
+   */
+  std::uint32_t record_length;
+
+  /**
+   * Number of columns the pages of a file of fixed-length records split the
+   * records into (the PAX layout), or 0 if they keep records whole.
+   */
+  std::uint32_t num_columns;
+
+  /**
+   * Lengths of the columns, in the order their bytes are in the records.
+   */
+  std::uint16_t column_lengths[Page::MAX_COLUMNS];
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,7 +260,12 @@ struct FileHeader {
     return num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        last_used_page == rhs.last_used_page &&
+        first_free_page == rhs.first_free_page &&
+        record_length == rhs.record_length &&
+        num_columns == rhs.num_columns &&
+        std::equal(column_lengths, column_lengths + num_columns,
+                   rhs.column_lengths);
   }
 };
 
@@ -60,15 +273,19 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a stream (a FileIO) to an underlying file on disk.
+ * Files contain fixed-sized pages, and they never shrink (though they do
+ * reuse deleted pages if possible, and a BlobFile gives the disk space of
+ * pages deleted together back to the filesystem).  If multiple File objects refer to
+ * the same underlying file, they will share the stream in memory.
+ * Which FileIO backend a newly opened file gets is set with setBackend().
  * If a file that has already been opened (possibly by another query), then the File class
  * detects this (by looking in the open_streams_ map) and just returns a file object with
  * the already created stream for the file without actually opening the UNIX file again. 
  *
- * @warning This class is not threadsafe.
+ * @warning This class is not threadsafe, except that pages of an open file
+ *          may be read concurrently with each other and with writes of other
+ *          pages.
  */
 
 
@@ -111,6 +328,45 @@ class File {
    */
   static bool exists(const std::string& filename);
 
+  /**
+   * Sets the backend used by files opened from now on.  Files already open
+   * keep theirs.
+   *
+   * @param backend   Backend to use.
+   */
+  static void setBackend(const FileBackendType backend) { backend_ = backend; }
+
+  /**
+   * Returns the backend used by files opened from now on.
+   */
+  static FileBackendType backend() { return backend_; }
+
+  /**
+   * Sets the number of pages files opened from now on grow by at a time.
+   * Each extent of that many pages is reserved on disk in one go.  Files
+   * already open keep theirs.
+   *
+   * @param pages   Pages per extent, at least 1.
+   */
+  static void setExtentPages(const PageId pages) { extent_pages_ = pages > 0 ? pages : 1; }
+
+  /**
+   * Returns the number of pages files opened from now on grow by at a time.
+   */
+  static PageId extentPages() { return extent_pages_; }
+
+  /**
+   * Number of pages per extent unless setExtentPages() says otherwise.
+   */
+  static const PageId DEFAULT_EXTENT_PAGES = 1;
+
+  /**
+   * Returns the number of pages each free map page of a BlobFile covers.
+   * Free map pages are the multiples of this, starting with the header
+   * page, and are never handed out as pages of the file.
+   */
+  static PageId freeMapChunkPages() { return FREE_MAP_CHUNK_PAGES; }
+
   /**
    * Destructor that automatically closes the underlying file if no other
    * File objects are using it.
@@ -124,6 +380,30 @@ class File {
    */
   virtual Page allocatePage(PageId &new_page_number) = 0;
 
+  /**
+   * Allocates a new page in the file, building it in the given page instead
+   * of returning a copy.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Page to hold the new page.
+   */
+  virtual void allocatePageInto(PageId &new_page_number, Page& new_page) = 0;
+
+  /**
+   * Allocates a new page like allocatePageInto(), placing it near the given
+   * page on disk if the file can.  Files that don't place pages ignore the
+   * hint.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Page to hold the new page.
+   * @param near_page_number  Page to place the new one near, or
+   *                          Page::INVALID_NUMBER for no preference.
+   */
+  virtual void allocatePageNear(PageId &new_page_number, Page& new_page,
+                                const PageId near_page_number) {
+    allocatePageInto(new_page_number, new_page);
+  }
+
   /**
    * Reads an existing page from the file.
    *
@@ -134,6 +414,43 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page from the file straight into the given page, so
+   * that a caller owning the memory (a buffer pool frame) skips the temporary
+   * page and its copy.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPageInto(const PageId page_number, Page& page) const = 0;
+
+  /**
+   * Reads several existing pages at once, each into the page given for it.
+   *
+   * @param page_numbers  Numbers of pages to read.
+   * @param pages         Pages to read into, one per page number.
+   * @throws  InvalidPageException  If a page doesn't exist in the file or is
+   *                                not currently used.  The other pages may
+   *                                or may not have been read.
+   */
+  virtual void readPagesInto(const std::vector<PageId>& page_numbers,
+                             const std::vector<Page*>& pages) const = 0;
+
+  /**
+   * Reads a run of consecutive pages into consecutive pages in memory, as
+   * readPagesInto() would, which the POSIX and direct backends do with one
+   * preadv.
+   *
+   * @param first_page_number   Number of the first page to read.
+   * @param count               Number of pages to read.
+   * @param pages               Pages to read into, count of them.
+   * @throws  InvalidPageException  If a page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPages(const PageId first_page_number, const PageId count, Page* pages) const;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -143,6 +460,26 @@ class File {
    */
   virtual void writePage(const PageId page_number, const Page& new_page) = 0;
 
+  /**
+   * Writes several pages at once, as writePage() would each of them.
+   *
+   * @param page_numbers  Numbers of pages whose contents to replace.
+   * @param pages         Pages to write, one per page number.
+   */
+  virtual void writePages(const std::vector<PageId>& page_numbers,
+                          const std::vector<const Page*>& pages) = 0;
+
+  /**
+   * Writes a run of consecutive pages from consecutive pages in memory, as
+   * writePages() would, which the POSIX and direct backends do with one
+   * pwritev.
+   *
+   * @param first_page_number   Number of the first page to write.
+   * @param count               Number of pages to write.
+   * @param pages               Pages to write, count of them.
+   */
+  void writePages(const PageId first_page_number, const PageId count, const Page* pages);
+
   /**
    * Deletes a page from the file.
    *
@@ -150,6 +487,16 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Deletes several pages at once, as deletePage() would each of them.
+   *
+   * @param page_numbers  Numbers of pages to delete.
+   */
+  virtual void deletePages(const std::vector<PageId>& page_numbers) {
+    for (std::size_t i = 0; i < page_numbers.size(); i++)
+      deletePage(page_numbers[i]);
+  }
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -157,6 +504,15 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns a number identifying this object's use of its file.  It changes
+   * when the object is assigned another file and is never reused, unlike
+   * the object's address.
+   *
+   * @return Identity of this file object.
+   */
+  std::uint64_t id() const { return id_; }
+
  	/**
    * Returns pageid of first page in the file.
    *
@@ -164,16 +520,27 @@ class File {
    */
 	PageId getFirstPageNo();
 
+  /**
+   * Writes the file header back to disk if it has changed since it was last
+   * written.  The header is kept in memory while the file is open, and is
+   * otherwise only written when the last File object open on the file closes.
+   *
+   * @throws  FileIOException   If the header can't be written.
+   */
+  void flushHeader() const;
+
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
-   * offset from the beginning of the file).
+   * offset from the beginning of the file).  The file header takes up the
+   * place of page 0, so that every page starts on a multiple of Page::SIZE,
+   * as direct I/O needs.
    *
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
   static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+    return static_cast<std::streamoff>(page_number) * Page::SIZE;
   }
 
   /**
@@ -186,35 +553,183 @@ class File {
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  FileIOException         If the underlying file can't be opened.
    */
   void openIfNeeded(const bool create_new);
 
   /**
    * Closes the underlying file stream in <stream_>.
    * This method only closes the file if no other File objects exist that access
-   * the same file.
+   * the same file, in which case it first writes the file header back.
+   *
+   * @throws  FileIOException   If the header can't be written.  The file is
+   *                            closed anyway.
    */
   void close();
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file, from memory.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the header for this file in memory.  It goes to disk at the
+   * next flushHeader(), or when the file is closed.
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * Reserves disk space for the rest of the extent holding the given page,
+   * unless that was already done.  Called with the page at the end of the
+   * file as it grows.
+   *
+   * @param page_number   Number of page about to be allocated.
+   * @throws  FileIOException   If the space can't be reserved.
+   */
+  void preallocateExtent(const PageId page_number);
+
+  /**
+   * Marks an extent with no link to another.
+   */
+  static const PageId NO_EXTENT = static_cast<PageId>(-1);
+
+  /**
+   * @brief Allocation state of one extent of a BlobFile, extent k being pages
+   *        k * extent_pages up to (k + 1) * extent_pages.
+   */
+  struct Extent {
+    /**
+     * First page of the extent not handed out since it was opened.  The
+     * pages from here to the end of the extent are marked free as soon as
+     * the extent is opened, so that they are not lost if the file is not
+     * closed cleanly, but are kept for the extent while the file is open.
+     */
+    PageId next;
+
+    /**
+     * Extent that takes the pages meant for this one once it is full, or
+     * NO_EXTENT.
+     */
+    PageId overflow;
+  };
+
+  /**
+   * Bytes at the start of each free map page that hold no bits.  The header
+   * page keeps the file header there.
+   */
+  static const std::size_t FREE_MAP_OFFSET = 64;
+  static_assert(sizeof(FileHeader) <= FREE_MAP_OFFSET,
+                "The file header must fit before the free map.");
+
+  /**
+   * Words of the free map held by each free map page.
+   */
+  static const PageId FREE_MAP_WORDS = (Page::SIZE - FREE_MAP_OFFSET) / sizeof(std::uint64_t);
+
+  /**
+   * Pages covered by each free map page.  Free map page c is page
+   * c * FREE_MAP_CHUNK_PAGES, the first it covers, so the header page holds
+   * the first.
+   */
+  static const PageId FREE_MAP_CHUNK_PAGES = FREE_MAP_WORDS * 64;
+
+  /**
+   * Reads the free map of the file from disk, unless the first BlobFile
+   * opened on the file already did.  Files without a free map read as
+   * having no free pages.
+   *
+   * @throws  FileIOException   If the free map can't be read.
+   */
+  void loadFreeMap();
+
+  /**
+   * Returns true if the page is marked free in the free map.
+   */
+  bool isPageFree(const PageId page_number) const;
+
+  /**
+   * Marks the page free or used in the free map.
+   */
+  void setPageFree(const PageId page_number, const bool free);
+
+  /**
+   * Returns the lowest page marked free from begin up to end, or
+   * Page::INVALID_NUMBER if there is none.
+   */
+  PageId findFreePage(const PageId begin, const PageId end) const;
+
+  /**
+   * @brief What the File objects open on one filesystem file share.
+   */
+  struct OpenFile {
+    /**
+     * Stream for the filesystem file.
+     */
+    std::shared_ptr<FileIO> stream;
+
+    /**
+     * The file header, read when the file was opened and kept up to date
+     * here.
+     */
+    FileHeader header;
+
+    /**
+     * True if the header has changed since it was last written to disk.
+     */
+    bool header_dirty;
+
+    /**
+     * Guards header and header_dirty.
+     */
+    std::mutex header_latch;
+
+    /**
+     * Pages per extent, fixed when the file was opened.
+     */
+    PageId extent_pages;
+
+    /**
+     * Page number up to which disk space has been reserved.
+     */
+    PageId preallocated_end;
+
+    /**
+     * Extents opened since the file was opened, by number, and the one pages
+     * allocated without a hint go to.  Extents filled before the file was
+     * opened have no entry and count as full.  Like the header, these only
+     * change when a page is allocated, which callers serialize.
+     */
+    std::map<PageId, Extent> extents;
+    PageId default_extent;
+
+    /**
+     * Free map of a BlobFile: one bit per page, set if the page is free.
+     * Loaded by the first BlobFile opened on the file, and written back with
+     * the header, a free map page at a time.  Changes when pages are
+     * allocated or deleted, which callers serialize.
+     */
+    std::vector<std::uint64_t> free_map;
+
+    /**
+     * Whether each free map page changed since it was last written.
+     */
+    std::vector<bool> free_map_dirty;
+
+    /**
+     * True once the free map has been loaded.
+     */
+    bool free_map_loaded;
+  };
+
+  typedef std::map<std::string, std::shared_ptr<OpenFile> > StreamMap;
   typedef std::map<std::string, int> CountMap;
 
   /**
-   * Streams for opened files.
+   * Streams and headers for opened files.
    */
   static StreamMap open_streams_;
 
@@ -223,15 +738,40 @@ class File {
    */
   static CountMap open_counts_;
 
+  /**
+   * Backend of files opened from now on.
+   */
+  static FileBackendType backend_;
+
+  /**
+   * Pages per extent of files opened from now on.
+   */
+  static PageId extent_pages_;
+
+  /**
+   * Last identity handed out to a file object.
+   */
+  static std::atomic<std::uint64_t> last_id_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
+  /**
+   * Identity of this object's use of filename_.
+   */
+  std::uint64_t id_;
+
   /**
    * Stream for underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<FileIO> stream_;
+
+  /**
+   * State shared with the other File objects open on the same file.
+   */
+  std::shared_ptr<OpenFile> open_file_;
 
   friend class FileIterator;
 };
@@ -247,6 +787,36 @@ class PageFile : public File {
    */
   static PageFile create(const std::string& filename);
 
+  /**
+   * Creates a new file of fixed-length records.  Its pages hold records of
+   * the given length only, packed without a slot array, so more of them fit.
+   *
+   * @param filename        Name of the file.
+   * @param record_length   Length of every record in bytes.
+   * @throws  FileExistsException     If the requested file already exists.
+   * @throws  InvalidRecordLengthException  If the length is 0 or more than
+   *                                        Page::DATA_SIZE.
+   */
+  static PageFile create(const std::string& filename,
+                         const std::uint16_t record_length);
+
+  /**
+   * Creates a new file of fixed-length records kept in the PAX layout: each
+   * page splits its records into the given columns and keeps each column in
+   * a minipage of its own, so a scan of one field only reads that field.
+   *
+   * @param filename        Name of the file.
+   * @param column_lengths  Lengths of the columns, in the order their bytes
+   *                        are in the records, which they make up.
+   * @throws  FileExistsException     If the requested file already exists.
+   * @throws  InvalidFieldException   If there are no columns, more than
+   *                                  Page::MAX_COLUMNS, or an empty one.
+   * @throws  InvalidRecordLengthException  If not even one record of the
+   *                                        columns fits on a page.
+   */
+  static PageFile create(const std::string& filename,
+                         const std::vector<std::uint16_t>& column_lengths);
+
   /**
    * Opens the file named fileName and returns the corresponding File object.
 	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
@@ -262,14 +832,23 @@ class PageFile : public File {
   /**
    * Constructs a file object representing a file on the filesystem.
    *
-   * @param name        Name of file.
-   * @param create_new  Whether to create a new file.
+   * @param name          Name of file.
+   * @param create_new    Whether to create a new file.
+   * @param record_length Length of every record in a new file of
+   *                      fixed-length records, or 0 for slotted pages.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  PageFile(const std::string& name, const bool create_new);
+  PageFile(const std::string& name, const bool create_new,
+           const std::uint16_t record_length = 0);
+
+  /**
+   * Returns the length of every record in a file of fixed-length records, or
+   * 0 if its pages are slotted.
+   */
+  std::uint16_t record_length() const { return readHeader().record_length; }
 
   /**
    * Copy constructor.
@@ -294,12 +873,22 @@ class PageFile : public File {
   ~PageFile();
 
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page in the file.  A free page is reused if there is one.
+   * Either way the page goes at the end of the used list, so this takes a
+   * constant number of reads and writes however large the file is.
    *
    * @return The new page.
    */
   Page allocatePage(PageId &new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, building it in the given page.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Page to hold the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page& new_page) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -310,6 +899,27 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPageInto(const PageId page_number, Page& page) const override;
+
+  /**
+   * Reads several existing pages at once, each into the page given for it.
+   *
+   * @param page_numbers  Numbers of pages to read.
+   * @param pages         Pages to read into, one per page number.
+   * @throws  InvalidPageException  If a page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPagesInto(const std::vector<PageId>& page_numbers,
+                     const std::vector<Page*>& pages) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -320,9 +930,22 @@ class PageFile : public File {
   void writePage(const PageId page_number, const Page& new_page) override;
 
   /**
-   * Deletes a page from the file.
+   * Writes several pages at once, as writePage() would each of them.
+   *
+   * @param page_numbers  Numbers of pages whose contents to replace.
+   * @param pages         Pages to write, one per page number.
+   */
+  void writePages(const std::vector<PageId>& page_numbers,
+                  const std::vector<const Page*>& pages) override;
+  using File::writePages;
+
+  /**
+   * Deletes a page from the file.  The page is unlinked from the used list
+   * through its neighbours' pointers, without walking the list.
    *
    * @param page_number   Number of page to delete.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
    */
   void deletePage(const PageId page_number) override;
 
@@ -344,19 +967,21 @@ class PageFile : public File {
  private:
 
   /**
-   * Reads a page from the file.  If <allow_free> is not set, an exception
-   * will be thrown if the page read from disk is not currently in use.
+   * Reads a page from the file into the given page.  If <allow_free> is not
+   * set, an exception will be thrown if the page read from disk is not
+   * currently in use.
    *
    * No bounds checking is performed; the underlying file stream will throw
    * an exception if the page is past the end of the file.
    *
    * @param page_number   Number of page to read.
+   * @param page          Page to read into.
    * @param allow_free    Whether to allow reading a free (unused) page.
-   * @return  The page.
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
    */
-  Page readPage(const PageId page_number, const bool allow_free) const;
+  void readPageInto(const PageId page_number, Page& page,
+                    const bool allow_free) const;
 
   /**
    * Writes a page into the file at the given page number with the given header.
@@ -379,6 +1004,15 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Writes only the header of the given page to disk, leaving the record data
+   * and slot table as they are.  No bounds checking is performed.
+   *
+   * @param page_number   Number of page whose header is to be written.
+   * @param header        Header to write.
+   */
+  void writePageHeader(const PageId page_number, const PageHeader& header);
+
   friend class FileIterator;
 };
 
@@ -448,6 +1082,33 @@ class BlobFile : public File {
    */
   Page allocatePage(PageId &new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, building it in the given page.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Page to hold the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page& new_page) override;
+
+  /**
+   * Allocates a new page in the file, building it in the given page, in the
+   * extent of the given page if that has a free page or room.  Otherwise the
+   * page goes in the extent that took the overflow of that one, then in the
+   * lowest free page of the file, and only then in a new extent at the end
+   * of the file.  Pages allocated without a hint share extents of their own.
+   * With single page extents, the default, the hint is ignored.
+   *
+   * The pages of a new extent are marked free when it is opened, and only
+   * kept for it while the file is open.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Page to hold the new page.
+   * @param near_page_number  Page to place the new one near, or
+   *                          Page::INVALID_NUMBER for no preference.
+   */
+  void allocatePageNear(PageId &new_page_number, Page& new_page,
+                        const PageId near_page_number) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -458,6 +1119,27 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPageInto(const PageId page_number, Page& page) const override;
+
+  /**
+   * Reads several existing pages at once, each into the page given for it.
+   *
+   * @param page_numbers  Numbers of pages to read.
+   * @param pages         Pages to read into, one per page number.
+   * @throws  InvalidPageException  If a page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPagesInto(const std::vector<PageId>& page_numbers,
+                     const std::vector<Page*>& pages) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -468,11 +1150,216 @@ class BlobFile : public File {
   void writePage(const PageId page_number, const Page& new_page) override;
 
   /**
-   * Deletes a page from the file.
+   * Writes several pages at once, as writePage() would each of them.
+   *
+   * @param page_numbers  Numbers of pages whose contents to replace.
+   * @param pages         Pages to write, one per page number.
+   */
+  void writePages(const std::vector<PageId>& page_numbers,
+                  const std::vector<const Page*>& pages) override;
+  using File::writePages;
+
+  /**
+   * Deletes a page from the file, marking it free for allocation to reuse.
    *
    * @param page_number   Number of page to delete.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void deletePage(const PageId page_number) override;
+
+  /**
+   * Deletes several pages at once, and gives their disk space back to the
+   * filesystem, a run of consecutive pages at a time.
+   *
+   * @param page_numbers  Numbers of pages to delete.
+   * @throws  InvalidPageException  If a page doesn't exist in the file, is
+   *                                not currently used or is given twice.  No
+   *                                page is deleted then.
+   */
+  void deletePages(const std::vector<PageId>& page_numbers) override;
+
+ private:
+  /**
+   * Deletes the given pages, punching holes where they were if asked to.
+   */
+  void releasePages(const std::vector<PageId>& page_numbers, const bool punch);
+
+  /**
+   * Takes the lowest free page of the given extent, or returns
+   * Page::INVALID_NUMBER if it has none.
+   */
+  PageId takeFromExtent(const PageId extent, FileHeader& header);
+
+  /**
+   * Takes the lowest free page of the file that is not kept for an open
+   * extent, or returns Page::INVALID_NUMBER if there is none.
+   */
+  PageId takeFreePage(FileHeader& header);
+};
+
+/**
+ * @brief A PageFile opened read-only through a memory mapping, so that a page
+ *        can be read as a pointer into the mapping instead of an 8 KB copy.
+ *
+ * The file is mapped with MAP_SHARED, so pages written through other File
+ * objects open on it show up once they reach the OS; pages still dirty in a
+ * buffer pool do not.  Allocating, writing or deleting pages throws.  Only
+ * PageFiles can be mapped, since each page's header is checked; a BlobFile,
+ * such as a B+ tree index, is read through a buffer pool as before.
+ *
+ * The kernel is told how the pages are being read: once a run of consecutive
+ * page numbers is seen the mapping is advised MADV_SEQUENTIAL, so that it
+ * reads ahead, and after a run of jumps MADV_RANDOM, so that it does not.
+ */
+class MappedFile : public File {
+ public:
+  /**
+   * Opens an existing PageFile and maps it.
+   *
+   * @param name  Name of file.
+   * @throws  FileNotFoundException   If the underlying file doesn't exist.
+   * @throws  FileIOException         If the file can't be mapped.
+   */
+  explicit MappedFile(const std::string& name);
+
+  /**
+   * Unmaps the file, and closes it if no other File objects are using it.
+   * Pointers returned by pageAt() are no longer valid.
+   */
+  ~MappedFile();
+
+  /**
+   * Returns the page with the given number where it lies in the mapping.  The
+   * pointer stays valid until this object is destroyed.  The mapping is
+   * read-only; writing through the pointer faults.
+   *
+   * @param page_number   Number of page to return.
+   * @return  The page.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  const Page* pageAt(const PageId page_number) const;
+
+  /**
+   * Throws ReadOnlyFileException.
+   */
+  Page allocatePage(PageId &new_page_number) override;
+
+  /**
+   * Throws ReadOnlyFileException.
+   */
+  void allocatePageInto(PageId &new_page_number, Page& new_page) override;
+
+  /**
+   * Reads an existing page from the file, copying it out of the mapping.
+   *
+   * @param page_number   Number of page to read.
+   * @return  The page.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  Page readPage(const PageId page_number) const override;
+
+  /**
+   * Reads an existing page from the file into the given page, copying it out
+   * of the mapping.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPageInto(const PageId page_number, Page& page) const override;
+
+  /**
+   * Reads several existing pages, each into the page given for it.
+   *
+   * @param page_numbers  Numbers of pages to read.
+   * @param pages         Pages to read into, one per page number.
+   * @throws  InvalidPageException  If a page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPagesInto(const std::vector<PageId>& page_numbers,
+                     const std::vector<Page*>& pages) const override;
+
+  /**
+   * Throws ReadOnlyFileException.
+   */
+  void writePage(const PageId page_number, const Page& new_page) override;
+
+  /**
+   * Throws ReadOnlyFileException.
+   */
+  void writePages(const std::vector<PageId>& page_numbers,
+                  const std::vector<const Page*>& pages) override;
+
+  /**
+   * Throws ReadOnlyFileException.
    */
   void deletePage(const PageId page_number) override;
+
+ private:
+  /**
+   * @brief One mapping of the file, from its start.
+   */
+  struct Mapping {
+    char* base;
+    std::size_t length;
+  };
+
+  /**
+   * Number of consecutive page numbers, or of jumps, after which the
+   * mapping's advice is switched.
+   */
+  static const int ADVICE_RUN = 4;
+
+  /**
+   * Maps the whole file again if it has grown past the current mapping, so
+   * that the mapping covers the given page.  Earlier mappings are kept until
+   * this object is destroyed, since pointers into them may still be in use.
+   *
+   * @param page_number   Number of page the mapping must cover.
+   * @return  The current mapping.
+   * @throws  InvalidPageException  If the file on disk ends before the page.
+   * @throws  FileIOException       If the file can't be mapped.
+   */
+  const Mapping* grow(const PageId page_number) const;
+
+  /**
+   * Notes an access to the given page, and switches the mapping's advice if
+   * the pattern of accesses has changed.
+   *
+   * @param page_number   Number of page accessed.
+   * @param mapping       The current mapping.
+   */
+  void noteAccess(const PageId page_number, const Mapping* mapping) const;
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  /**
+   * Read-only descriptor of the file, for mapping it.
+   */
+  int fd_;
+
+  /**
+   * The current mapping, and every mapping made, which grow() adds to under
+   * the latch.
+   */
+  mutable std::atomic<const Mapping*> mapping_;
+  mutable std::vector<Mapping*> mappings_;
+  mutable std::mutex mapping_latch_;
+
+  /**
+   * Last page accessed, the number of consecutive page numbers and of jumps
+   * seen in a row, and the madvise() advice in force.  Updated without a
+   * latch by every reader; a race only delays a switch of advice.
+   */
+  mutable std::atomic<PageId> last_page_;
+  mutable std::atomic<int> sequential_run_;
+  mutable std::atomic<int> random_run_;
+  mutable std::atomic<int> advice_;
 };
 
 }
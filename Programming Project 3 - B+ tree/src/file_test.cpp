@@ -0,0 +1,264 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "file.h"
+#include "io_engine.h"
+#include "page.h"
+#include "page_iterator.h"
+#include "exceptions/file_not_found_exception.h"
+
+#define checkPassFail(a, b)                                               \
+    \
+{                                                                  \
+        if ((a) == (b))                                                   \
+            std::cout << "\nTest passed at line no:" << __LINE__ << "\n"; \
+        else {                                                            \
+            std::cout << "\nTest FAILS at line no:" << __LINE__;          \
+            std::cout << "\nExpected:" << (b);                            \
+            std::cout << "\nActual:" << (a);                              \
+            std::cout << std::endl;                                       \
+            exit(1);                                                      \
+        }                                                                 \
+    \
+}
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+
+const std::string fileName = "fileTest.db";
+
+// Record each live page of the file holds, by page number.
+typedef std::map<PageId, std::string> LivePages;
+
+// Counts of what went wrong while allocating pages.
+struct AllocationErrors {
+    int reused;      // pages handed out while still live
+    int freeMapPage; // free map pages handed out
+};
+
+// -----------------------------------------------------------------------------
+// Forward declarations
+// -----------------------------------------------------------------------------
+
+void removeFile();
+std::streamoff fileSize();
+void allocatePages(BlobFile& file, LivePages& live, int count, int generation,
+                   AllocationErrors& errors, std::uint32_t& seed);
+void deletePages(BlobFile& file, LivePages& live, int count, std::uint32_t& seed);
+int checkContents(BlobFile& file, const LivePages& live);
+void freeMapTests(const PageId extentPages, const int numPages);
+void test1();
+void test2();
+void test3();
+
+int main(int argc, char** argv)
+{
+    test1();
+    test2();
+    test3();
+
+    File::setExtentPages(File::DEFAULT_EXTENT_PAGES);
+    return 0;
+}
+
+void test1()
+{
+    // Single page extents, the default, in a file of one free map page
+    std::cout << "--------------------" << std::endl;
+    std::cout << "free map with single page extents" << std::endl;
+    freeMapTests(1, 3000);
+}
+
+void test2()
+{
+    // Extents of 64 pages, reserved as they are opened, in a file that grows
+    // past the second free map page
+    std::cout << "--------------------" << std::endl;
+    std::cout << "free map with 64 page extents" << std::endl;
+    freeMapTests(64, File::freeMapChunkPages() + 1000);
+}
+
+void test3()
+{
+    // Switching the I/O engine while another thread has batches running on
+    // the old one leaves those batches to finish there
+    std::cout << "--------------------" << std::endl;
+    std::cout << "engine switch under running batches" << std::endl;
+    removeFile();
+    const PageId numPages = 64;
+    BlobFile* file = new BlobFile(fileName, true);
+    LivePages live;
+    for (PageId i = 0; i < numPages; i++) {
+        PageId pageNo;
+        Page page = file->allocatePage(pageNo);
+        live[pageNo] = "page " + std::to_string(pageNo);
+        page.insertRecord(live[pageNo]);
+        file->writePage(pageNo, page);
+    }
+
+    std::atomic<bool> stop(false);
+    int wrong = 0;
+    std::thread reader([&]() {
+        std::vector<Page> pages(numPages);
+        while (!stop.load()) {
+            file->readPages(live.begin()->first, numPages, &pages[0]);
+            PageId k = 0;
+            for (LivePages::const_iterator it = live.begin(); it != live.end(); ++it, ++k) {
+                PageIterator iter = pages[k].begin();
+                if (iter == pages[k].end() || *iter != it->second) {
+                    wrong++;
+                }
+            }
+        }
+    });
+
+    const IOEngineType savedEngine = IOEngine::get()->type();
+    for (int i = 0; i < 2000; i++) {
+        IOEngine::select(i % 2 ? URING_ENGINE : THREAD_ENGINE);
+    }
+    stop = true;
+    reader.join();
+    IOEngine::select(savedEngine);
+
+    checkPassFail(wrong, 0)
+    delete file;
+    removeFile();
+}
+
+// -----------------------------------------------------------------------------
+// freeMapTests
+// -----------------------------------------------------------------------------
+
+void freeMapTests(const PageId extentPages, const int numPages)
+{
+    // Grows the file, deletes a third of its pages, then closes and reopens
+    // it and allocates as many again, twice over.  No page may be handed out
+    // while live, no free map page may ever be handed out, and every live
+    // page must keep what was written to it.
+    removeFile();
+    File::setExtentPages(extentPages);
+    LivePages live;
+    AllocationErrors errors = {0, 0};
+    std::uint32_t seed = 12345u;
+
+    BlobFile* file = new BlobFile(fileName, true);
+    allocatePages(*file, live, numPages, 0, errors, seed);
+    checkPassFail(live.size(), (std::size_t)numPages)
+
+    for (int generation = 1; generation <= 2; generation++) {
+        deletePages(*file, live, numPages / 3, seed);
+        checkPassFail(checkContents(*file, live), 0)
+
+        delete file;
+        file = new BlobFile(BlobFile::open(fileName));
+        checkPassFail(checkContents(*file, live), 0)
+
+        const std::streamoff sizeBefore = fileSize();
+        allocatePages(*file, live, numPages / 3, generation, errors, seed);
+        checkPassFail(errors.reused, 0)
+        checkPassFail(errors.freeMapPage, 0)
+        checkPassFail(live.size(), (std::size_t)numPages)
+        checkPassFail(checkContents(*file, live), 0)
+
+        // the deleted pages, not new ones, took the allocations
+        checkPassFail(fileSize(), sizeBefore)
+    }
+
+    delete file;
+    removeFile();
+}
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+
+void removeFile()
+{
+    try {
+        File::remove(fileName);
+    }
+    catch (const FileNotFoundException& e) {
+    }
+}
+
+std::streamoff fileSize()
+{
+    std::ifstream in(fileName.c_str(), std::ios::binary | std::ios::ate);
+    return in.tellg();
+}
+
+void allocatePages(BlobFile& file, LivePages& live, int count, int generation,
+                   AllocationErrors& errors, std::uint32_t& seed)
+{
+    // Every other page is placed near a random live page, the rest anywhere.
+    for (int i = 0; i < count; i++) {
+        PageId near = Page::INVALID_NUMBER;
+        if (i % 2 == 1 && !live.empty()) {
+            seed = seed * 1103515245u + 12345u;
+            LivePages::const_iterator it = live.lower_bound((seed >> 8) % live.rbegin()->first + 1);
+            near = it->first;
+        }
+
+        PageId pageNo;
+        Page page;
+        file.allocatePageNear(pageNo, page, near);
+        if (live.count(pageNo)) {
+            errors.reused++;
+        }
+        if (pageNo % File::freeMapChunkPages() == 0) {
+            errors.freeMapPage++;
+        }
+
+        const std::string record = "page " + std::to_string(pageNo) + " generation " + std::to_string(generation);
+        page.insertRecord(record);
+        file.writePage(pageNo, page);
+        live[pageNo] = record;
+    }
+}
+
+void deletePages(BlobFile& file, LivePages& live, int count, std::uint32_t& seed)
+{
+    // Half are deleted one at a time, the rest in one batch.
+    std::vector<PageId> batch;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245u + 12345u;
+        LivePages::iterator it = live.lower_bound((seed >> 8) % live.rbegin()->first + 1);
+        if (i < count / 2) {
+            file.deletePage(it->first);
+        }
+        else {
+            batch.push_back(it->first);
+        }
+        live.erase(it);
+    }
+    file.deletePages(batch);
+}
+
+int checkContents(BlobFile& file, const LivePages& live)
+{
+    // Returns the number of live pages not holding their record.
+    int wrong = 0;
+    for (LivePages::const_iterator it = live.begin(); it != live.end(); ++it) {
+        Page page = file.readPage(it->first);
+        PageIterator iter = page.begin();
+        if (iter == page.end() || *iter != it->second) {
+            wrong++;
+        }
+    }
+    return wrong;
+}
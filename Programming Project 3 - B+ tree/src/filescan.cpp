@@ -7,98 +7,138 @@
 
 #include "filescan.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/read_only_file_exception.h"
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, BufAccessStrategy *accessStrategy)
 {
   file = new PageFile(name, false);	//dont create new file
+  mappedFile = NULL;
 	bufMgr = bufferMgr;
-	curDirtyFlag = false;
-  curPage = NULL;
-	filePageIter = file->begin();
+  strategy = accessStrategy;
+  mappedPage = NULL;
+  curPageNum = Page::INVALID_NUMBER;
+  atEnd = false;
+  sequentialRun = 0;
+  prefetchedUpTo = Page::INVALID_NUMBER;
+}
+
+FileScan::FileScan(const std::string &name)
+{
+  mappedFile = new MappedFile(name);
+  file = mappedFile;
+  bufMgr = NULL;
+  strategy = NULL;
+  mappedPage = NULL;
+  curPageNum = Page::INVALID_NUMBER;
+  atEnd = false;
+  sequentialRun = 0;
+  prefetchedUpTo = Page::INVALID_NUMBER;
 }
 
 FileScan::~FileScan()
 {
   // generally must unpin last page of the scan
-  if (curPage != NULL)
+  releaseCurrentPage();
+  if (bufMgr != NULL)
+    bufMgr->flushFile(file);
+  delete file;
+}
+
+Page* FileScan::currentPage() const
+{
+  // the scan only reads through the page, so the read-only mapping is safe
+  // to hand to a PageIterator
+  if (mappedFile != NULL)
+    return const_cast<Page*>(mappedPage);
+  return curPage.holdsPage() ? curPage.get() : NULL;
+}
+
+void FileScan::releaseCurrentPage()
+{
+  mappedPage = NULL;
+  curPage.release();
+}
+
+void FileScan::readCurrentPage(const PageId prevPageNum)
+{
+  // the mapping does its own read-ahead
+  if (mappedFile != NULL)
   {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-		curDirtyFlag = false;
-    filePageIter = file->begin();
+    mappedPage = mappedFile->pageAt(curPageNum);
+    return;
   }
-  bufMgr->flushFile(file);
-  delete file;
+
+  if (prevPageNum != Page::INVALID_NUMBER && curPageNum == prevPageNum + 1)
+    sequentialRun++;
+  else
+    sequentialRun = 0;
+
+  // Once the scan has moved through a few consecutive pages, keep reading
+  // about a window ahead of it, topping up when it is half way through.
+  if (sequentialRun >= 2 && curPageNum + PREFETCH_WINDOW / 2 >= prefetchedUpTo)
+  {
+    const PageId first = prefetchedUpTo > curPageNum ? prefetchedUpTo + 1 : curPageNum + 1;
+    bufMgr->prefetchAsync(file, first, PREFETCH_WINDOW, strategy);
+    prefetchedUpTo = first + PREFETCH_WINDOW - 1;
+  }
+
+  curPage = bufMgr->fetchPageWrite(file, curPageNum, strategy);
 }
 
 void FileScan::scanNext(RecordId& outRid)
 {
-  std::string rec;
-
-  if (filePageIter == file->end())
+  if (atEnd)
 	{
 		throw EndOfFileException();
 	}
 
-  // special case of the first record of the first page of the file
-  if (curPage == NULL)
+  if (currentPage() == NULL)
   {
-    // need to get the first page of the file
-		filePageIter = file->begin();
-    if(filePageIter == file->end())
+    // special case of the first record of the first page of the file
+    const PageId firstPageNum = file->getFirstPageNo();
+    if(firstPageNum == Page::INVALID_NUMBER)
 		{
+      atEnd = true;
 			throw EndOfFileException();
 		}
-	 
-		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
-		curDirtyFlag = false;
-
-		// get the first record off the page
-    pageRecordIter = curPage->begin(); 
 
-		if(pageRecordIter != curPage->end()) 
-		{
-		  // get pointer to record
-		  rec = *pageRecordIter;
-
-			outRid = pageRecordIter.getCurrentRecord();
-			return;
-		}
+		// read the first page of the file
+    curPageNum = firstPageNum;
+    readCurrentPage(Page::INVALID_NUMBER);
+    pageRecordIter = currentPage()->begin(); 
+  }
+  else
+  {
+    // Loop, looking for a record that satisfied the predicate.
+    // First try and get the next record off the current page
+    pageRecordIter++;
   }
 
-	// Loop, looking for a record that satisfied the predicate.
-	// First try and get the next record off the current page
-	pageRecordIter++;
-
-  while (pageRecordIter == curPage->end())
+  while (pageRecordIter == currentPage()->end())
   {
+    // the page itself says which one follows it, so the file need not be read
+    const PageId prevPageNum = curPageNum;
+    const PageId nextPageNum = currentPage()->next_page_number();
+
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-    curDirtyFlag = false;
+    releaseCurrentPage();
 
-    filePageIter++;
-    if (filePageIter == file->end())
+    if (nextPageNum == Page::INVALID_NUMBER)
     {
-      curPage = NULL;
+      atEnd = true;
 			throw EndOfFileException();
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    curPageNum = nextPageNum;
+    readCurrentPage(prevPageNum);
 
     // get the first record off the page
-    pageRecordIter = curPage->begin(); 
+    pageRecordIter = currentPage()->begin(); 
   }
 
-  // curRec points at a valid record
-  // see if the record satisfies the scan's predicate 
-  // get a pointer to the record
-  rec = *pageRecordIter;
-
 	// return rid of the record
 	outRid = pageRecordIter.getCurrentRecord();
 	return;
@@ -111,10 +151,44 @@ std::string FileScan::getRecord()
   return *pageRecordIter;
 }
 
+// returns a view of the current record in its pinned page
+RecordView FileScan::getRecordView()
+{
+  return pageRecordIter.getCurrentRecordView();
+}
+
+// returns a view of part of the current record in its pinned page
+RecordView FileScan::getFieldView(std::size_t offset, std::size_t length)
+{
+  return currentPage()->getFieldView(pageRecordIter.getCurrentRecord(), offset, length);
+}
+
+ColumnView FileScan::scanNextColumn(std::size_t offset, std::size_t length)
+{
+  if (atEnd)
+    throw EndOfFileException();
+
+  const PageId prevPageNum = currentPage() == NULL ? Page::INVALID_NUMBER : curPageNum;
+  const PageId nextPageNum = prevPageNum == Page::INVALID_NUMBER
+      ? file->getFirstPageNo() : currentPage()->next_page_number();
+  releaseCurrentPage();
+  if (nextPageNum == Page::INVALID_NUMBER)
+  {
+    atEnd = true;
+    throw EndOfFileException();
+  }
+
+  curPageNum = nextPageNum;
+  readCurrentPage(prevPageNum);
+  return currentPage()->getColumnView(offset, length);
+}
+
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
-  curDirtyFlag = true;
+  if (mappedFile != NULL)
+    throw ReadOnlyFileException(file->filename());
+  curPage.markDirty();
 }
 
 }
@@ -24,24 +24,84 @@ class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  /**
+   * Opens a scan over the named relation.
+   *
+   * @param name      Relation to scan
+   * @param bufMgr    Buffer manager to read its pages through
+   * @param strategy  Ring to recycle pages through so that the scan does not
+   *                  flush the rest of the pool, or NULL to read normally
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr, BufAccessStrategy *strategy = NULL);
+
+  /**
+   * Opens a scan over the named relation that reads its pages straight from
+   * a read-only mapping of the file, with no buffer pool: nothing is copied
+   * or pinned.  Pages of the relation still dirty in a buffer pool are not
+   * seen, so flush the file first.
+   *
+   * @param name      Relation to scan
+   */
+  explicit FileScan(const std::string &name);
 
   ~FileScan();
 
   //return RecordId of next record that satisfies the scan 
   void scanNext(RecordId& outRid);
 
-  //read current record, returning pointer and length
+  //read current record, returning a copy of it
   std::string getRecord();
 
-  //marks current page of scan dirty
+  //view current record in place, copying nothing; good until the scan
+  //moves on to the next record.  Throws InvalidFieldException on a page in
+  //the PAX layout with more than one column, whose records are not in one
+  //piece; use getFieldView or getRecord there
+  RecordView getRecordView();
+
+  //view the bytes [offset, offset + length) of the current record in place;
+  //on a page in the PAX layout only the column holding them is read
+  RecordView getFieldView(std::size_t offset, std::size_t length);
+
+  //move on to the next page instead of the next record, and view the
+  //bytes [offset, offset + length) of every slot on it in place; on a page
+  //in the PAX layout they are back to back in the column's minipage.  For
+  //relations of fixed-length records only, and not to be mixed with
+  //scanNext on one scan.  Throws EndOfFileException after the last page
+  ColumnView scanNextColumn(std::size_t offset, std::size_t length);
+
+  //marks current page of scan dirty; throws ReadOnlyFileException on a
+  //scan over a mapping
   void markDirty();
 
  private:
+  /**
+   * Reads and pins page curPageNum, first starting to read the pages after
+   * it in the background if the scan has been moving through consecutive
+   * page numbers.
+   *
+   * @param prevPageNum Page the scan was on before, or Page::INVALID_NUMBER
+   */
+  void readCurrentPage(const PageId prevPageNum);
+
+  /**
+   * Returns the current page, or NULL if there is none.
+   */
+  Page* currentPage() const;
+
+  /**
+   * Lets go of the current page.
+   */
+  void releaseCurrentPage();
+
   /**
    * File which is being scanned.
    */
-  PageFile      *file;
+  File          *file;
+
+  /**
+   * The file, if the scan reads it through a mapping, or NULL.
+   */
+  MappedFile    *mappedFile;
 
   /**
    * Buffer Manager instance used to read/write pages into/from buffer pool.
@@ -49,17 +109,47 @@ class FileScan
 	BufMgr				*bufMgr;
 
   /**
-   * Current page being scanned.
+   * Access strategy the pages are read with, or NULL.
+   */
+  BufAccessStrategy *strategy;
+
+  /**
+   * Current page being scanned, and whether it has been updated.
+   */
+  WritePageGuard curPage;
+
+  /**
+   * Current page, where it lies in the mapping, on a scan over a mapping.
+   */
+  const Page    *mappedPage;
+
+  /**
+   * Page number of the current page, or of the last page once the scan has
+   * run off the end.
+   */
+  PageId        curPageNum;
+
+  /**
+   * True once every record has been returned.
    */
-  Page*         curPage;
+  bool          atEnd;
 
-  FileIterator  filePageIter;
   PageIterator  pageRecordIter;
 
   /**
-   * True if page has been updated
+   * Number of pages in a row read at consecutive page numbers, and the last
+   * page number prefetching has been requested up to.
+   */
+  int           sequentialRun;
+  PageId        prefetchedUpTo;
+
+  /**
+   * Number of pages requested per prefetch once the scan is found to be
+   * sequential.  Half the bulk read ring, so that a top-up requested half
+   * way through a window fits in it; the ring itself stops the prefetcher
+   * before it recycles a page the scan has not read.
    */
-  bool  	      curDirtyFlag;
+  static const std::uint32_t PREFETCH_WINDOW = BufAccessStrategy::BULK_READ_RING_SIZE / 2;
 };
 
 }
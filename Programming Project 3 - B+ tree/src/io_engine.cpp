@@ -0,0 +1,372 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_engine.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace badgerdb {
+
+/**
+ * Runs one request on the calling thread.
+ */
+static void runRequest(IORequest& request) {
+  ssize_t moved;
+  do {
+    if (request.write)
+      moved = pwritev(request.fd, request.iov, request.iovcnt, request.pos);
+    else
+      moved = preadv(request.fd, request.iov, request.iovcnt, request.pos);
+  } while (moved < 0 && errno == EINTR);
+  request.result = moved < 0 ? -errno : moved;
+}
+
+/**
+ * @brief An io_uring submission and completion queue pair, mapped into the
+ *        process and driven with raw system calls.  Used by one thread.
+ */
+class UringRing {
+ public:
+  /**
+   * Sets up a ring with room for the given number of requests.  ok() says
+   * whether that worked.
+   */
+  explicit UringRing(const unsigned depth)
+  : fd_(-1), sqMap_(MAP_FAILED), cqMap_(MAP_FAILED), sqes_(NULL)
+  {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = syscall(__NR_io_uring_setup, depth, &params);
+    if (fd_ < 0)
+      return;
+    entries_ = params.sq_entries;
+
+    sqMapLen_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqMapLen_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap && cqMapLen_ > sqMapLen_)
+      sqMapLen_ = cqMapLen_;
+    sqMap_ = mmap(NULL, sqMapLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  fd_, IORING_OFF_SQ_RING);
+    if (sqMap_ == MAP_FAILED)
+      return;
+    if (singleMap)
+      cqMap_ = sqMap_;
+    else
+      cqMap_ = mmap(NULL, cqMapLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd_, IORING_OFF_CQ_RING);
+    if (cqMap_ == MAP_FAILED)
+      return;
+    sqesLen_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, sqesLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+      return;
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqMap_);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cqMap_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+  }
+
+  ~UringRing() {
+    if (sqes_ != NULL)
+      munmap(sqes_, sqesLen_);
+    if (cqMap_ != MAP_FAILED && cqMap_ != sqMap_)
+      munmap(cqMap_, cqMapLen_);
+    if (sqMap_ != MAP_FAILED)
+      munmap(sqMap_, sqMapLen_);
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  bool ok() const { return sqes_ != NULL; }
+
+  void run(IORequest* requests, const std::size_t count) {
+    std::size_t queued = 0;
+    std::size_t completed = 0;
+    unsigned unsubmitted = 0;
+    unsigned inFlight = 0;
+
+    while (completed < count) {
+      // fill the free slots of the submission queue
+      while (queued < count && inFlight + unsubmitted < entries_) {
+        const unsigned tail = *sqTail_;
+        const unsigned index = tail & sqMask_;
+        struct io_uring_sqe* sqe = &sqes_[index];
+        const IORequest& request = requests[queued];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->fd = request.fd;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(request.iov);
+        sqe->len = request.iovcnt;
+        sqe->off = request.pos;
+        sqe->user_data = queued;
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        queued++;
+        unsubmitted++;
+      }
+
+      // hand them to the kernel and wait for at least one to finish
+      const int submitted = syscall(__NR_io_uring_enter, fd_, unsubmitted, 1,
+                                    IORING_ENTER_GETEVENTS, NULL, 0);
+      if (submitted >= 0) {
+        unsubmitted -= submitted;
+        inFlight += submitted;
+      }
+      else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        fail(requests, count, -errno, inFlight);
+        return;
+      }
+
+      unsigned head = *cqHead_;
+      const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++) {
+        const struct io_uring_cqe* cqe = &cqes_[head & cqMask_];
+        requests[cqe->user_data].result = cqe->res;
+        completed++;
+        inFlight--;
+      }
+      __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    }
+  }
+
+ private:
+  /**
+   * Gives up on a batch when the ring itself fails: waits out the requests
+   * the kernel already has, since they still point at the caller's buffers,
+   * and fails the rest.
+   */
+  void fail(IORequest* requests, const std::size_t count, const int error, unsigned inFlight) {
+    for (std::size_t i = 0; i < count; i++)
+      requests[i].result = error;
+    while (inFlight > 0) {
+      if (syscall(__NR_io_uring_enter, fd_, 0, inFlight, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+          errno != EINTR)
+        return;
+      unsigned head = *cqHead_;
+      const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++) {
+        const struct io_uring_cqe* cqe = &cqes_[head & cqMask_];
+        if (cqe->user_data < count)
+          requests[cqe->user_data].result = cqe->res;
+        inFlight--;
+      }
+      __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    }
+  }
+
+  UringRing(const UringRing&);
+  UringRing& operator=(const UringRing&);
+
+  int fd_;
+  unsigned entries_;
+  void* sqMap_;
+  std::size_t sqMapLen_;
+  void* cqMap_;
+  std::size_t cqMapLen_;
+  struct io_uring_sqe* sqes_;
+  std::size_t sqesLen_;
+  unsigned* sqTail_;
+  unsigned sqMask_;
+  unsigned* sqArray_;
+  unsigned* cqHead_;
+  unsigned* cqTail_;
+  unsigned cqMask_;
+  struct io_uring_cqe* cqes_;
+};
+
+/**
+ * Bumped whenever the engine is replaced, so threads set up fresh rings.
+ */
+static std::atomic<unsigned> engineGeneration(0);
+
+/**
+ * @brief IOEngine giving each thread its own io_uring, so threads never wait
+ *        for each other to submit or reap.
+ */
+class UringEngine : public IOEngine {
+ public:
+  explicit UringEngine(const unsigned depth)
+  : IOEngine(depth), generation_(++engineGeneration)
+  {
+  }
+
+  void run(IORequest* requests, const std::size_t count) override {
+    // one request gains nothing from the ring
+    if (count == 1) {
+      runRequest(requests[0]);
+      return;
+    }
+
+    thread_local std::unique_ptr<UringRing> ring;
+    thread_local unsigned ringGeneration = 0;
+    if (!ring || ringGeneration != generation_) {
+      ring.reset(new UringRing(depth_));
+      ringGeneration = generation_;
+    }
+    if (!ring->ok()) {
+      // out of locked memory or the like; do without
+      for (std::size_t i = 0; i < count; i++)
+        runRequest(requests[i]);
+      return;
+    }
+    ring->run(requests, count);
+  }
+
+  IOEngineType type() const override { return URING_ENGINE; }
+
+ private:
+  const unsigned generation_;
+};
+
+/**
+ * @brief IOEngine handing requests to a pool of threads doing blocking
+ *        preadv and pwritev.
+ */
+class ThreadEngine : public IOEngine {
+ public:
+  explicit ThreadEngine(const unsigned depth)
+  : IOEngine(depth), stop_(false)
+  {
+    for (unsigned i = 0; i < depth; i++)
+      workers_.push_back(std::thread(&ThreadEngine::work, this));
+  }
+
+  ~ThreadEngine() {
+    {
+      std::lock_guard<std::mutex> guard(latch_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::size_t i = 0; i < workers_.size(); i++)
+      workers_[i].join();
+  }
+
+  void run(IORequest* requests, const std::size_t count) override {
+    if (count == 1) {
+      runRequest(requests[0]);
+      return;
+    }
+
+    Batch batch;
+    batch.remaining = count;
+    {
+      std::lock_guard<std::mutex> guard(latch_);
+      for (std::size_t i = 0; i < count; i++) {
+        const Job job = {&requests[i], &batch};
+        queue_.push_back(job);
+      }
+    }
+    wake_.notify_all();
+
+    std::unique_lock<std::mutex> lock(batch.latch);
+    while (batch.remaining > 0)
+      batch.done.wait(lock);
+  }
+
+  IOEngineType type() const override { return THREAD_ENGINE; }
+
+ private:
+  struct Batch {
+    std::size_t remaining;
+    std::mutex latch;
+    std::condition_variable done;
+  };
+
+  struct Job {
+    IORequest* request;
+    Batch* batch;
+  };
+
+  void work() {
+    std::unique_lock<std::mutex> lock(latch_);
+    while (true) {
+      while (!stop_ && queue_.empty())
+        wake_.wait(lock);
+      if (stop_)
+        return;
+      const Job job = queue_.front();
+      queue_.pop_front();
+      lock.unlock();
+
+      runRequest(*job.request);
+      {
+        std::lock_guard<std::mutex> guard(job.batch->latch);
+        if (--job.batch->remaining == 0)
+          job.batch->done.notify_one();
+      }
+      lock.lock();
+    }
+  }
+
+  std::deque<Job> queue_;
+  std::mutex latch_;
+  std::condition_variable wake_;
+  bool stop_;
+  std::vector<std::thread> workers_;
+};
+
+/**
+ * The engine in use, set up on first use.  The pointer itself is never
+ * destroyed, so that files closed while the process exits can still use it.
+ */
+static std::shared_ptr<IOEngine>& currentEngine = *new std::shared_ptr<IOEngine>();
+static std::mutex currentEngineLatch;
+
+static IOEngine* createEngine(const IOEngineType type, const unsigned depth) {
+  if (type == URING_ENGINE) {
+    // the kernel may lack io_uring or have it turned off
+    UringRing probe(depth);
+    if (probe.ok())
+      return new UringEngine(depth);
+  }
+  return new ThreadEngine(depth);
+}
+
+std::shared_ptr<IOEngine> IOEngine::get() {
+  std::shared_ptr<IOEngine> engine = std::atomic_load(&currentEngine);
+  if (! engine) {
+    std::lock_guard<std::mutex> guard(currentEngineLatch);
+    engine = currentEngine;
+    if (! engine) {
+      engine.reset(createEngine(URING_ENGINE, DEFAULT_DEPTH));
+      std::atomic_store(&currentEngine, engine);
+    }
+  }
+  return engine;
+}
+
+IOEngineType IOEngine::select(const IOEngineType type, const unsigned depth) {
+  std::lock_guard<std::mutex> guard(currentEngineLatch);
+  const std::shared_ptr<IOEngine> engine(createEngine(type, depth));
+  // the old engine goes once the batches that took it from get() are done
+  std::atomic_store(&currentEngine, engine);
+  return engine->type();
+}
+
+}
@@ -0,0 +1,137 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace badgerdb {
+
+/**
+ * @brief How an IOEngine keeps several reads and writes in flight.
+ */
+enum IOEngineType {
+  /**
+   * An io_uring per thread, set up with raw system calls.
+   */
+  URING_ENGINE,
+
+  /**
+   * A pool of threads each doing preadv and pwritev.  Used where io_uring is
+   * not available.
+   */
+  THREAD_ENGINE
+};
+
+/**
+ * @brief One positional read or write of an IOEngine batch.
+ */
+struct IORequest {
+  /**
+   * File descriptor to read or write.
+   */
+  int fd;
+
+  /**
+   * True to write the buffers, false to read into them.
+   */
+  bool write;
+
+  /**
+   * Buffers to read into or write, back to back in the file.  Owned by the
+   * caller.
+   */
+  struct iovec* iov;
+
+  /**
+   * Number of buffers in iov that are used.
+   */
+  int iovcnt;
+
+  /**
+   * Offset in the file of the first byte.
+   */
+  off_t pos;
+
+  /**
+   * Set by the engine to the number of bytes moved, or to -errno if the
+   * request failed.  A read at the end of the file moves fewer bytes than
+   * asked for, and a write may too; finishing those is up to the caller.
+   */
+  ssize_t result;
+};
+
+/**
+ * @brief Runs batches of file reads and writes with many of them in flight,
+ *        instead of one after another.
+ *
+ * There is one engine for the whole process.  It can be used from any number
+ * of threads at once.
+ */
+class IOEngine {
+ public:
+  /**
+   * Number of requests kept in flight unless select() says otherwise.
+   */
+  static const unsigned DEFAULT_DEPTH = 32;
+
+  /**
+   * Returns the engine, setting up an io_uring one on first use, or a thread
+   * pool if the kernel does not allow io_uring.  The engine lives at least as
+   * long as the returned reference, even if select() replaces it meanwhile.
+   */
+  static std::shared_ptr<IOEngine> get();
+
+  /**
+   * Replaces the engine.  Batches already running on the old one finish on
+   * it, and it is shut down once the last of them is done.
+   *
+   * @param type    Kind of engine wanted.
+   * @param depth   Number of requests to keep in flight.
+   * @return  The kind of engine set up, which is THREAD_ENGINE if io_uring
+   *          was wanted but is not available.
+   */
+  static IOEngineType select(const IOEngineType type, const unsigned depth = DEFAULT_DEPTH);
+
+  virtual ~IOEngine() {}
+
+  /**
+   * Runs the given requests, up to depth() of them at a time, and returns
+   * once all have finished.  Each request's result says how it went.
+   *
+   * @param requests  Requests to run.
+   * @param count     Number of requests.
+   */
+  virtual void run(IORequest* requests, const std::size_t count) = 0;
+
+  /**
+   * Returns the kind of engine this is.
+   */
+  virtual IOEngineType type() const = 0;
+
+  /**
+   * Returns the number of requests kept in flight.
+   */
+  unsigned depth() const { return depth_; }
+
+ protected:
+  explicit IOEngine(const unsigned depth) : depth_(depth) {}
+
+  /**
+   * Number of requests kept in flight.
+   */
+  const unsigned depth_;
+
+ private:
+  IOEngine(const IOEngine&);
+  IOEngine& operator=(const IOEngine&);
+};
+
+}
@@ -5,6 +5,7 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <vector>
 #include "btree.h"
 #include "page.h"
@@ -19,6 +20,7 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/invalid_record_length_exception.h"
 
 #define checkPassFail(a, b)                                               \
     \
@@ -43,6 +45,8 @@ using namespace badgerdb;
 const std::string relationName = "relA";
 //If the relation size is changed then the second parameter 2 chechPassFail may need to be changed to number of record that are expected to be found during the scan, else tests will erroneously be reported to have failed.
 const int relationSize = 5000;
+// Number of distinct pages intScan collects RIDs for before fetching their records.
+const size_t SCAN_BATCH_PAGES = 8;
 std::string intIndexName, doubleIndexName, stringIndexName;
 
 // This is the structure for tuples in the base relation
@@ -72,12 +76,16 @@ void createRelationForwardNegative(int negNum);
 void createRelationBackward(int size);
 void createRelationBackwardNegative(int negNum);
 void createRelationRandom(int size);
-void intTests();
+void createRelationForwardFixed();
+void createRelationForwardPax();
+void fillRelationForward();
+void intTests(const bool mappedScan = false);
 void intTests1();
 void intTests0();
 void intTests2();
 int intScan(BTreeIndex* index, int lowVal, Operator lowOp, int highVal, Operator highOp);
-void indexTests();
+long long intColumnSum(FileScan& scan);
+void indexTests(const bool mappedScan = false);
 void indexTests0();
 void indexTests1();
 void indexTests2();
@@ -89,6 +97,8 @@ void test5();
 void test6();
 void test7();
 void test8();
+void test9();
+void test10();
 void errorTests();
 void deleteRelation();
 
@@ -152,6 +162,8 @@ int main(int argc, char** argv)
     test6();
     test7();
     test8();
+    test9();
+    test10();
     errorTests();
 
     delete bufMgr;
@@ -247,6 +259,58 @@ void test8()
     deleteRelation();
 }
 
+void test9()
+{
+    // Create a relation of fixed-length records with tuples valued 0 to relationSize
+    // and perform index tests on it
+    std::cout << "--------------------" << std::endl;
+    std::cout << "createRelationForward fixed-length" << std::endl;
+    createRelationForwardFixed();
+    indexTests();
+    deleteRelation();
+
+    // A record length no page can hold is refused before any file is made
+    std::cout << "Record lengths of 0 and over a page's data size should be rejected" << std::endl;
+    int rejected = 0;
+    const std::size_t badLengths[] = {0, Page::DATA_SIZE + 1};
+    for (std::size_t i = 0; i < sizeof(badLengths) / sizeof(badLengths[0]); i++) {
+        try {
+            PageFile::create(relationName, badLengths[i]);
+        }
+        catch (const InvalidRecordLengthException& e) {
+            rejected++;
+        }
+    }
+    checkPassFail(rejected, 2)
+    checkPassFail(File::exists(relationName), false)
+}
+
+void test10()
+{
+    // Create a relation in the PAX layout with tuples valued 0 to relationSize, one
+    // column per field, and perform index tests on it, building the index through
+    // the buffer pool and through a mapping of the relation
+    std::cout << "--------------------" << std::endl;
+    std::cout << "createRelationForward PAX" << std::endl;
+    createRelationForwardPax();
+    indexTests();
+    indexTests(true);
+
+    // The integer column, read a page at a time through the pool and through a
+    // mapping, adds up to 0 + 1 + ... + (relationSize - 1)
+    std::cout << "Sum of the integer column" << std::endl;
+    const long long expectedSum = (long long)relationSize * (relationSize - 1) / 2;
+    {
+        FileScan scan(relationName, bufMgr);
+        checkPassFail(intColumnSum(scan), expectedSum)
+    }
+    {
+        FileScan scan(relationName);
+        checkPassFail(intColumnSum(scan), expectedSum)
+    }
+    deleteRelation();
+}
+
 // -----------------------------------------------------------------------------
 // createRelationForward
 // -----------------------------------------------------------------------------
@@ -618,13 +682,79 @@ void createRelationRandom(int size)
     file1->writePage(new_page_number, new_page);
 }
 
+// -----------------------------------------------------------------------------
+// createRelationForwardFixed
+// -----------------------------------------------------------------------------
+
+void createRelationForwardFixed()
+{
+    // destroy any old copies of relation file
+    try {
+        File::remove(relationName);
+    }
+    catch (const FileNotFoundException& e) {
+    }
+
+    // every record is a RECORD, so pages hold them as fixed-length records
+    file1 = new PageFile(PageFile::create(relationName, sizeof(RECORD)));
+    fillRelationForward();
+}
+
+void createRelationForwardPax()
+{
+    // destroy any old copies of relation file
+    try {
+        File::remove(relationName);
+    }
+    catch (const FileNotFoundException& e) {
+    }
+
+    // one column for i and its padding, one for d and one for s
+    std::vector<std::uint16_t> columnLengths;
+    columnLengths.push_back(offsetof(RECORD, d));
+    columnLengths.push_back(sizeof(record1.d));
+    columnLengths.push_back(sizeof(record1.s));
+    file1 = new PageFile(PageFile::create(relationName, columnLengths));
+    fillRelationForward();
+}
+
+void fillRelationForward()
+{
+    // initialize all of record1.s to keep purify happy
+    memset(record1.s, ' ', sizeof(record1.s));
+    PageId new_page_number;
+    Page new_page = file1->allocatePage(new_page_number);
+
+    // Insert tuples valued 0 to relationSize into file1 in forward order.
+    for (int i = 0; i < relationSize; i++) {
+        sprintf(record1.s, "%05d string record", i);
+        record1.i = i;
+        record1.d = (double)i;
+        std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+
+        while (1) {
+            try {
+                new_page.insertRecord(new_data);
+
+                break;
+            }
+            catch (const InsufficientSpaceException& e) {
+
+                file1->writePage(new_page_number, new_page);
+                new_page = file1->allocatePage(new_page_number);
+            }
+        }
+    }
+    file1->writePage(new_page_number, new_page);
+}
+
 // -----------------------------------------------------------------------------
 // indexTests
 // -----------------------------------------------------------------------------
 
-void indexTests()
+void indexTests(const bool mappedScan)
 {
-    intTests();
+    intTests(mappedScan);
     try {
         File::remove(intIndexName);
     }
@@ -666,10 +796,10 @@ void indexTests2()
 // intTests
 // -----------------------------------------------------------------------------
 
-void intTests()
+void intTests(const bool mappedScan)
 {
     std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, mappedScan);
 
     // run some tests
     checkPassFail(intScan(&index, 0, GT, 5, LT), 4)
@@ -720,7 +850,6 @@ void intTests2()
 int intScan(BTreeIndex* index, int lowVal, Operator lowOp, int highVal, Operator highOp)
 {
     RecordId scanRid;
-    Page* curPage;
 
     std::cout << "Scan for ";
     if (lowOp == GT) {
@@ -748,26 +877,52 @@ int intScan(BTreeIndex* index, int lowVal, Operator lowOp, int highVal, Operator
         return 0;
     }
 
-    while (1) {
+    // Fetch the records a batch of RIDs at a time, so that each page is
+    // looked up and pinned once per batch.  A batch spans a few pages at
+    // most, which must all fit in the buffer pool at once.
+    std::vector<RecordId> rids;
+    std::vector<PageId> pageNos;
+    std::vector<PageId> distinctPageNos;
+    std::vector<Page*> pages;
+    bool completed = false;
+
+    while (!completed) {
+        rids.clear();
+        pageNos.clear();
+        distinctPageNos.clear();
         try {
-            index->scanNext(scanRid);
-            bufMgr->readPage(file1, scanRid.page_number, curPage);
-            RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
-            bufMgr->unPinPage(file1, scanRid.page_number, false);
+            while (distinctPageNos.size() < SCAN_BATCH_PAGES) {
+                index->scanNext(scanRid);
+                if (std::find(distinctPageNos.begin(), distinctPageNos.end(), scanRid.page_number)
+                    == distinctPageNos.end()) {
+                    distinctPageNos.push_back(scanRid.page_number);
+                }
+                rids.push_back(scanRid);
+                pageNos.push_back(scanRid.page_number);
+            }
+        }
+        catch (const IndexScanCompletedException& e) {
+            completed = true;
+        }
+        if (rids.empty()) {
+            break;
+        }
+
+        bufMgr->readPages(file1, pageNos, pages);
+        for (size_t k = 0; k < rids.size(); k++) {
+            RECORD myRec = *(reinterpret_cast<const RECORD*>(pages[k]->getRecord(rids[k]).data()));
 
             if (numResults < 5) {
-                std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+                std::cout << "at:" << rids[k].page_number << "," << rids[k].slot_number;
                 std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
             }
             else if (numResults == 5) {
                 std::cout << "..." << std::endl;
             }
-        }
-        catch (const IndexScanCompletedException& e) {
-            break;
-        }
 
-        numResults++;
+            numResults++;
+        }
+        bufMgr->unPinPages(file1, pageNos, false);
     }
 
     if (numResults >= 5) {
@@ -779,6 +934,30 @@ int intScan(BTreeIndex* index, int lowVal, Operator lowOp, int highVal, Operator
     return numResults;
 }
 
+// -----------------------------------------------------------------------------
+// intColumnSum
+// -----------------------------------------------------------------------------
+
+long long intColumnSum(FileScan& scan)
+{
+    long long sum = 0;
+    try {
+        while (1) {
+            const ColumnView column = scan.scanNextColumn(offsetof(RECORD, i), sizeof(record1.i));
+            for (SlotId slot = 1; slot <= column.num_slots(); slot++) {
+                if (column.isUsed(slot)) {
+                    int value;
+                    memcpy(&value, column.value(slot), sizeof(value));
+                    sum += value;
+                }
+            }
+        }
+    }
+    catch (const EndOfFileException& e) {
+    }
+    return sum;
+}
+
 // -----------------------------------------------------------------------------
 // errorTests
 // -----------------------------------------------------------------------------
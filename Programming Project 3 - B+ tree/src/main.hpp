@@ -10,6 +10,8 @@
  *     <li> @ref prereq_sec
  *     <li> @ref commands_sec
  *     <li> @ref modify_run_main_sec
+ *     <li> @ref tests_sec
+ *     <li> @ref benchmarks_sec
  *     <li> @ref documentation_sec
  *   </ol>
  *   <li> @ref api_sec
@@ -68,6 +70,26 @@
  * If you want to edit what <code>badgerdb_main</code> does, edit
  * <code>src/main.cpp</code>.
  *
+ * @subsection tests_sec Running the tests
+ *
+ * Besides the index tests in <code>src/main.cpp</code>, unit tests of the page
+ * layout live in <code>src/page_test.cpp</code>, of page allocation in files
+ * in <code>src/file_test.cpp</code>, and of the buffer manager's batch calls
+ * in <code>src/buffer_test.cpp</code>.  Build and run them with:
+ * @code
+ *   $ make test
+ * @endcode
+ *
+ * @subsection benchmarks_sec Running the benchmarks
+ *
+ * Performance benchmarks for the storage layer live in
+ * <code>src/bench.cpp</code>.  Build and run all of them, or just one by name:
+ * @code
+ *   $ make bench
+ *   $ ./src/badgerdb_bench
+ *   $ ./src/badgerdb_bench concurrent
+ * @endcode
+ *
  * @subsection documentation_sec Rebuilding the documentation
  *
  * Documentation is generated by using Doxygen.  If you have updated the
@@ -5,11 +5,14 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <cassert>
 
 #include <iostream>
 #include "exceptions/insufficient_space_exception.h"
+#include "exceptions/invalid_field_exception.h"
 #include "exceptions/invalid_record_exception.h"
+#include "exceptions/invalid_record_length_exception.h"
 #include "exceptions/invalid_slot_exception.h"
 #include "exceptions/slot_in_use_exception.h"
 #include "page_iterator.h"
@@ -18,42 +21,192 @@
 
 namespace badgerdb {
 
+/**
+ * Lays out the minipages of a page in the PAX layout after its column
+ * directory, each on an 8-byte boundary so that the values of every column
+ * are aligned.
+ *
+ * @param column_lengths  Lengths of the columns.
+ * @param num_columns     Number of columns.
+ * @param num_slots       Number of slots each minipage has room for.
+ * @param begin           Offset of the column directory, after the slot map.
+ * @param columns         Column directory to fill in, or NULL.
+ * @return  Offset of the end of the last minipage.
+ */
+static std::size_t layoutColumns(const std::uint16_t* column_lengths,
+                                 const std::uint16_t num_columns,
+                                 const std::size_t num_slots,
+                                 const std::size_t begin,
+                                 PageColumn* columns) {
+  std::size_t offset = begin + ((num_columns * sizeof(PageColumn) + 7) & ~std::size_t(7));
+  std::size_t record_offset = 0;
+  for (std::uint16_t i = 0; i < num_columns; ++i) {
+    if (columns != NULL) {
+      columns[i].record_offset = record_offset;
+      columns[i].length = column_lengths[i];
+      columns[i].offset = offset;
+    }
+    record_offset += column_lengths[i];
+    offset += (num_slots * column_lengths[i] + 7) & ~std::size_t(7);
+  }
+  return offset;
+}
+
 Page::Page() {
   initialize();
 }
 
-void Page::initialize() {
+SlotId Page::capacity(const std::size_t record_length,
+                      const std::uint16_t* column_lengths,
+                      const std::uint16_t num_columns) {
+  // Each record takes at least its length and a bit of the slot map, so no
+  // more than this many fit; the map's last word and the minipages' padding
+  // may take a few fewer.
+  std::size_t num_slots = DATA_SIZE * 8 / (record_length * 8 + 1);
+  while (num_slots > 0) {
+    const std::size_t map_size = numSlotMapWords(num_slots) * sizeof(std::uint64_t);
+    const std::size_t end = num_columns > 0
+        ? layoutColumns(column_lengths, num_columns, num_slots, map_size, NULL)
+        : map_size + num_slots * record_length;
+    if (end <= DATA_SIZE) {
+      break;
+    }
+    --num_slots;
+  }
+  return num_slots;
+}
+
+void Page::initialize(const std::uint16_t record_length,
+                      const std::uint16_t* column_lengths,
+                      const std::uint16_t num_columns) {
+  // Clear the padding too, so equal headers compare equal byte for byte.
+  memset(&header_, 0, sizeof(header_));
   header_.free_space_lower_bound = 0;
   header_.free_space_upper_bound = DATA_SIZE;
+  header_.fragmented_space = 0;
   header_.num_slots = 0;
   header_.num_free_slots = 0;
+  header_.first_free_slot = INVALID_SLOT;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
+  header_.prev_page_number = INVALID_NUMBER;
+  header_.record_length = record_length;
+  header_.num_columns = num_columns;
+  if (record_length > 0) {
+    // Every slot a page of fixed-length records can have is there from the
+    // start, one per element of the record array, or of each minipage.
+    header_.num_slots = capacity(record_length, column_lengths, num_columns);
+    header_.num_free_slots = header_.num_slots;
+  }
   //data_.assign(DATA_SIZE, char());
 	memset(data_, '\0', DATA_SIZE);
+  if (num_columns > 0) {
+    layoutColumns(column_lengths, num_columns, header_.num_slots, slotMapSize(),
+                  reinterpret_cast<PageColumn*>(data_ + slotMapSize()));
+  }
 }
 
 RecordId Page::insertRecord(const std::string& record_data) {
+  validateRecordLength(record_data);
   if (!hasSpaceForRecord(record_data)) {
     throw InsufficientSpaceException(
         page_number(), record_data.length(), getFreeSpace());
   }
+  if (header_.record_length > 0) {
+    const SlotId slot_number = firstUnusedSlot();
+    setSlotUsed(slot_number, true);
+    --header_.num_free_slots;
+    writeFixedRecord(slot_number, record_data);
+    return {page_number(), slot_number};
+  }
+  // A new slot takes room from the same free space as the record, so make
+  // the room for both before the slot array grows.
+  std::size_t record_size = record_data.length();
+  if (header_.num_free_slots == 0) {
+    record_size += newSlotSize();
+  }
+  reserveContiguousSpace(record_size);
   const SlotId slot_number = getAvailableSlot();
   insertRecordInSlot(slot_number, record_data);
   return {page_number(), slot_number};
 }
 
 std::string Page::getRecord(const RecordId& record_id) const {
+  if (header_.num_columns > 0) {
+    // Gather the record back together from its columns.
+    validateRecordId(record_id);
+    std::string record(header_.record_length, '\0');
+    for (std::uint16_t i = 0; i < header_.num_columns; ++i) {
+      const PageColumn& column = getColumn(i);
+      memcpy(&record[column.record_offset],
+             &data_[column.offset + (record_id.slot_number - 1) * column.length],
+             column.length);
+    }
+    return record;
+  }
+  return getRecordView(record_id).str();
+}
+
+RecordView Page::getRecordView(const RecordId& record_id) const {
+  if (header_.num_columns > 0) {
+    // Split into columns, a record is only in one piece if it has one column.
+    return getFieldView(record_id, 0, header_.record_length);
+  }
   validateRecordId(record_id);
+  if (header_.record_length > 0) {
+    return RecordView(data_ + fixedRecordOffset(record_id.slot_number),
+                      header_.record_length);
+  }
   const PageSlot& slot = getSlot(record_id.slot_number);
-	std::string retStr = std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
+  return RecordView(data_ + slot.item_offset, slot.item_length);
+}
 
-	return retStr;
+RecordView Page::getFieldView(const RecordId& record_id,
+                              const std::size_t offset,
+                              const std::size_t length) const {
+  if (header_.num_columns > 0) {
+    validateRecordId(record_id);
+    const PageColumn* column = findColumn(offset, length);
+    if (column == NULL) {
+      throw InvalidFieldException(page_number(), offset, length);
+    }
+    return RecordView(data_ + column->offset +
+                          (record_id.slot_number - 1) * column->length +
+                          (offset - column->record_offset),
+                      length);
+  }
+  const RecordView record = getRecordView(record_id);
+  if (offset + length > record.size()) {
+    throw InvalidFieldException(page_number(), offset, length);
+  }
+  return RecordView(record.data() + offset, length);
+}
+
+ColumnView Page::getColumnView(const std::size_t offset,
+                               const std::size_t length) const {
+  if (header_.record_length == 0 || offset + length > header_.record_length) {
+    throw InvalidFieldException(page_number(), offset, length);
+  }
+  if (header_.num_columns > 0) {
+    const PageColumn* column = findColumn(offset, length);
+    if (column == NULL) {
+      throw InvalidFieldException(page_number(), offset, length);
+    }
+    return ColumnView(data_ + column->offset + (offset - column->record_offset),
+                      column->length, header_.num_slots, &slotMapWord(0));
+  }
+  return ColumnView(data_ + fixedRecordOffset(1) + offset, header_.record_length,
+                    header_.num_slots, &slotMapWord(0));
 }
 
 void Page::updateRecord(const RecordId& record_id,
                         const std::string& record_data) {
   validateRecordId(record_id);
+  validateRecordLength(record_data);
+  if (header_.record_length > 0) {
+    writeFixedRecord(record_id.slot_number, record_data);
+    return;
+  }
   const PageSlot* slot = getSlot(record_id.slot_number);
   const std::size_t free_space_after_delete =
       getFreeSpace() + slot->item_length;
@@ -75,101 +228,240 @@ void Page::deleteRecord(const RecordId& record_id) {
 void Page::deleteRecord(const RecordId& record_id,
                         const bool allow_slot_compaction) {
   validateRecordId(record_id);
-  PageSlot* slot = getSlot(record_id.slot_number);
-
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = '\0';
-
-  //data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
-
-  // Compact the data by removing the hole left by this record (if necessary).
-  std::uint16_t move_offset = slot->item_offset; 
-  std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
-    PageSlot* other_slot = getSlot(i);
-    if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-      if (other_slot->item_offset < move_offset) {
-        move_offset = other_slot->item_offset;
-      }
-      move_bytes += other_slot->item_length;
-      // Update the slot for the other data to reflect the soon-to-be-new
-      // location.
-      other_slot->item_offset += slot->item_length;
-    }
+  if (header_.record_length > 0) {
+    // The record's space stays with its slot.
+    setSlotUsed(record_id.slot_number, false);
+    ++header_.num_free_slots;
+    return;
   }
-  // If we have data to move, shift it to the right.
-  if (move_bytes > 0) {
-    const std::string& data_to_move = std::string(data_, DATA_SIZE).substr(move_offset, move_bytes);
-
-		for(std::uint16_t i = 0; i < move_bytes; i++)
-			data_[i + move_offset + slot->item_length] = data_to_move[i];
+  PageSlot* slot = getSlot(record_id.slot_number);
 
-    //data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
+  // Leave the record where it is; its space is reclaimed when an insert needs
+  // it.  Only the lowest record can be given back right away.
+  if (slot->item_offset == header_.free_space_upper_bound) {
+    header_.free_space_upper_bound += slot->item_length;
+  } else {
+    header_.fragmented_space += slot->item_length;
   }
-  header_.free_space_upper_bound += slot->item_length;
 
   // Mark slot as unused.
-  slot->used = false;
-  slot->item_offset = 0;
-  slot->item_length = 0;
+  setSlotUsed(record_id.slot_number, false);
+  linkFreeSlot(record_id.slot_number);
   ++header_.num_free_slots;
 
   if (allow_slot_compaction && record_id.slot_number == header_.num_slots) {
     // Last slot in the list, so we need to free any unused slots that are at
-    // the end of the slot list.
-    int num_slots_to_delete = 1;
-    for (SlotId i = 1; i < header_.num_slots; ++i) {
-      // Traverse list backwards, looking for unused slots.
-      const PageSlot* other_slot = getSlot(header_.num_slots - i);
-      if (!other_slot->used) {
-        ++num_slots_to_delete;
-      } else {
-        // Stop at the first used slot we find, since we can't move used slots
-        // without affecting record IDs.
+    // the end of the slot list.  We can't move used slots without affecting
+    // record IDs, so stop at the last used slot, found from the slot map.
+    SlotId last_used_slot = INVALID_SLOT;
+    for (std::size_t word = (header_.num_slots - 1) / 64 + 1; word > 0; --word) {
+      const std::uint64_t bits = slotMapWord(word - 1);
+      if (bits != 0) {
+        last_used_slot = (word - 1) * 64 + 64 - __builtin_clzll(bits);
         break;
       }
     }
+    for (SlotId i = last_used_slot + 1; i <= header_.num_slots; ++i) {
+      unlinkFreeSlot(i);
+    }
+    const int num_slots_to_delete = header_.num_slots - last_used_slot;
+    const std::size_t old_map_size = slotMapSize();
     header_.num_slots -= num_slots_to_delete;
+    if (slotMapSize() < old_map_size) {
+      // The slot map lost words, so the slot array moves down after it.
+      memmove(&data_[slotMapSize()], &data_[old_map_size],
+              header_.num_slots * sizeof(PageSlot));
+    }
     header_.num_free_slots -= num_slots_to_delete;
-    header_.free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
+    header_.free_space_lower_bound = slotArrayEnd(header_.num_slots);
+  }
+}
+
+void Page::reserveContiguousSpace(const std::size_t bytes) {
+  const std::size_t contiguous =
+      header_.free_space_upper_bound - header_.free_space_lower_bound;
+  if (contiguous < bytes && header_.fragmented_space > 0) {
+    compact();
   }
 }
 
+void Page::compact() {
+  // Offsets and slots of the records, highest offset first, so each record
+  // is moved up over space already vacated.  Runs of records that are
+  // already next to each other are moved together.
+  struct Item {
+    std::uint16_t offset;
+    std::uint16_t length;
+    SlotId slot_number;
+    bool operator<(const Item& rhs) const { return offset > rhs.offset; }
+  };
+  Item items[MAX_SLOTS];
+  std::size_t num_items = 0;
+  const std::size_t num_words = numSlotMapWords(header_.num_slots);
+  for (std::size_t word = 0; word < num_words; ++word) {
+    for (std::uint64_t bits = slotMapWord(word); bits != 0; bits &= bits - 1) {
+      const SlotId slot_number = word * 64 + __builtin_ctzll(bits) + 1;
+      const PageSlot* slot = getSlot(slot_number);
+      items[num_items].offset = slot->item_offset;
+      items[num_items].length = slot->item_length;
+      items[num_items].slot_number = slot_number;
+      ++num_items;
+    }
+  }
+  std::sort(items, items + num_items);
+
+  std::uint16_t top = DATA_SIZE;
+  std::size_t run = 0;
+  while (run < num_items) {
+    // Gather the run of records adjacent to the first one, going down.
+    const std::uint16_t run_end = items[run].offset + items[run].length;
+    std::uint16_t run_begin = items[run].offset;
+    std::size_t next = run + 1;
+    while (next < num_items &&
+           items[next].offset + items[next].length == run_begin) {
+      run_begin = items[next].offset;
+      ++next;
+    }
+    const std::uint16_t shift = top - run_end;
+    if (shift > 0) {
+      memmove(&data_[run_begin + shift], &data_[run_begin], run_end - run_begin);
+      for (std::size_t i = run; i < next; ++i) {
+        getSlot(items[i].slot_number)->item_offset += shift;
+      }
+    }
+    top = run_begin + shift;
+    run = next;
+  }
+  header_.free_space_upper_bound = top;
+  header_.fragmented_space = 0;
+}
+
 bool Page::hasSpaceForRecord(const std::string& record_data) const {
+  if (header_.record_length > 0) {
+    return record_data.length() == header_.record_length &&
+        header_.num_free_slots > 0;
+  }
   std::size_t record_size = record_data.length();
   if (header_.num_free_slots == 0) {
-    record_size += sizeof(PageSlot);
+    record_size += newSlotSize();
   }
   return record_size <= getFreeSpace();
 }
 
+SlotId Page::nextUsedSlot(const SlotId start) const {
+  // Bit i of the map is slot i + 1, so the search starts at bit <start>.
+  const std::size_t num_words = numSlotMapWords(header_.num_slots);
+  std::size_t word = start / 64;
+  if (word >= num_words) {
+    return INVALID_SLOT;
+  }
+  std::uint64_t bits = slotMapWord(word) & (~std::uint64_t(0) << (start % 64));
+  while (bits == 0) {
+    if (++word == num_words) {
+      return INVALID_SLOT;
+    }
+    bits = slotMapWord(word);
+  }
+  return word * 64 + __builtin_ctzll(bits) + 1;
+}
+
+SlotId Page::firstUnusedSlot() const {
+  std::size_t word = 0;
+  while (slotMapWord(word) == ~std::uint64_t(0)) {
+    ++word;
+  }
+  const SlotId slot_number = word * 64 + __builtin_ctzll(~slotMapWord(word)) + 1;
+  assert(slot_number <= header_.num_slots);
+  return slot_number;
+}
+
+const PageColumn* Page::findColumn(const std::size_t offset,
+                                   const std::size_t length) const {
+  for (std::uint16_t i = 0; i < header_.num_columns; ++i) {
+    const PageColumn& column = getColumn(i);
+    if (column.record_offset <= offset &&
+        offset + length <= std::size_t(column.record_offset) + column.length) {
+      return &column;
+    }
+  }
+  return NULL;
+}
+
+void Page::writeFixedRecord(const SlotId slot_number,
+                            const std::string& record_data) {
+  if (header_.num_columns == 0) {
+    memcpy(&data_[fixedRecordOffset(slot_number)], record_data.data(),
+           header_.record_length);
+    return;
+  }
+  for (std::uint16_t i = 0; i < header_.num_columns; ++i) {
+    const PageColumn& column = getColumn(i);
+    memcpy(&data_[column.offset + (slot_number - 1) * column.length],
+           record_data.data() + column.record_offset, column.length);
+  }
+}
+
+void Page::validateRecordLength(const std::string& record_data) const {
+  if (header_.record_length > 0 &&
+      record_data.length() != header_.record_length) {
+    throw InvalidRecordLengthException(page_number(), record_data.length(),
+                                       header_.record_length);
+  }
+}
+
+void Page::linkFreeSlot(const SlotId slot_number) {
+  PageSlot* slot = getSlot(slot_number);
+  slot->item_offset = header_.first_free_slot;
+  slot->item_length = INVALID_SLOT;
+  if (header_.first_free_slot != INVALID_SLOT) {
+    getSlot(header_.first_free_slot)->item_length = slot_number;
+  }
+  header_.first_free_slot = slot_number;
+}
+
+void Page::unlinkFreeSlot(const SlotId slot_number) {
+  const PageSlot* slot = getSlot(slot_number);
+  const SlotId next = slot->item_offset;
+  const SlotId prev = slot->item_length;
+  if (next != INVALID_SLOT) {
+    getSlot(next)->item_length = prev;
+  }
+  if (prev != INVALID_SLOT) {
+    getSlot(prev)->item_offset = next;
+  } else {
+    header_.first_free_slot = next;
+  }
+}
+
 PageSlot* Page::getSlot(const SlotId slot_number) {
-  return reinterpret_cast<PageSlot*>(&data_[(slot_number - 1) * sizeof(PageSlot)]);
+  return reinterpret_cast<PageSlot*>(
+      &data_[slotMapSize() + (slot_number - 1) * sizeof(PageSlot)]);
 }
 
 const PageSlot& Page::getSlot(const SlotId slot_number) const {
-  return *reinterpret_cast<const PageSlot*>(&data_[(slot_number - 1) * sizeof(PageSlot)]);
+  return *reinterpret_cast<const PageSlot*>(
+      &data_[slotMapSize() + (slot_number - 1) * sizeof(PageSlot)]);
 }
 
 SlotId Page::getAvailableSlot() {
-  SlotId slot_number = INVALID_SLOT;
-  if (header_.num_free_slots > 0) {
-    // Have an allocated but unused slot that we can reuse.
-    for (SlotId i = 1; i <= header_.num_slots; ++i) {
-      const PageSlot* slot = getSlot(i);
-      if (!slot->used) {
-        // We don't decrement the number of free slots until someone actually
-        // puts data in the slot.
-        slot_number = i;
-        break;
-      }
-    }
-  } else {
-    // Have to allocate a new slot.
+  SlotId slot_number = header_.first_free_slot;
+  if (slot_number == INVALID_SLOT) {
+    // Have to allocate a new slot.  We don't decrement the number of free
+    // slots until someone actually puts data in the slot.
+    assert(header_.num_slots < MAX_SLOTS);
     slot_number = header_.num_slots + 1;
+    if (header_.num_slots % 64 == 0) {
+      // The slot needs another word of the slot map, so the slot array moves
+      // up to make room for it.
+      const std::size_t map_size = slotMapSize();
+      memmove(&data_[map_size + sizeof(std::uint64_t)], &data_[map_size],
+              header_.num_slots * sizeof(PageSlot));
+      slotMapWord(header_.num_slots / 64) = 0;
+    }
     ++header_.num_slots;
     ++header_.num_free_slots;
-    header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    header_.free_space_lower_bound = slotArrayEnd(header_.num_slots);
+    linkFreeSlot(slot_number);
   }
   assert(slot_number != INVALID_SLOT);
   return slot_number;
@@ -181,29 +473,29 @@ void Page::insertRecordInSlot(const SlotId slot_number,
       slot_number == INVALID_SLOT) {
     throw InvalidSlotException(page_number(), slot_number);
   }
-  PageSlot* slot = getSlot(slot_number);
-  if (slot->used) {
+  if (isSlotUsed(slot_number)) {
     throw SlotInUseException(page_number(), slot_number);
   }
   const int record_length = record_data.length();
-  slot->used = true;
+  reserveContiguousSpace(record_length);
+  unlinkFreeSlot(slot_number);
+  setSlotUsed(slot_number, true);
+  PageSlot* slot = getSlot(slot_number);
   slot->item_length = record_length;
   slot->item_offset = header_.free_space_upper_bound - record_length;
   header_.free_space_upper_bound = slot->item_offset;
   --header_.num_free_slots;
 
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = record_data[i];
-
-  //data_.replace(slot->item_offset, slot->item_length, record_data);
+  memcpy(&data_[slot->item_offset], record_data.data(), record_length);
 }
 
 void Page::validateRecordId(const RecordId& record_id) const {
   if (record_id.page_number != page_number()) {
     throw InvalidRecordException(record_id, page_number());
   }
-  const PageSlot& slot = getSlot(record_id.slot_number);
-  if (!slot.used) {
+  if (record_id.slot_number == INVALID_SLOT ||
+      record_id.slot_number > header_.num_slots ||
+      !isSlotUsed(record_id.slot_number)) {
     throw InvalidRecordException(record_id, page_number());
   }
 }
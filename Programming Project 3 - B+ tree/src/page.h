@@ -8,6 +8,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstring>
 #include <stdint.h>
 #include <memory>
 #include <string>
@@ -21,9 +22,10 @@ namespace badgerdb {
  * @brief Header metadata in a page.
  *
  * Header metadata in each page which tracks where space has been used and
- * contains a pointer to the next page in the file.
+ * contains a pointer to the next page in the file.  It is aligned so that the
+ * data after it, which starts with the slot map, is too.
  */
-struct PageHeader {
+struct alignas(8) PageHeader {
   /**
    * Lower bound of the free space.  This is the offset of the first unused byte
    * after the slot array.
@@ -36,6 +38,13 @@ struct PageHeader {
    */
   std::uint16_t free_space_upper_bound;
 
+  /**
+   * Bytes of deleted records above the free space upper bound that have not
+   * been reclaimed yet.  They are counted as free space, and the records are
+   * compacted to join them to the free space once an insert needs it.
+   */
+  std::uint16_t fragmented_space;
+
   /**
    * Number of slots currently allocated.  This number may include slots which
    * are unused but are in the middle of the slot array (due to record
@@ -48,6 +57,25 @@ struct PageHeader {
    */
   SlotId num_free_slots;
 
+  /**
+   * First slot of the list of slots allocated but not in use, or
+   * Page::INVALID_SLOT if there are none.
+   */
+  SlotId first_free_slot;
+
+  /**
+   * Length of every record on a page of fixed-length records, or 0 on a
+   * slotted page.
+   */
+  std::uint16_t record_length;
+
+  /**
+   * Number of columns the records of a page of fixed-length records are split
+   * into, each column kept apart in a minipage (the PAX layout), or 0 if the
+   * records are kept whole.
+   */
+  std::uint16_t num_columns;
+
   /**
    * Number of the page within the file.
    */
@@ -58,6 +86,12 @@ struct PageHeader {
    */
   PageId next_page_number;
 
+  /**
+   * Number of the previous used page in the file.  Lets a page be unlinked
+   * from the used list without walking it.
+   */
+  PageId prev_page_number;
+
   /**
    * Returns true if this page header is equal to the other.
    *
@@ -68,33 +102,228 @@ struct PageHeader {
     return num_slots == rhs.num_slots &&
         num_free_slots == rhs.num_free_slots &&
         current_page_number == rhs.current_page_number &&
-        next_page_number == rhs.next_page_number;
+        next_page_number == rhs.next_page_number &&
+        prev_page_number == rhs.prev_page_number;
   }
 };
 
 /**
  * @brief Slot metadata that tracks where a record is in the data space.
+ *
+ * Whether a slot is in use is kept in the page's slot map.  Slots not in use
+ * are linked into the page's free slot list through their fields.
  */
 struct PageSlot {
   /**
-   * Whether the slot currently holds data.  May be false if this slot's
-   * record has been deleted after insertion.
+   * Offset of the data item in the page.  For a slot not in use, the next
+   * slot in the free slot list, or Page::INVALID_SLOT.
    */
-  bool used;
+  std::uint16_t item_offset;
 
   /**
-   * Offset of the data item in the page.
+   * Length of the data item in this slot.  For a slot not in use, the
+   * previous slot in the free slot list, or Page::INVALID_SLOT.
    */
-  std::uint16_t item_offset;
+  std::uint16_t item_length;
+};
 
+/**
+ * @brief Column metadata that tracks where a column's minipage is in the data
+ *        space of a page in the PAX layout.
+ */
+struct PageColumn {
   /**
-   * Length of the data item in this slot.
+   * Offset in the record of the bytes making up the column.
    */
-  std::uint16_t item_length;
+  std::uint16_t record_offset;
+
+  /**
+   * Number of bytes each record has in the column.
+   */
+  std::uint16_t length;
+
+  /**
+   * Offset of the minipage in the page, where the column's bytes of every
+   * slot are kept back to back.
+   */
+  std::uint16_t offset;
 };
 
 class PageIterator;
 
+/**
+ * @brief Read-only view of a record's bytes where they are stored in a page,
+ *        for reading records without copying them; std::string_view comes
+ *        with C++17, newer than this code is built as.
+ *
+ * A view is only good while the page stays pinned and unchanged: inserting,
+ * updating or deleting records on the page may move the bytes.
+ */
+class RecordView {
+ public:
+  /**
+   * Constructs an empty view.
+   */
+  RecordView()
+      : data_(NULL),
+        size_(0) {
+  }
+
+  /**
+   * Constructs a view of the given bytes.
+   *
+   * @param data  First byte of the record.
+   * @param size  Number of bytes in the record.
+   */
+  RecordView(const char* data, const std::size_t size)
+      : data_(data),
+        size_(size) {
+  }
+
+  /**
+   * Returns the first byte of the record.
+   */
+  const char* data() const { return data_; }
+
+  /**
+   * Returns the number of bytes in the record.
+   */
+  std::size_t size() const { return size_; }
+
+  /**
+   * Returns true if the record has no bytes.
+   */
+  bool empty() const { return size_ == 0; }
+
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + size_; }
+  const char& operator[](const std::size_t i) const { return data_[i]; }
+
+  /**
+   * Returns a copy of the record.
+   */
+  std::string str() const { return std::string(data_, size_); }
+
+  /**
+   * Returns true if the other view has the same bytes.
+   */
+  bool operator==(const RecordView& rhs) const {
+    return size_ == rhs.size_ && (size_ == 0 || memcmp(data_, rhs.data_, size_) == 0);
+  }
+
+  bool operator!=(const RecordView& rhs) const { return !(*this == rhs); }
+
+ private:
+  /**
+   * First byte of the record.
+   */
+  const char* data_;
+
+  /**
+   * Number of bytes in the record.
+   */
+  std::size_t size_;
+};
+
+/**
+ * @brief Read-only view of one field of every slot of a page of fixed-length
+ *        records, where the fields are stored in the page.
+ *
+ * The field of slot n is stride() bytes after that of slot n - 1.  On a page
+ * in the PAX layout the stride is the field's length, so the fields are back
+ * to back.  Only the fields of used slots hold records' bytes.  A view is only
+ * good while the page stays pinned and unchanged.
+ */
+class ColumnView {
+ public:
+  /**
+   * Constructs an empty view.
+   */
+  ColumnView()
+      : data_(NULL),
+        stride_(0),
+        num_slots_(0),
+        slot_map_(NULL) {
+  }
+
+  /**
+   * Constructs a view of a page's fields.
+   *
+   * @param data      Field of the first slot.
+   * @param stride    Bytes from the field of one slot to that of the next.
+   * @param num_slots Number of slots.
+   * @param slot_map  Bit map of the slots in use, as kept by the page.
+   */
+  ColumnView(const char* data, const std::size_t stride,
+             const SlotId num_slots, const std::uint64_t* slot_map)
+      : data_(data),
+        stride_(stride),
+        num_slots_(num_slots),
+        slot_map_(slot_map) {
+  }
+
+  /**
+   * Returns the field of the first slot.
+   */
+  const char* data() const { return data_; }
+
+  /**
+   * Returns the number of bytes from the field of one slot to that of the
+   * next.
+   */
+  std::size_t stride() const { return stride_; }
+
+  /**
+   * Returns the number of slots.
+   */
+  SlotId num_slots() const { return num_slots_; }
+
+  /**
+   * Returns the bit map of the slots in use, bit (n - 1) % 64 of word
+   * (n - 1) / 64 being that of slot n.
+   */
+  const std::uint64_t* slot_map() const { return slot_map_; }
+
+  /**
+   * Returns whether the given slot holds a record.
+   *
+   * @param slot_number   Number of slot, from 1 to num_slots().
+   */
+  bool isUsed(const SlotId slot_number) const {
+    return (slot_map_[(slot_number - 1) / 64] >> ((slot_number - 1) % 64)) & 1;
+  }
+
+  /**
+   * Returns the field of the given slot.
+   *
+   * @param slot_number   Number of slot, from 1 to num_slots().
+   */
+  const char* value(const SlotId slot_number) const {
+    return data_ + (slot_number - 1) * stride_;
+  }
+
+ private:
+  /**
+   * Field of the first slot.
+   */
+  const char* data_;
+
+  /**
+   * Bytes from the field of one slot to that of the next.
+   */
+  std::size_t stride_;
+
+  /**
+   * Number of slots.
+   */
+  SlotId num_slots_;
+
+  /**
+   * Bit map of the slots in use.
+   */
+  const std::uint64_t* slot_map_;
+};
+
 /**
  * @brief Class which represents a fixed-size database page containing records.
  *
@@ -103,6 +332,19 @@ class PageIterator;
  * slots and identified by a RecordId.  Although a record's actual contents may
  * be moved on the page, accessing a record by its slot is consistent.
  *
+ * A page is either slotted, holding records of any length found through a
+ * slot array, or holds records all of one length in a dense array, record n
+ * being the nth element.  A page of fixed-length records may instead split
+ * them into columns (the PAX layout): each column's bytes of all the records
+ * are kept together in a minipage, so reading one field of every record only
+ * touches that field's bytes.
+ *
+ * Either way, the data starts with a bit map of the slots in use, bit
+ * (n - 1) % 64 of word (n - 1) / 64 being that of slot n, with one word per
+ * 64 slots the page has.  On a slotted page the map grows with the slot
+ * array after it, which moves up a word each time it grows past a multiple
+ * of 64 slots.
+ *
  * @warning This class is not threadsafe.
  */
 class Page {
@@ -128,16 +370,60 @@ class Page {
    */
   static const SlotId INVALID_SLOT = 0;
 
+  /**
+   * Most slots a slotted page can have.
+   */
+  static const SlotId MAX_SLOTS = DATA_SIZE / sizeof(PageSlot);
+
+  /**
+   * Most columns a page in the PAX layout can split its records into.
+   */
+  static const std::uint16_t MAX_COLUMNS = 16;
+
+  /**
+   * Returns the number of slots a page of fixed-length records has, which is
+   * 0 if not even one record fits.
+   *
+   * @param record_length   Length of the records, more than 0.
+   * @param column_lengths  Lengths of the columns the records are split into
+   *                        in the PAX layout, summing to record_length.
+   * @param num_columns     Number of columns, or 0 to keep records whole.
+   * @return  Number of slots.
+   */
+  static SlotId capacity(const std::size_t record_length,
+                         const std::uint16_t* column_lengths = NULL,
+                         const std::uint16_t num_columns = 0);
+
   /**
    * Constructs a new, uninitialized page.
    */
   Page();
 
+  /**
+   * Returns the length of every record on this page if it holds fixed-length
+   * records, or 0 if it is a slotted page.
+   *
+   * @return  Record length in bytes, or 0.
+   */
+  std::uint16_t record_length() const { return header_.record_length; }
+
+  /**
+   * Returns the number of columns the records of this page are split into if
+   * it is in the PAX layout, or 0 if its records are kept whole.
+   *
+   * @return  Number of columns, or 0.
+   */
+  std::uint16_t num_columns() const { return header_.num_columns; }
+
   /**
    * Inserts a new record into the page.
    *
    * @param record_data  Bytes that compose the record.
    * @return  ID of the newly inserted record.
+   * @throws  InsufficientSpaceException  If the page has no room for the
+   *                                      record.
+   * @throws  InvalidRecordLengthException  If the page holds fixed-length
+   *                                        records of another length.
    */
   RecordId insertRecord(const std::string& record_data);
 
@@ -151,6 +437,54 @@ class Page {
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns a view of the record with the given ID where it is stored in the
+   * page, copying nothing.  The view is only good while the page stays
+   * pinned and no record on it is inserted, updated or deleted.
+   *
+   * @see getRecord
+   * @param record_id  ID of the record to return.
+   * @return  View of the record.
+   * @throws  InvalidFieldException  If the page is in the PAX layout with
+   *                                 more than one column, so the record is
+   *                                 not in one piece; use getFieldView for
+   *                                 one of its columns, or getRecord for a
+   *                                 copy of all of it.
+   */
+  RecordView getRecordView(const RecordId& record_id) const;
+
+  /**
+   * Returns a view of some of the bytes of the record with the given ID,
+   * where they are stored in the page.  On a page in the PAX layout the
+   * bytes must be within one column, and only that column is read.
+   *
+   * @see getRecordView
+   * @param record_id  ID of the record.
+   * @param offset     Offset of the field in the record.
+   * @param length     Number of bytes in the field.
+   * @return  View of the field.
+   * @throws  InvalidFieldException  If the field is not within the record,
+   *                                 or not within one of its columns.
+   */
+  RecordView getFieldView(const RecordId& record_id, const std::size_t offset,
+                          const std::size_t length) const;
+
+  /**
+   * Returns a view of one field of every slot of a page of fixed-length
+   * records, where the fields are stored in the page.  On a page in the PAX
+   * layout the field must be within one column, and the view is of that
+   * column's minipage.
+   *
+   * @param offset     Offset of the field in the records.
+   * @param length     Number of bytes in the field.
+   * @return  View of the field of every slot.
+   * @throws  InvalidFieldException  If the page is slotted, or the field is
+   *                                 not within the records, or not within
+   *                                 one of their columns.
+   */
+  ColumnView getColumnView(const std::size_t offset,
+                           const std::size_t length) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -162,9 +496,9 @@ class Page {
   void updateRecord(const RecordId& record_id, const std::string& record_data);
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array.
+   * Deletes the record with the given ID.  Only the slot is freed; the space
+   * of the record is reclaimed when an insert or update needs it.  Slot array
+   * is compacted if the slot deleted is at the end of the slot array.
    *
    * @param record_id   ID of the record to delete.
    */
@@ -172,6 +506,7 @@ class Page {
 
   /**
    * Returns true if the page has enough free space to hold the given data.
+   * A page of fixed-length records only has space for records of its length.
    *
    * @param record_data Bytes that compose the record.
    * @return  Whether the page can hold the data.
@@ -183,8 +518,13 @@ class Page {
    *
    * @return  Free space in bytes.
    */
-  std::uint16_t getFreeSpace() const { return header_.free_space_upper_bound -
-                                              header_.free_space_lower_bound; }
+  std::uint16_t getFreeSpace() const {
+    if (header_.record_length > 0) {
+      return header_.num_free_slots * header_.record_length;
+    }
+    return header_.free_space_upper_bound - header_.free_space_lower_bound +
+        header_.fragmented_space;
+  }
 
   /**
    * Returns this page's number in its file.
@@ -200,6 +540,13 @@ class Page {
    */
   PageId next_page_number() const { return header_.next_page_number; }
 
+  /**
+   * Returns the number of the previous used page before this page in its file.
+   *
+   * @return  Page number of previous used page in file.
+   */
+  PageId prev_page_number() const { return header_.prev_page_number; }
+
   /**
    * Returns an iterator at the first record in the page.
    *
@@ -218,8 +565,73 @@ class Page {
  private:
   /**
    * Initializes this page as a new page with no header information or data.
+   *
+   * @param record_length   Length of the records the page is to hold, or 0
+   *                        for a slotted page.
+   * @param column_lengths  Lengths of the columns the records are split into
+   *                        in the PAX layout, summing to record_length.
+   * @param num_columns     Number of columns, or 0 to keep records whole.
    */
-  void initialize();
+  void initialize(const std::uint16_t record_length = 0,
+                  const std::uint16_t* column_lengths = NULL,
+                  const std::uint16_t num_columns = 0);
+
+  /**
+   * Returns the column with the given index on a page in the PAX layout.
+   *
+   * @param column  Index of the column, from 0.
+   * @return  The column.
+   */
+  const PageColumn& getColumn(const std::size_t column) const {
+    return reinterpret_cast<const PageColumn*>(data_ + slotMapSize())[column];
+  }
+
+  /**
+   * Returns the column holding the given bytes of the records on a page in
+   * the PAX layout, or NULL if no one column holds them all.
+   *
+   * @param offset  Offset of the bytes in the record.
+   * @param length  Number of bytes.
+   * @return  The column, or NULL.
+   */
+  const PageColumn* findColumn(const std::size_t offset,
+                               const std::size_t length) const;
+
+  /**
+   * Stores the given record in the given slot of a page of fixed-length
+   * records, splitting it into its columns in the PAX layout.
+   *
+   * @param slot_number   Number of slot.
+   * @param record_data   Bytes that compose the record.
+   */
+  void writeFixedRecord(const SlotId slot_number, const std::string& record_data);
+
+  /**
+   * Returns where the given slot's record is on a page of fixed-length
+   * records.
+   *
+   * @param slot_number   Number of slot.
+   * @return  Offset of the record in the data.
+   */
+  std::size_t fixedRecordOffset(const SlotId slot_number) const {
+    return slotMapSize() + (slot_number - 1) * header_.record_length;
+  }
+
+  /**
+   * Returns the first slot not in use on a page of fixed-length records,
+   * which must have one.
+   *
+   * @return  Number of the slot.
+   */
+  SlotId firstUnusedSlot() const;
+
+  /**
+   * Throws an exception if the page holds fixed-length records and the given
+   * record is of another length.
+   *
+   * @param record_data   Bytes that compose the record.
+   */
+  void validateRecordLength(const std::string& record_data) const;
 
   /**
    * Sets this page's number in its file.
@@ -240,9 +652,17 @@ class Page {
   }
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array and
+   * Sets the number of the previous used page before this page in its file.
+   *
+   * @param prev_page_number  Page number of previous used page in file.
+   */
+  void set_prev_page_number(const PageId new_prev_page_number) {
+    header_.prev_page_number = new_prev_page_number;
+  }
+
+  /**
+   * Deletes the record with the given ID, freeing only its slot.  Slot array
+   * is compacted if the slot deleted is at the end of the slot array and
    * <allow_slot_compaction> is set.
    *
    * @param record_id             ID of the record to delete.
@@ -252,6 +672,137 @@ class Page {
   void deleteRecord(const RecordId& record_id,
                     const bool allow_slot_compaction);
 
+  /**
+   * Makes sure the free space between the slot array and the records holds
+   * at least the given number of bytes, compacting the records if the space
+   * of deleted ones is needed.  Callers are responsible for making sure the
+   * page has that much free space in all.
+   *
+   * @param bytes   Number of contiguous free bytes needed.
+   */
+  void reserveContiguousSpace(const std::size_t bytes);
+
+  /**
+   * Moves all records up against the end of the data, in one pass, so the
+   * space of deleted records joins the free space.
+   */
+  void compact();
+
+  /**
+   * Returns whether the slot with the given number holds a record.
+   *
+   * @param slot_number   Number of slot to check.
+   * @return  Whether the slot is in use.
+   */
+  bool isSlotUsed(const SlotId slot_number) const {
+    return (slotMapWord((slot_number - 1) / 64) >> ((slot_number - 1) % 64)) & 1;
+  }
+
+  /**
+   * Marks the slot with the given number as in use or not in the slot map.
+   *
+   * @param slot_number   Number of slot to mark.
+   * @param used          Whether the slot holds a record.
+   */
+  void setSlotUsed(const SlotId slot_number, const bool used) {
+    const std::uint64_t bit = std::uint64_t(1) << ((slot_number - 1) % 64);
+    if (used) {
+      slotMapWord((slot_number - 1) / 64) |= bit;
+    } else {
+      slotMapWord((slot_number - 1) / 64) &= ~bit;
+    }
+  }
+
+  /**
+   * Returns the given word of the slot map.
+   *
+   * @param word  Index of the word, from 0.
+   * @return  The word.
+   */
+  std::uint64_t& slotMapWord(const std::size_t word) {
+    return reinterpret_cast<std::uint64_t*>(data_)[word];
+  }
+
+  /**
+   * Returns the given word of the slot map.
+   *
+   * @param word  Index of the word, from 0.
+   * @return  The word.
+   */
+  const std::uint64_t& slotMapWord(const std::size_t word) const {
+    return reinterpret_cast<const std::uint64_t*>(data_)[word];
+  }
+
+  /**
+   * Returns the number of bytes of the slot map, which the slot array or the
+   * records follow.
+   *
+   * @return  Number of bytes.
+   */
+  std::size_t slotMapSize() const {
+    return numSlotMapWords(header_.num_slots) * sizeof(std::uint64_t);
+  }
+
+  /**
+   * Returns the number of words of the slot map of a page with the given
+   * number of slots.
+   *
+   * @param num_slots   Number of slots.
+   * @return  Number of words.
+   */
+  static std::size_t numSlotMapWords(const std::size_t num_slots) {
+    return (num_slots + 63) / 64;
+  }
+
+  /**
+   * Returns where the slot array of a slotted page with the given number of
+   * slots ends, after the slot map in front of it.
+   *
+   * @param num_slots   Number of slots.
+   * @return  Offset of the first byte after the slot array.
+   */
+  static std::size_t slotArrayEnd(const std::size_t num_slots) {
+    return num_slots * sizeof(PageSlot) +
+        numSlotMapWords(num_slots) * sizeof(std::uint64_t);
+  }
+
+  /**
+   * Returns the number of bytes a new slot takes from the free space of a
+   * slotted page, counting the slot map word it needs if it is the first of
+   * its 64.
+   *
+   * @return  Number of bytes.
+   */
+  std::size_t newSlotSize() const {
+    return slotArrayEnd(header_.num_slots + 1) - header_.free_space_lower_bound;
+  }
+
+  /**
+   * Returns the first slot in use after the given slot, or INVALID_SLOT if
+   * there is none.  Skips whole words of the slot map at a time.
+   *
+   * @param start   Slot to search after, or INVALID_SLOT to search from the
+   *                first slot.
+   * @return  Next used slot after the given slot or INVALID_SLOT.
+   */
+  SlotId nextUsedSlot(const SlotId start) const;
+
+  /**
+   * Puts the given slot, which must not be in use, at the head of the free
+   * slot list.
+   *
+   * @param slot_number   Number of slot to link.
+   */
+  void linkFreeSlot(const SlotId slot_number);
+
+  /**
+   * Takes the given slot, which must not be in use, out of the free slot
+   * list.
+   *
+   * @param slot_number   Number of slot to unlink.
+   */
+  void unlinkFreeSlot(const SlotId slot_number);
+
   /**
    * Returns the slot with the given number.  This method will return
    * unallocated slots if requested; it is up to the caller to ensure they
@@ -273,8 +824,9 @@ class Page {
   const PageSlot& getSlot(const SlotId slot_number) const;
 
   /**
-   * Returns the slot number of an available slot.  If no slots are available
-   * to be reused, allocates a new slot.  Updates available slot count in the
+   * Returns the slot number of an available slot, the one at the head of the
+   * free slot list.  If no slots are available to be reused, allocates a new
+   * slot and links it into the list.  Updates available slot count in the
    * header metadata, but does not mark returned slot as used.  If a new slot is
    * allocated, updates the free space lower bound.
    *
@@ -343,5 +895,9 @@ static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
 static_assert(Page::DATA_SIZE > 0,
               "Page must have some space to hold data.");
+static_assert(sizeof(Page) == Page::SIZE,
+              "Page must be its header followed by its data, with no padding.");
+static_assert(sizeof(PageHeader) % sizeof(std::uint64_t) == 0,
+              "Slot map at the start of the data must be aligned.");
 
 }
@@ -101,23 +101,30 @@ class PageIterator {
 		return page_->getRecord(current_record_); 
 	}
 
+  /**
+   * Returns a view of the current record where it is stored in the page,
+   * copying nothing.
+   *
+   * @see Page::getRecordView
+   * @return  View of record in page.
+   * @throws  InvalidFieldException  If the page is in the PAX layout with
+   *                                 more than one column; use
+   *                                 Page::getFieldView or operator* instead.
+   */
+  inline RecordView getCurrentRecordView() const {
+    return page_->getRecordView(current_record_);
+  }
+
   /**
    * Returns the next used slot in the page after the given slot or
-   * Page::INVALID_SLOT if no slots are used after the given slot.
+   * Page::INVALID_SLOT if no slots are used after the given slot.  Runs of
+   * unused slots are skipped through the page's slot map.
    *
    * @param start   Slot to start search at.
    * @return  Next used slot after given slot or Page::INVALID_SLOT.
    */
   SlotId getNextUsedSlot(const SlotId start) const {
-    SlotId slot_number = Page::INVALID_SLOT;
-    for (SlotId i = start + 1; i <= page_->header_.num_slots; ++i) {
-      const PageSlot* slot = page_->getSlot(i);
-      if (slot->used) {
-        slot_number = i;
-        break;
-      }
-    }
-    return slot_number;
+    return page_->nextUsedSlot(start);
   }
 
 	RecordId getCurrentRecord()
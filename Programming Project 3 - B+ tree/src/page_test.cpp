@@ -0,0 +1,294 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include "page.h"
+#include "page_iterator.h"
+#include "exceptions/insufficient_space_exception.h"
+
+#define checkPassFail(a, b)                                               \
+    \
+{                                                                  \
+        if ((a) == (b))                                                   \
+            std::cout << "\nTest passed at line no:" << __LINE__ << "\n"; \
+        else {                                                            \
+            std::cout << "\nTest FAILS at line no:" << __LINE__;          \
+            std::cout << "\nExpected:" << (b);                            \
+            std::cout << "\nActual:" << (a);                              \
+            std::cout << std::endl;                                       \
+            exit(1);                                                      \
+        }                                                                 \
+    \
+}
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+
+// Bytes a slot takes in the slot array, and the slot map word each run of 64
+// slots adds in front of it.
+const std::size_t SLOT_SIZE = sizeof(PageSlot);
+const std::size_t SLOT_MAP_WORD_SIZE = sizeof(std::uint64_t);
+
+// Contents of a slotted page, by slot number, that the page is checked against.
+typedef std::map<SlotId, std::string> PageModel;
+
+// -----------------------------------------------------------------------------
+// Forward declarations
+// -----------------------------------------------------------------------------
+
+int checkModel(Page& page, const PageModel& model);
+void test1();
+void test2();
+void test3();
+void test4();
+
+int main(int argc, char** argv)
+{
+    test1();
+    test2();
+    test3();
+    test4();
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// checkModel
+// -----------------------------------------------------------------------------
+
+int checkModel(Page& page, const PageModel& model)
+{
+    // Returns the number of records that are where the model says, in slot
+    // order, or -1 if the page holds one the model does not.
+    PageModel::const_iterator expected = model.begin();
+    int matches = 0;
+    for (PageIterator iter = page.begin(); iter != page.end(); ++iter) {
+        const RecordId rid = iter.getCurrentRecord();
+        if (expected == model.end() || rid.slot_number != expected->first) {
+            return -1;
+        }
+        if (page.getRecord(rid) == expected->second) {
+            matches++;
+        }
+        ++expected;
+    }
+    return expected == model.end() ? matches : -1;
+}
+
+void test1()
+{
+    // Every 64 slots the slot map grows by a word in front of the slot array,
+    // and shrinks again once the last slot of the run is gone.
+    std::cout << "--------------------" << std::endl;
+    std::cout << "slot map resize at 64-slot boundaries" << std::endl;
+    Page page;
+    PageModel model;
+    const std::uint16_t initialFree = page.getFreeSpace();
+    const std::string record(1, 'x');
+
+    int wrongGrowth = 0;
+    while (page.hasSpaceForRecord(record)) {
+        const std::uint16_t before = page.getFreeSpace();
+        const RecordId rid = page.insertRecord(record);
+        std::size_t cost = record.length() + SLOT_SIZE;
+        if ((rid.slot_number - 1) % 64 == 0) {
+            cost += SLOT_MAP_WORD_SIZE;
+        }
+        if (rid.slot_number != model.size() + 1 ||
+            static_cast<std::size_t>(before - page.getFreeSpace()) != cost) {
+            wrongGrowth++;
+        }
+        model[rid.slot_number] = record;
+    }
+    checkPassFail(wrongGrowth, 0)
+    checkPassFail(model.size() > 256, true)
+    checkPassFail(checkModel(page, model), (int)model.size())
+
+    // delete from the end, so the slot array and its map shrink one slot at a time
+    int wrongShrink = 0;
+    while (!model.empty()) {
+        const SlotId slot = model.rbegin()->first;
+        const std::uint16_t before = page.getFreeSpace();
+        page.deleteRecord({page.page_number(), slot, 0});
+        model.erase(slot);
+        std::size_t gain = record.length() + SLOT_SIZE;
+        if ((slot - 1) % 64 == 0) {
+            gain += SLOT_MAP_WORD_SIZE;
+        }
+        if (static_cast<std::size_t>(page.getFreeSpace() - before) != gain) {
+            wrongShrink++;
+        }
+        if (slot % 64 == 1 && checkModel(page, model) != (int)model.size()) {
+            wrongShrink++;
+        }
+    }
+    checkPassFail(wrongShrink, 0)
+    checkPassFail(page.getFreeSpace(), initialFree)
+}
+
+void test2()
+{
+    // Deleted slots in the middle of the array go on the free slot list, and
+    // are handed out again before the array grows.
+    std::cout << "--------------------" << std::endl;
+    std::cout << "free slot list" << std::endl;
+    Page page;
+    PageModel model;
+    for (int i = 0; i < 200; i++) {
+        const std::string record(10, 'a' + i % 26);
+        model[page.insertRecord(record).slot_number] = record;
+    }
+
+    std::map<SlotId, bool> freed;
+    for (SlotId slot = 3; slot <= 190; slot += 7) {
+        page.deleteRecord({page.page_number(), slot, 0});
+        model.erase(slot);
+        freed[slot] = true;
+    }
+    checkPassFail(checkModel(page, model), (int)model.size())
+
+    const std::size_t numFreed = freed.size();
+    int reused = 0;
+    for (std::size_t i = 0; i < numFreed; i++) {
+        const std::string record(10, 'A' + i % 26);
+        const RecordId rid = page.insertRecord(record);
+        if (freed.erase(rid.slot_number) == 1) {
+            reused++;
+        }
+        model[rid.slot_number] = record;
+    }
+    checkPassFail(reused, (int)numFreed)
+    checkPassFail(checkModel(page, model), (int)model.size())
+
+    // with the list empty, the next record gets a new slot at the end
+    const RecordId rid = page.insertRecord("tail");
+    checkPassFail(rid.slot_number, 201)
+}
+
+void test3()
+{
+    // Deleting and shrinking records leaves holes that are only squeezed out
+    // when an insert needs contiguous space.
+    std::cout << "--------------------" << std::endl;
+    std::cout << "lazy compaction" << std::endl;
+    Page page;
+    PageModel model;
+    const std::string big(100, 'b');
+    while (page.hasSpaceForRecord(big)) {
+        model[page.insertRecord(big).slot_number] = big;
+    }
+
+    // free every other record, and shrink the rest, so no hole fits the
+    // record inserted below on its own
+    int i = 0;
+    for (PageModel::iterator it = model.begin(); it != model.end(); i++) {
+        const RecordId rid = {page.page_number(), it->first, 0};
+        if (i % 2 == 0) {
+            page.deleteRecord(rid);
+            model.erase(it++);
+        }
+        else {
+            it->second = std::string(40, 's');
+            page.updateRecord(rid, it->second);
+            ++it;
+        }
+    }
+    checkPassFail(checkModel(page, model), (int)model.size())
+
+    // deleted slots are left on the free slot list, so the record below
+    // costs no more than its own bytes
+    const std::uint16_t freeBefore = page.getFreeSpace();
+    const std::string large(freeBefore - 16, 'L');
+    checkPassFail(page.hasSpaceForRecord(large), true)
+    model[page.insertRecord(large).slot_number] = large;
+    checkPassFail(checkModel(page, model), (int)model.size())
+    checkPassFail(page.getFreeSpace(), 16)
+
+    bool threw = false;
+    try {
+        page.insertRecord(std::string(17, 'x'));
+    }
+    catch (const InsufficientSpaceException&) {
+        threw = true;
+    }
+    checkPassFail(threw, true)
+}
+
+void test4()
+{
+    // Random inserts, deletes and updates, checked against a model of the
+    // page.  Odd trials use tiny records, so the slot array and its map go
+    // through many resizes; even trials use larger ones and fragment the page.
+    std::cout << "--------------------" << std::endl;
+    std::cout << "randomized page model" << std::endl;
+    srand(7);
+    int mismatches = 0;
+    int wrongInserts = 0;
+    for (int trial = 0; trial < 100; trial++) {
+        Page page;
+        PageModel model;
+        const int maxLength = trial % 2 ? 3 : 120;
+        for (int op = 0; op < 5000; op++) {
+            const int r = rand() % 10;
+            if (r < 6) {
+                const std::string record(rand() % maxLength, 'a' + rand() % 26);
+                if (page.hasSpaceForRecord(record)) {
+                    const RecordId rid = page.insertRecord(record);
+                    if (model.count(rid.slot_number)) {
+                        wrongInserts++;
+                    }
+                    model[rid.slot_number] = record;
+                }
+                else {
+                    try {
+                        page.insertRecord(record);
+                        wrongInserts++;
+                    }
+                    catch (const InsufficientSpaceException&) {
+                    }
+                }
+            }
+            else if (!model.empty()) {
+                PageModel::iterator it = model.begin();
+                std::advance(it, rand() % model.size());
+                if (rand() % 3 == 0) {
+                    // favour the last slot, which trims the slot array
+                    it = std::prev(model.end());
+                }
+                const RecordId rid = {page.page_number(), it->first, 0};
+                if (r < 9) {
+                    page.deleteRecord(rid);
+                    model.erase(it);
+                }
+                else {
+                    const std::string record(rand() % maxLength, 'A' + rand() % 26);
+                    try {
+                        page.updateRecord(rid, record);
+                        it->second = record;
+                    }
+                    catch (const InsufficientSpaceException&) {
+                    }
+                }
+            }
+            if (op % 97 == 0 && checkModel(page, model) != (int)model.size()) {
+                mismatches++;
+            }
+        }
+        if (checkModel(page, model) != (int)model.size()) {
+            mismatches++;
+        }
+    }
+    checkPassFail(wrongInserts, 0)
+    checkPassFail(mismatches, 0)
+}
@@ -0,0 +1,657 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <utility>
+#include "replacement.h"
+
+namespace badgerdb {
+
+ReplacementPolicy* ReplacementPolicy::create(const ReplacementPolicyType type, const std::uint32_t numBufs)
+{
+  switch (type)
+  {
+    case LRU_K:
+      return new LruKPolicy(numBufs);
+    case TWO_Q:
+      return new TwoQPolicy(numBufs);
+    case ARC:
+      return new ArcPolicy(numBufs);
+    case CLOCK:
+    default:
+      return new ClockPolicy(numBufs);
+  }
+}
+
+//----------------------------------------
+// ClockPolicy
+//----------------------------------------
+
+ClockPolicy::ClockPolicy(const std::uint32_t bufs)
+  : numBufs(bufs), clockHand(bufs - 1)
+{
+  refbits = new std::atomic<bool>[bufs];
+  for (FrameId i = 0; i < bufs; i++)
+    refbits[i] = false;
+}
+
+ClockPolicy::~ClockPolicy()
+{
+  delete [] refbits;
+}
+
+bool ClockPolicy::pickVictim(const File* file, const PageId pageNo,
+                             const FrameClaimer& claim, FrameId& frame)
+{
+  // Sweep twice: the first pass may only clear reference bits.  Free frames
+  // have their bit clear, so they are taken as soon as the hand reaches them.
+  for (std::uint32_t numScanned = 0; numScanned < 2*numBufs; numScanned++)
+  {
+    // advance the clock
+    const FrameId hand = (clockHand.fetch_add(1) + 1) % numBufs;
+
+    if (refbits[hand])
+    {
+      // has been referenced, clear the bit
+      refbits[hand] = false;
+    }
+    else if (claim(hand))
+    {
+      frame = hand;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ClockPolicy::frameEvicted(const FrameId frame)
+{
+  refbits[frame] = false;
+}
+
+void ClockPolicy::frameLoaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+  refbits[frame] = true;
+}
+
+void ClockPolicy::frameAccessed(const FrameId frame)
+{
+  refbits[frame] = true;
+}
+
+void ClockPolicy::frameFreed(const FrameId frame)
+{
+  refbits[frame] = false;
+}
+
+void ClockPolicy::candidateVictims(const std::uint32_t maxFrames, std::vector<FrameId>& frames)
+{
+  // The frames ahead of the hand whose bit is already clear go this sweep,
+  // and the ones the hand clears as it passes go on the next, if nobody
+  // touches them meanwhile.
+  const FrameId hand = clockHand;
+  std::uint32_t listed = 0;
+  for (int sweep = 0; sweep < 2; sweep++)
+  {
+    for (std::uint32_t i = 1; i <= numBufs && listed < maxFrames; i++)
+    {
+      const FrameId frame = (hand + i) % numBufs;
+      if (refbits[frame] == (sweep == 1))
+      {
+        frames.push_back(frame);
+        listed++;
+      }
+    }
+  }
+}
+
+//----------------------------------------
+// LruKPolicy
+//----------------------------------------
+
+LruKPolicy::LruKPolicy(const std::uint32_t numBufs)
+  : now(0), stateOf(numBufs, FREE), position(numBufs), keys(numBufs), ranked(numBufs)
+{
+  stamps = new Stamps[numBufs];
+  // hand out low frame numbers first
+  for (FrameId i = 0; i < numBufs; i++)
+  {
+    stamps[i].last = 0;
+    stamps[i].previous = 0;
+    position[i] = freeList.insert(freeList.end(), i);
+  }
+}
+
+LruKPolicy::~LruKPolicy()
+{
+  delete [] stamps;
+}
+
+LruKPolicy::Rank LruKPolicy::rankOf(const FrameId frame) const
+{
+  return std::make_pair(std::make_pair(stamps[frame].previous.load(std::memory_order_relaxed),
+                                       stamps[frame].last.load(std::memory_order_relaxed)),
+                        frame);
+}
+
+std::set<LruKPolicy::Rank>::iterator LruKPolicy::rerank(const std::set<Rank>::iterator it)
+{
+  const FrameId frame = it->second;
+  const Rank current = rankOf(frame);
+  if (current == *it)
+    return it;
+  // Stamps only grow, so the frame files in behind its old place, and the
+  // successor of the old place is the next frame to look at, whether it is
+  // this one or not.
+  ranked[frame] = current;
+  ranking.insert(current);
+  return ranking.erase(it);
+}
+
+void LruKPolicy::unlink(const FrameId frame)
+{
+  switch (stateOf[frame])
+  {
+    case FREE:
+      freeList.erase(position[frame]);
+      break;
+    case RESIDENT:
+      ranking.erase(ranked[frame]);
+      break;
+    case NONE:
+      break;
+  }
+  stateOf[frame] = NONE;
+}
+
+bool LruKPolicy::pickVictim(const File* file, const PageId pageNo,
+                            const FrameClaimer& claim, FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  for (std::list<FrameId>::iterator it = freeList.begin(); it != freeList.end(); ++it)
+  {
+    if (claim(*it))
+    {
+      frame = *it;
+      return true;
+    }
+  }
+
+  std::set<Rank>::iterator it = ranking.begin();
+  while (it != ranking.end())
+  {
+    const std::set<Rank>::iterator next = rerank(it);
+    if (next != it)
+    {
+      it = next;
+      continue;
+    }
+    if (claim(it->second))
+    {
+      frame = it->second;
+      return true;
+    }
+    ++it;
+  }
+  return false;
+}
+
+void LruKPolicy::frameEvicted(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  if (stateOf[frame] == RESIDENT && retained.find(keys[frame]) == retained.end())
+  {
+    retainedOrder.push_front(keys[frame]);
+    const History h = {stamps[frame].last, stamps[frame].previous};
+    const Retained r = {h, retainedOrder.begin()};
+    retained[keys[frame]] = r;
+    if (retainedOrder.size() > stateOf.size())
+    {
+      retained.erase(retainedOrder.back());
+      retainedOrder.pop_back();
+    }
+  }
+  unlink(frame);
+}
+
+void LruKPolicy::frameLoaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  unlink(frame);
+  const BufPageKey key = {file, pageNo};
+  std::uint64_t previous = 0;
+
+  // a page re-read soon after eviction keeps its previous reference
+  std::unordered_map<BufPageKey, Retained, BufPageKeyHash>::iterator it = retained.find(key);
+  if (it != retained.end())
+  {
+    previous = it->second.history.last;
+    retainedOrder.erase(it->second.position);
+    retained.erase(it);
+  }
+
+  keys[frame] = key;
+  stamps[frame].previous = previous;
+  stamps[frame].last = ++now;
+  ranked[frame] = rankOf(frame);
+  ranking.insert(ranked[frame]);
+  stateOf[frame] = RESIDENT;
+}
+
+void LruKPolicy::frameAccessed(const FrameId frame)
+{
+  // Hits between two loads are one reference.  Racing hits on one frame may
+  // interleave their stores, which at worst loses one of them.
+  const std::uint64_t time = now.load(std::memory_order_relaxed);
+  const std::uint64_t last = stamps[frame].last.load(std::memory_order_relaxed);
+  if (last != time)
+  {
+    stamps[frame].previous.store(last, std::memory_order_relaxed);
+    stamps[frame].last.store(time, std::memory_order_relaxed);
+  }
+}
+
+void LruKPolicy::frameFreed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  if (stateOf[frame] == FREE)
+    return;
+  unlink(frame);
+  position[frame] = freeList.insert(freeList.end(), frame);
+  stateOf[frame] = FREE;
+}
+
+void LruKPolicy::candidateVictims(const std::uint32_t maxFrames, std::vector<FrameId>& frames)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  std::uint32_t listed = 0;
+  std::set<Rank>::iterator it = ranking.begin();
+  while (it != ranking.end() && listed < maxFrames)
+  {
+    const std::set<Rank>::iterator next = rerank(it);
+    if (next != it)
+    {
+      it = next;
+      continue;
+    }
+    frames.push_back(it->second);
+    ++listed;
+    ++it;
+  }
+}
+
+//----------------------------------------
+// TwoQPolicy
+//----------------------------------------
+
+TwoQPolicy::TwoQPolicy(const std::uint32_t numBufs)
+  : kin(std::max<std::size_t>(1, numBufs / 4)),
+    kout(std::max<std::size_t>(1, numBufs / 2)),
+    queueOf(numBufs, FREE), position(numBufs), keys(numBufs)
+{
+  referenced = new std::atomic<bool>[numBufs];
+  for (FrameId i = 0; i < numBufs; i++)
+  {
+    referenced[i] = false;
+    position[i] = freeList.insert(freeList.end(), i);
+  }
+}
+
+TwoQPolicy::~TwoQPolicy()
+{
+  delete [] referenced;
+}
+
+void TwoQPolicy::unlink(const FrameId frame)
+{
+  switch (queueOf[frame])
+  {
+    case FREE:
+      freeList.erase(position[frame]);
+      break;
+    case A1IN:
+      a1in.erase(position[frame]);
+      break;
+    case AM:
+      am.erase(position[frame]);
+      break;
+    case NONE:
+      break;
+  }
+  queueOf[frame] = NONE;
+}
+
+bool TwoQPolicy::pickVictim(const File* file, const PageId pageNo,
+                            const FrameClaimer& claim, FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  std::list<FrameId>* queues[3] = {&freeList, &am, &a1in};
+  // reclaim from A1in while it is over its share, otherwise from Am
+  if (a1in.size() > kin)
+    std::swap(queues[1], queues[2]);
+
+  for (int q = 0; q < 3; q++)
+  {
+    if (claimFrom(*queues[q], queues[q] == &am, claim, frame))
+      return true;
+  }
+  return false;
+}
+
+bool TwoQPolicy::claimFrom(std::list<FrameId>& queue, const bool promote,
+                           const FrameClaimer& claim, FrameId& frame)
+{
+  // Each step either moves a referenced frame from just before <end> to the
+  // head of Am, clearing its flag, or moves <end> one frame towards the head.
+  std::list<FrameId>::iterator end = queue.end();
+  while (end != queue.begin())
+  {
+    std::list<FrameId>::iterator it = end;
+    --it;
+    if (promote && referenced[*it].exchange(false))
+    {
+      am.splice(am.begin(), queue, it);
+      continue;
+    }
+    if (claim(*it))
+    {
+      frame = *it;
+      return true;
+    }
+    end = it;
+  }
+  return false;
+}
+
+void TwoQPolicy::frameEvicted(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  // pages leaving the probation queue are remembered in A1out
+  if (queueOf[frame] == A1IN && a1outIndex.find(keys[frame]) == a1outIndex.end())
+  {
+    a1out.push_front(keys[frame]);
+    a1outIndex[keys[frame]] = a1out.begin();
+    if (a1out.size() > kout)
+    {
+      a1outIndex.erase(a1out.back());
+      a1out.pop_back();
+    }
+  }
+  unlink(frame);
+}
+
+void TwoQPolicy::frameLoaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  unlink(frame);
+  const BufPageKey key = {file, pageNo};
+  keys[frame] = key;
+  referenced[frame] = false;
+
+  std::unordered_map<BufPageKey, std::list<BufPageKey>::iterator, BufPageKeyHash>::iterator ghost = a1outIndex.find(key);
+  if (ghost != a1outIndex.end())
+  {
+    // re-read while remembered: the page is hot
+    a1out.erase(ghost->second);
+    a1outIndex.erase(ghost);
+    am.push_front(frame);
+    position[frame] = am.begin();
+    queueOf[frame] = AM;
+  }
+  else
+  {
+    a1in.push_front(frame);
+    position[frame] = a1in.begin();
+    queueOf[frame] = A1IN;
+  }
+}
+
+void TwoQPolicy::frameAccessed(const FrameId frame)
+{
+  // only honoured in Am: hits in A1in are correlated references and do not
+  // promote the page
+  if (! referenced[frame].load(std::memory_order_relaxed))
+    referenced[frame].store(true, std::memory_order_relaxed);
+}
+
+void TwoQPolicy::frameFreed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  unlink(frame);
+  position[frame] = freeList.insert(freeList.end(), frame);
+  queueOf[frame] = FREE;
+}
+
+void TwoQPolicy::candidateVictims(const std::uint32_t maxFrames, std::vector<FrameId>& frames)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  std::list<FrameId>* queues[2] = {&am, &a1in};
+  if (a1in.size() > kin)
+    std::swap(queues[0], queues[1]);
+
+  // referenced Am frames would be passed over
+  std::uint32_t listed = 0;
+  for (int q = 0; q < 2 && listed < maxFrames; q++)
+  {
+    for (std::list<FrameId>::reverse_iterator it = queues[q]->rbegin();
+         it != queues[q]->rend() && listed < maxFrames; ++it)
+    {
+      if (queues[q] == &am && referenced[*it])
+        continue;
+      frames.push_back(*it);
+      ++listed;
+    }
+  }
+}
+
+//----------------------------------------
+// ArcPolicy
+//----------------------------------------
+
+ArcPolicy::ArcPolicy(const std::uint32_t numBufs)
+  : capacity(numBufs), target(0),
+    queueOf(numBufs, FREE), position(numBufs), keys(numBufs)
+{
+  referenced = new std::atomic<bool>[numBufs];
+  for (FrameId i = 0; i < numBufs; i++)
+  {
+    referenced[i] = false;
+    position[i] = freeList.insert(freeList.end(), i);
+  }
+}
+
+ArcPolicy::~ArcPolicy()
+{
+  delete [] referenced;
+}
+
+void ArcPolicy::unlink(const FrameId frame)
+{
+  switch (queueOf[frame])
+  {
+    case FREE:
+      freeList.erase(position[frame]);
+      break;
+    case T1:
+      t1.erase(position[frame]);
+      break;
+    case T2:
+      t2.erase(position[frame]);
+      break;
+    case NONE:
+      break;
+  }
+  queueOf[frame] = NONE;
+}
+
+void ArcPolicy::remember(GhostList& ghosts, GhostIndex& index, const BufPageKey& key)
+{
+  forget(b1, b1Index, key);
+  forget(b2, b2Index, key);
+  ghosts.push_front(key);
+  index[key] = ghosts.begin();
+}
+
+void ArcPolicy::forget(GhostList& ghosts, GhostIndex& index, const BufPageKey& key)
+{
+  GhostIndex::iterator it = index.find(key);
+  if (it != index.end())
+  {
+    ghosts.erase(it->second);
+    index.erase(it);
+  }
+}
+
+bool ArcPolicy::claimFrom(std::list<FrameId>& queue, const FrameClaimer& claim, FrameId& frame)
+{
+  // Each step either moves a referenced frame from just before <end> to the
+  // head of T2, clearing its flag, or moves <end> one frame towards the head.
+  std::list<FrameId>::iterator end = queue.end();
+  while (end != queue.begin())
+  {
+    std::list<FrameId>::iterator it = end;
+    --it;
+    if (&queue != &freeList && referenced[*it].exchange(false))
+    {
+      t2.splice(t2.begin(), queue, it);
+      queueOf[*it] = T2;
+      continue;
+    }
+    if (claim(*it))
+    {
+      frame = *it;
+      return true;
+    }
+    end = it;
+  }
+  return false;
+}
+
+bool ArcPolicy::pickVictim(const File* file, const PageId pageNo,
+                           const FrameClaimer& claim, FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  if (claimFrom(freeList, claim, frame))
+    return true;
+
+  // REPLACE(x): take from T1 while it exceeds its target size
+  const BufPageKey key = {file, pageNo};
+  const bool inB2 = b2Index.find(key) != b2Index.end();
+  if (!t1.empty() && (t1.size() > target || (inB2 && t1.size() == target)))
+    return claimFrom(t1, claim, frame) || claimFrom(t2, claim, frame);
+  return claimFrom(t2, claim, frame) || claimFrom(t1, claim, frame);
+}
+
+void ArcPolicy::frameEvicted(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  if (queueOf[frame] == T1)
+    remember(b1, b1Index, keys[frame]);
+  else if (queueOf[frame] == T2)
+    remember(b2, b2Index, keys[frame]);
+  unlink(frame);
+}
+
+void ArcPolicy::frameLoaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  unlink(frame);
+  const BufPageKey key = {file, pageNo};
+  keys[frame] = key;
+  referenced[frame] = false;
+
+  if (b1Index.find(key) != b1Index.end())
+  {
+    // T1 was too small to keep this page: grow its target
+    target = std::min(capacity, target + std::max<std::size_t>(1, b2.size() / b1.size()));
+    forget(b1, b1Index, key);
+    t2.push_front(frame);
+    position[frame] = t2.begin();
+    queueOf[frame] = T2;
+  }
+  else if (b2Index.find(key) != b2Index.end())
+  {
+    // T2 was too small to keep this page: shrink T1's target
+    const std::size_t delta = std::max<std::size_t>(1, b1.size() / b2.size());
+    target = target > delta ? target - delta : 0;
+    forget(b2, b2Index, key);
+    t2.push_front(frame);
+    position[frame] = t2.begin();
+    queueOf[frame] = T2;
+  }
+  else
+  {
+    t1.push_front(frame);
+    position[frame] = t1.begin();
+    queueOf[frame] = T1;
+  }
+
+  // keep the directory within c pages for L1 and 2c pages overall
+  while (t1.size() + b1.size() > capacity && !b1.empty())
+  {
+    b1Index.erase(b1.back());
+    b1.pop_back();
+  }
+  while (t1.size() + t2.size() + b1.size() + b2.size() > 2 * capacity && !b2.empty())
+  {
+    b2Index.erase(b2.back());
+    b2.pop_back();
+  }
+}
+
+void ArcPolicy::frameAccessed(const FrameId frame)
+{
+  if (! referenced[frame].load(std::memory_order_relaxed))
+    referenced[frame].store(true, std::memory_order_relaxed);
+}
+
+void ArcPolicy::frameFreed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  unlink(frame);
+  position[frame] = freeList.insert(freeList.end(), frame);
+  queueOf[frame] = FREE;
+}
+
+void ArcPolicy::candidateVictims(const std::uint32_t maxFrames, std::vector<FrameId>& frames)
+{
+  std::lock_guard<std::mutex> guard(latch);
+
+  std::list<FrameId>* queues[2] = {&t2, &t1};
+  if (! t1.empty() && t1.size() > target)
+    std::swap(queues[0], queues[1]);
+
+  // referenced frames would be passed over
+  std::uint32_t listed = 0;
+  for (int q = 0; q < 2 && listed < maxFrames; q++)
+  {
+    for (std::list<FrameId>::reverse_iterator it = queues[q]->rbegin();
+         it != queues[q]->rend() && listed < maxFrames; ++it)
+    {
+      if (referenced[*it])
+        continue;
+      frames.push_back(*it);
+      ++listed;
+    }
+  }
+}
+
+}
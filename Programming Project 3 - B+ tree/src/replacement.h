@@ -0,0 +1,479 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "file.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Page replacement policies the buffer manager can be constructed with.
+ */
+enum ReplacementPolicyType {
+    CLOCK, /* Single reference bit clock */
+    LRU_K, /* LRU-2: evict the page whose second most recent reference is oldest */
+    TWO_Q, /* Full 2Q: FIFO probation queue, LRU main queue, ghost queue of recent evictions */
+    ARC /* Adaptive Replacement Cache */
+};
+
+/**
+ * @brief Identity of a page held in (or recently evicted from) the buffer pool.
+ */
+struct BufPageKey {
+  /**
+   * Identity of the file object the page was read through (File::id()).
+   * Unlike the object's address it is never reused, so a page of a file
+   * opened later cannot inherit the history of an evicted one.
+   */
+  std::uint64_t fileId;
+
+  /**
+   * Page number within the file.
+   */
+  PageId pageNo;
+
+  BufPageKey() : fileId(0), pageNo(Page::INVALID_NUMBER) {}
+  BufPageKey(const File* file, const PageId page) : fileId(file->id()), pageNo(page) {}
+
+  bool operator==(const BufPageKey& rhs) const {
+    return fileId == rhs.fileId && pageNo == rhs.pageNo;
+  }
+};
+
+/**
+ * @brief Hash functor for BufPageKey.
+ */
+struct BufPageKeyHash {
+  std::size_t operator()(const BufPageKey& key) const {
+    std::uint64_t h = key.fileId * 0xC2B2AE3D27D4EB4Full;
+    h ^= static_cast<std::uint64_t>(key.pageNo) * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(h ^ (h >> 29));
+  }
+};
+
+/**
+ * @brief Decides which buffer frame BufMgr::allocBuf gives up next.
+ *
+ * The buffer manager reports every event that changes the residency or
+ * recency of a frame, and asks the policy for a victim when it needs a frame.
+ * Policies only see frame numbers and page identities; pin counts, latches
+ * and write-back stay in BufMgr, which hands pickVictim() a callback that
+ * latches a candidate if it can be taken.
+ *
+ * All methods may be called concurrently from several threads.
+ * frameAccessed() is called on every buffer hit, so no policy takes a lock
+ * in it: hits are recorded in per-frame atomics, and the policies that keep
+ * an order reorder frames from them lazily, under their latch, when they
+ * next pick a victim.
+ */
+class ReplacementPolicy {
+ public:
+  /**
+   * Callback trying to take a frame.  Returns true, with the frame latched,
+   * if the frame is free or holds an unpinned page.
+   */
+  typedef std::function<bool(FrameId)> FrameClaimer;
+
+  /**
+   * Creates a policy of the given type for a pool of numBufs frames.
+   *
+   * @param type    Policy to create.
+   * @param numBufs Number of frames in the buffer pool.
+   * @return  The new policy; owned by the caller.
+   */
+  static ReplacementPolicy* create(const ReplacementPolicyType type, const std::uint32_t numBufs);
+
+  virtual ~ReplacementPolicy() {}
+
+  /**
+   * Chooses a frame to reuse, trying candidates in order of preference until
+   * claim() accepts one.
+   *
+   * @param file    File of the page the frame is wanted for.
+   * @param pageNo  Page number of the page the frame is wanted for, or
+   *                Page::INVALID_NUMBER if not yet known.
+   * @param claim   Callback that latches a candidate frame.
+   * @param frame   Claimed frame returned via this variable.
+   * @return  False if every frame was pinned or busy.
+   */
+  virtual bool pickVictim(const File* file, const PageId pageNo,
+                          const FrameClaimer& claim, FrameId& frame) = 0;
+
+  /**
+   * The frame returned by pickVictim() has been detached from its page and
+   * will be reused.
+   *
+   * @param frame   Frame number.
+   */
+  virtual void frameEvicted(const FrameId frame) = 0;
+
+  /**
+   * A page has been read or allocated into the frame.
+   *
+   * @param frame   Frame number.
+   * @param file    File the page belongs to.
+   * @param pageNo  Page number within the file.
+   */
+  virtual void frameLoaded(const FrameId frame, const File* file, const PageId pageNo) = 0;
+
+  /**
+   * The page in the frame was requested again.  Must not block.
+   *
+   * @param frame   Frame number.
+   */
+  virtual void frameAccessed(const FrameId frame) = 0;
+
+  /**
+   * The frame no longer holds a page: it was flushed, disposed of, or taken
+   * as a victim and then not used.
+   *
+   * @param frame   Frame number.
+   */
+  virtual void frameFreed(const FrameId frame) = 0;
+
+  /**
+   * Lists the frames pickVictim() would try first, without claiming any, so
+   * that their pages can be cleaned before they are needed.
+   *
+   * @param maxFrames Number of frames to list at most.
+   * @param frames    Frames are appended here, most likely victim first.
+   */
+  virtual void candidateVictims(const std::uint32_t maxFrames, std::vector<FrameId>& frames) = 0;
+};
+
+/**
+ * @brief Single reference bit clock, the buffer manager's original policy.
+ */
+class ClockPolicy : public ReplacementPolicy {
+ public:
+  explicit ClockPolicy(const std::uint32_t numBufs);
+  ~ClockPolicy();
+
+  bool pickVictim(const File* file, const PageId pageNo,
+                  const FrameClaimer& claim, FrameId& frame) override;
+  void frameEvicted(const FrameId frame) override;
+  void frameLoaded(const FrameId frame, const File* file, const PageId pageNo) override;
+  void frameAccessed(const FrameId frame) override;
+  void frameFreed(const FrameId frame) override;
+  void candidateVictims(const std::uint32_t maxFrames, std::vector<FrameId>& frames) override;
+
+ private:
+  /**
+   * Number of frames in the buffer pool.
+   */
+  std::uint32_t numBufs;
+
+  /**
+   * Current position of clockhand in our buffer pool.
+   */
+  std::atomic<FrameId> clockHand;
+
+  /**
+   * Has each buffer frame been referenced recently.
+   */
+  std::atomic<bool>* refbits;
+};
+
+/**
+ * @brief LRU-K with K = 2.
+ *
+ * Frames are ranked by the time of their second most recent reference;
+ * frames referenced only once rank first, oldest reference first.  Time is
+ * counted in page loads, so references between two loads count as one.  A
+ * hit only updates the frame's stamps; a frame whose stamps have moved on
+ * since it was ranked is ranked again when pickVictim() reaches it, so
+ * finding a victim neither sorts the pool nor sees stale ranks.  Reference
+ * history of evicted pages is retained for a while so that a page re-read
+ * soon after eviction keeps its rank.
+ */
+class LruKPolicy : public ReplacementPolicy {
+ public:
+  explicit LruKPolicy(const std::uint32_t numBufs);
+  ~LruKPolicy();
+
+  bool pickVictim(const File* file, const PageId pageNo,
+                  const FrameClaimer& claim, FrameId& frame) override;
+  void frameEvicted(const FrameId frame) override;
+  void frameLoaded(const FrameId frame, const File* file, const PageId pageNo) override;
+  void frameAccessed(const FrameId frame) override;
+  void frameFreed(const FrameId frame) override;
+  void candidateVictims(const std::uint32_t maxFrames, std::vector<FrameId>& frames) override;
+
+ private:
+  /**
+   * State of a frame.  NONE while it is between eviction and reload.
+   */
+  enum State { NONE, FREE, RESIDENT };
+
+  /**
+   * Reference history of an evicted page, most recent first.
+   */
+  struct History {
+    std::uint64_t last;
+    std::uint64_t previous;
+  };
+
+  /**
+   * Reference history of a resident page, updated by hits without the latch.
+   */
+  struct Stamps {
+    std::atomic<std::uint64_t> last;
+    std::atomic<std::uint64_t> previous;
+  };
+
+  /**
+   * Eviction order of a resident frame: second most recent reference (0 if
+   * referenced only once), then most recent reference, then frame number.
+   */
+  typedef std::pair<std::pair<std::uint64_t, std::uint64_t>, FrameId> Rank;
+
+  /**
+   * History of an evicted page and its place in the retention order.
+   */
+  struct Retained {
+    History history;
+    std::list<BufPageKey>::iterator position;
+  };
+
+  /**
+   * Returns the rank of a resident frame from its current stamps.
+   */
+  Rank rankOf(const FrameId frame) const;
+
+  /**
+   * Ranks the frame at the given position of the ranking again if hits have
+   * moved its stamps on, and returns the position of the next frame to
+   * consider: the same one if it was still ranked right.
+   */
+  std::set<Rank>::iterator rerank(const std::set<Rank>::iterator it);
+
+  /**
+   * Removes the frame from the free list or the ranking.
+   */
+  void unlink(const FrameId frame);
+
+  /**
+   * Latch protecting all of the state below but the stamps and the clock.
+   */
+  std::mutex latch;
+
+  /**
+   * Logical time, advanced on every page load, under the latch.
+   */
+  std::atomic<std::uint64_t> now;
+
+  /**
+   * Per frame: its references, updated on hits.
+   */
+  Stamps* stamps;
+
+  /**
+   * Per frame: its state, its position on the free list, its page, and the
+   * rank it is filed under in the ranking.
+   */
+  std::vector<State> stateOf;
+  std::vector<std::list<FrameId>::iterator> position;
+  std::vector<BufPageKey> keys;
+  std::vector<Rank> ranked;
+
+  /**
+   * Frames holding no page, taken before any resident frame.
+   */
+  std::list<FrameId> freeList;
+
+  /**
+   * Resident frames, next victim first as of the last time each was ranked.
+   */
+  std::set<Rank> ranking;
+
+  /**
+   * History of recently evicted pages and their eviction order, bounded to
+   * one entry per frame.
+   */
+  std::unordered_map<BufPageKey, Retained, BufPageKeyHash> retained;
+  std::list<BufPageKey> retainedOrder;
+};
+
+/**
+ * @brief Full 2Q (Johnson and Shasha).
+ *
+ * New pages enter the A1in FIFO.  Pages evicted from A1in are remembered in
+ * the A1out ghost queue; if they are read again while remembered they go to
+ * the Am LRU queue, which holds the pages proven to be hot.  A hit only sets
+ * the frame's reference flag; pickVictim() moves a flagged Am frame it finds
+ * at the tail back to the head instead of taking it.
+ */
+class TwoQPolicy : public ReplacementPolicy {
+ public:
+  explicit TwoQPolicy(const std::uint32_t numBufs);
+  ~TwoQPolicy();
+
+  bool pickVictim(const File* file, const PageId pageNo,
+                  const FrameClaimer& claim, FrameId& frame) override;
+  void frameEvicted(const FrameId frame) override;
+  void frameLoaded(const FrameId frame, const File* file, const PageId pageNo) override;
+  void frameAccessed(const FrameId frame) override;
+  void frameFreed(const FrameId frame) override;
+  void candidateVictims(const std::uint32_t maxFrames, std::vector<FrameId>& frames) override;
+
+ private:
+  /**
+   * Queue a frame is on.  NONE while it is between eviction and reload.
+   */
+  enum Queue { NONE, FREE, A1IN, AM };
+
+  /**
+   * Removes the frame from whichever queue holds it.
+   */
+  void unlink(const FrameId frame);
+
+  /**
+   * Claims the least recently used frame of the queue that claim() accepts.
+   * If promote is set, referenced frames move to the head of Am instead.
+   */
+  bool claimFrom(std::list<FrameId>& queue, const bool promote,
+                 const FrameClaimer& claim, FrameId& frame);
+
+  /**
+   * Per frame: whether it was hit since it was loaded or last promoted.
+   * Set without the latch.
+   */
+  std::atomic<bool>* referenced;
+
+  /**
+   * Latch protecting all of the state below.
+   */
+  std::mutex latch;
+
+  /**
+   * Target sizes of A1in (a quarter of the pool) and A1out (half the pool).
+   */
+  std::size_t kin;
+  std::size_t kout;
+
+  /**
+   * Per frame: its queue, its position in that queue, and its page.
+   */
+  std::vector<Queue> queueOf;
+  std::vector<std::list<FrameId>::iterator> position;
+  std::vector<BufPageKey> keys;
+
+  /**
+   * Resident queues, most recent at the front.
+   */
+  std::list<FrameId> freeList;
+  std::list<FrameId> a1in;
+  std::list<FrameId> am;
+
+  /**
+   * Ghost queue of pages recently evicted from A1in, with an index into it.
+   */
+  std::list<BufPageKey> a1out;
+  std::unordered_map<BufPageKey, std::list<BufPageKey>::iterator, BufPageKeyHash> a1outIndex;
+};
+
+/**
+ * @brief Adaptive Replacement Cache (Megiddo and Modha).
+ *
+ * T1 holds pages seen once recently and T2 pages seen at least twice; B1 and
+ * B2 remember pages recently evicted from each.  Hits in the ghost lists
+ * shift the target size of T1 towards whichever list would have kept the
+ * page.  As in CAR (Bansal and Modha), a hit only sets the frame's
+ * reference flag; pickVictim() moves a flagged frame it finds at the tail of
+ * T1 or T2 to the head of T2 instead of taking it.
+ */
+class ArcPolicy : public ReplacementPolicy {
+ public:
+  explicit ArcPolicy(const std::uint32_t numBufs);
+  ~ArcPolicy();
+
+  bool pickVictim(const File* file, const PageId pageNo,
+                  const FrameClaimer& claim, FrameId& frame) override;
+  void frameEvicted(const FrameId frame) override;
+  void frameLoaded(const FrameId frame, const File* file, const PageId pageNo) override;
+  void frameAccessed(const FrameId frame) override;
+  void frameFreed(const FrameId frame) override;
+  void candidateVictims(const std::uint32_t maxFrames, std::vector<FrameId>& frames) override;
+
+ private:
+  /**
+   * Queue a frame is on.  NONE while it is between eviction and reload.
+   */
+  enum Queue { NONE, FREE, T1, T2 };
+
+  typedef std::list<BufPageKey> GhostList;
+  typedef std::unordered_map<BufPageKey, GhostList::iterator, BufPageKeyHash> GhostIndex;
+
+  /**
+   * Removes the frame from whichever queue holds it.
+   */
+  void unlink(const FrameId frame);
+
+  /**
+   * Adds the page to the front of a ghost list, or removes it from one.
+   */
+  void remember(GhostList& ghosts, GhostIndex& index, const BufPageKey& key);
+  void forget(GhostList& ghosts, GhostIndex& index, const BufPageKey& key);
+
+  /**
+   * Claims the least recently used frame of the queue that claim() accepts,
+   * moving referenced frames to the head of T2 on the way.
+   */
+  bool claimFrom(std::list<FrameId>& queue, const FrameClaimer& claim, FrameId& frame);
+
+  /**
+   * Per frame: whether it was hit since it was loaded or last promoted.
+   * Set without the latch.
+   */
+  std::atomic<bool>* referenced;
+
+  /**
+   * Latch protecting all of the state below.
+   */
+  std::mutex latch;
+
+  /**
+   * Number of frames (c), and the adaptive target size of T1 (p).
+   */
+  std::size_t capacity;
+  std::size_t target;
+
+  /**
+   * Per frame: its queue, its position in that queue, and its page.
+   */
+  std::vector<Queue> queueOf;
+  std::vector<std::list<FrameId>::iterator> position;
+  std::vector<BufPageKey> keys;
+
+  /**
+   * Resident queues, most recent at the front.
+   */
+  std::list<FrameId> freeList;
+  std::list<FrameId> t1;
+  std::list<FrameId> t2;
+
+  /**
+   * Ghost lists of pages evicted from T1 and T2, with indexes into them.
+   */
+  GhostList b1;
+  GhostList b2;
+  GhostIndex b1Index;
+  GhostIndex b2Index;
+};
+
+}